@@ -0,0 +1,119 @@
+#ifndef L3KV_ENGINE_ARENA_HPP
+#define L3KV_ENGINE_ARENA_HPP
+
+/*
+ * SHARD ARENA - SIZE-CLASSED VALUE STORAGE
+ *
+ * - Allocations up to LARGEST_POOLED bytes are served from per-size-class
+ *   pools (std::pmr::synchronized_pool_resource): small documents are packed
+ *   into shared slabs instead of one malloc each.
+ * - Larger requests bypass the pools and get a dedicated extent straight
+ *   from the upstream resource, so big documents never pin a slab.
+ * - Chunks grow geometrically, which keeps the number of fresh mappings (and
+ *   page faults) during bulk loads logarithmic in the data size.
+ *
+ * Accounting:
+ * - `live_bytes` / `live_allocs`: what callers currently hold.
+ * - `reserved_bytes`: what the arena holds from upstream (slabs + extents).
+ *   reserved - live is pool slack and fragmentation.
+ *
+ * Deallocation may come from any thread (epoch reclamation, ValueRef
+ * release), hence the synchronized pool.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace l3kv {
+
+class ShardArena : public std::pmr::memory_resource {
+public:
+  static constexpr size_t LARGEST_POOLED = 64 * 1024;
+
+  struct Stats {
+    uint64_t live_bytes = 0;
+    uint64_t live_allocs = 0;
+    uint64_t reserved_bytes = 0;
+
+    Stats &operator+=(const Stats &o) {
+      live_bytes += o.live_bytes;
+      live_allocs += o.live_allocs;
+      reserved_bytes += o.reserved_bytes;
+      return *this;
+    }
+  };
+
+  explicit ShardArena(
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream), pool_(pool_options(), &upstream_) {}
+
+  ShardArena(const ShardArena &) = delete;
+  ShardArena &operator=(const ShardArena &) = delete;
+
+  Stats stats() const {
+    return {live_bytes_.load(std::memory_order_relaxed),
+            live_allocs_.load(std::memory_order_relaxed),
+            upstream_.reserved()};
+  }
+
+private:
+  // Counts what the pool takes from (and returns to) the system.
+  class CountingResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource *next_;
+    std::atomic<uint64_t> reserved_{0};
+
+  public:
+    explicit CountingResource(std::pmr::memory_resource *next) : next_(next) {}
+    uint64_t reserved() const {
+      return reserved_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void *do_allocate(size_t bytes, size_t align) override {
+      void *p = next_->allocate(bytes, align);
+      reserved_.fetch_add(bytes, std::memory_order_relaxed);
+      return p;
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+      next_->deallocate(p, bytes, align);
+      reserved_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    bool do_is_equal(const memory_resource &o) const noexcept override {
+      return this == &o;
+    }
+  };
+
+  static std::pmr::pool_options pool_options() {
+    std::pmr::pool_options opts;
+    opts.largest_required_pool_block = LARGEST_POOLED;
+    return opts;
+  }
+
+  void *do_allocate(size_t bytes, size_t align) override {
+    void *p = pool_.allocate(bytes, align);
+    live_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    live_allocs_.fetch_add(1, std::memory_order_relaxed);
+    return p;
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    pool_.deallocate(p, bytes, align);
+    live_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    live_allocs_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  bool do_is_equal(const memory_resource &o) const noexcept override {
+    return this == &o;
+  }
+
+  CountingResource upstream_; // Declared before pool_: outlives it
+  std::pmr::synchronized_pool_resource pool_;
+  std::atomic<uint64_t> live_bytes_{0};
+  std::atomic<uint64_t> live_allocs_{0};
+};
+
+} // namespace l3kv
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef L3KV_ENGINE_BUCKET_INDEX_HPP
+#define L3KV_ENGINE_BUCKET_INDEX_HPP
+
+/*
+ * MERKLE BUCKET -> KEYS INDEX
+ *
+ * Anti-entropy asks for "all keys in leaf bucket B". Scanning every shard
+ * for that is O(keyspace); this index makes it O(bucket size).
+ *
+ * - One key list per Merkle leaf bucket (MerkleTree::bucket_of).
+ * - A key is added exactly once, when it first enters a shard index, and
+ *   removed if it ever leaves it. Deletes are tombstones and keep their key
+ *   listed: sync has to ship them too.
+ * - Buckets are guarded by 256 striped mutexes (same split as MerkleTree),
+ *   so inserts to different stripes never contend and readers only block
+ *   the stripe they copy.
+ */
+
+#include "merkle.hpp"
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace l3kv {
+
+class BucketIndex {
+public:
+  static constexpr size_t BUCKETS = 65536;
+  static constexpr size_t STRIPES = 256;
+
+  BucketIndex() : buckets_(BUCKETS) {}
+
+  BucketIndex(const BucketIndex &) = delete;
+  BucketIndex &operator=(const BucketIndex &) = delete;
+
+  // Caller guarantees `key` is not present yet.
+  void add(std::string_view key) {
+    uint32_t b = MerkleTree::bucket_of(key);
+    std::lock_guard lock(stripe(b));
+    buckets_[b].emplace_back(key);
+  }
+
+  void remove(std::string_view key) {
+    uint32_t b = MerkleTree::bucket_of(key);
+    std::lock_guard lock(stripe(b));
+    auto &keys = buckets_[b];
+    auto it = std::find(keys.begin(), keys.end(), key);
+    if (it != keys.end()) {
+      *it = std::move(keys.back());
+      keys.pop_back();
+    }
+  }
+
+  std::vector<std::string> keys(uint32_t bucket) const {
+    if (bucket >= BUCKETS)
+      return {};
+    std::lock_guard lock(stripe(bucket));
+    return buckets_[bucket];
+  }
+
+private:
+  std::mutex &stripe(uint32_t bucket) const {
+    return stripes_[bucket % STRIPES];
+  }
+
+  std::vector<std::vector<std::string>> buckets_;
+  mutable std::array<std::mutex, STRIPES> stripes_;
+};
+
+} // namespace l3kv
+
+#endif
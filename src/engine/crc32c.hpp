@@ -0,0 +1,175 @@
+#ifndef L3KV_ENGINE_CRC32C_HPP
+#define L3KV_ENGINE_CRC32C_HPP
+
+/*
+ * CRC32C (CASTAGNOLI) - WAL RECORD CHECKSUMS
+ *
+ * Implementations:
+ * - Hardware: SSE4.2 `crc32` instruction on x86-64 (8 bytes per instruction)
+ *   or the ARMv8 CRC32 extension when the compiler targets it.
+ * - Portable: slicing-by-8 over eight 256-entry tables (one table lookup
+ *   per input byte, eight independent lookups per 64-bit word).
+ *
+ * `extend()` picks the hardware path once at runtime via CPUID, so the same
+ * binary runs on CPUs without SSE4.2. Both paths produce identical values.
+ *
+ * Convention (as in LevelDB/RocksDB): `extend(crc, ...)` continues a
+ * finished CRC, so `extend(extend(0, a), b) == value(a + b)`.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#define L3KV_CRC32C_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define L3KV_CRC32C_TARGET
+#else
+#include <cpuid.h>
+#define L3KV_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define L3KV_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace l3kv::crc32c {
+
+namespace detail {
+
+constexpr uint32_t POLY = 0x82F63B78; // Castagnoli, reflected
+
+constexpr std::array<std::array<uint32_t, 256>, 8> make_tables() {
+  std::array<std::array<uint32_t, 256>, 8> t{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k)
+      c = (c >> 1) ^ (POLY & (0u - (c & 1)));
+    t[0][i] = c;
+  }
+  for (size_t k = 1; k < 8; ++k) {
+    for (uint32_t i = 0; i < 256; ++i)
+      t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+  }
+  return t;
+}
+
+inline constexpr auto TABLES = make_tables();
+
+} // namespace detail
+
+// Slicing-by-8. Assumes a little-endian host (x86, ARM).
+inline uint32_t extend_portable(uint32_t crc, const void *data, size_t n) {
+  const auto &t = detail::TABLES;
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint32_t l = ~crc;
+
+  while (n && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    l = t[0][(l ^ *p++) & 0xFF] ^ (l >> 8);
+    --n;
+  }
+  while (n >= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    w ^= l;
+    l = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^ t[5][(w >> 16) & 0xFF] ^
+        t[4][(w >> 24) & 0xFF] ^ t[3][(w >> 32) & 0xFF] ^
+        t[2][(w >> 40) & 0xFF] ^ t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+    p += 8;
+    n -= 8;
+  }
+  while (n--)
+    l = t[0][(l ^ *p++) & 0xFF] ^ (l >> 8);
+  return ~l;
+}
+
+#if defined(L3KV_CRC32C_X86)
+
+inline bool hardware_available() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return false;
+  return (c & bit_SSE4_2) != 0;
+#endif
+}
+
+// Only call when hardware_available().
+L3KV_CRC32C_TARGET inline uint32_t extend_hardware(uint32_t crc,
+                                                   const void *data, size_t n) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint64_t l = ~crc;
+
+  while (n && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    l = _mm_crc32_u8((uint32_t)l, *p++);
+    --n;
+  }
+  while (n >= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    l = _mm_crc32_u64(l, w);
+    p += 8;
+    n -= 8;
+  }
+  while (n--)
+    l = _mm_crc32_u8((uint32_t)l, *p++);
+  return ~(uint32_t)l;
+}
+
+#elif defined(L3KV_CRC32C_ARM)
+
+inline bool hardware_available() { return true; }
+
+inline uint32_t extend_hardware(uint32_t crc, const void *data, size_t n) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  uint32_t l = ~crc;
+  while (n >= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    l = __crc32cd(l, w);
+    p += 8;
+    n -= 8;
+  }
+  while (n--)
+    l = __crc32cb(l, *p++);
+  return ~l;
+}
+
+#else
+
+inline bool hardware_available() { return false; }
+
+inline uint32_t extend_hardware(uint32_t crc, const void *data, size_t n) {
+  return extend_portable(crc, data, n);
+}
+
+#endif
+
+using ExtendFn = uint32_t (*)(uint32_t, const void *, size_t);
+
+inline ExtendFn best_implementation() {
+  return hardware_available() ? &extend_hardware : &extend_portable;
+}
+
+inline const char *implementation_name() {
+  return hardware_available() ? "hardware" : "slicing-by-8";
+}
+
+inline uint32_t extend(uint32_t crc, const void *data, size_t n) {
+  static const ExtendFn fn = best_implementation();
+  return fn(crc, data, n);
+}
+
+inline uint32_t value(const void *data, size_t n) { return extend(0, data, n); }
+
+} // namespace l3kv::crc32c
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef L3KV_ENGINE_EPOCH_HPP
+#define L3KV_ENGINE_EPOCH_HPP
+
+/*
+ * EPOCH-BASED RECLAMATION (EBR)
+ *
+ * Read Path:
+ * - A reader announces the global epoch in its own cache-line-sized slot and
+ *   clears it on exit. No shared cache line is written, so readers on
+ *   different cores never contend.
+ *
+ * Write Path:
+ * - Writers publish a new immutable object (Copy-on-Write) with an atomic
+ *   pointer swap, then `retire()` the old one tagged with the epoch it was
+ *   unlinked in.
+ * - A retired object is freed once every active reader announced a newer
+ *   epoch, i.e. nobody can still hold a pointer to it.
+ *
+ * Limbo lists live in the per-thread slots so writers on different shards
+ * don't serialize on a global lock. `synchronize()` drains every list and is
+ * used by owners (e.g. Engine) before tearing down memory the deleters touch.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace l3kv {
+
+class EpochManager {
+public:
+  static constexpr size_t MAX_THREADS = 256;
+  static constexpr size_t RECLAIM_THRESHOLD = 64;
+
+  using Deleter = void (*)(void *);
+
+  static EpochManager &instance() {
+    static EpochManager mgr;
+    return mgr;
+  }
+
+  // RAII read-side critical section. Nesting is allowed.
+  class Guard {
+  public:
+    Guard() { EpochManager::instance().enter(); }
+    ~Guard() { EpochManager::instance().exit(); }
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+  };
+
+  void enter() {
+    auto &ts = local();
+    if (ts.depth++ == 0) {
+      // seq_cst store orders the announcement before any pointer load below
+      ts.slot->epoch.store(global_.load(std::memory_order_relaxed),
+                           std::memory_order_seq_cst);
+    }
+  }
+
+  void exit() {
+    auto &ts = local();
+    if (--ts.depth == 0)
+      ts.slot->epoch.store(IDLE, std::memory_order_release);
+  }
+
+  void retire(void *p, Deleter deleter) {
+    if (!p)
+      return;
+    uint64_t e = global_.fetch_add(1, std::memory_order_seq_cst);
+    Slot *slot = local().slot;
+    size_t pending;
+    {
+      std::lock_guard lock(slot->limbo_mx);
+      slot->limbo.push_back({e, p, deleter});
+      pending = slot->limbo.size();
+    }
+    if (pending >= RECLAIM_THRESHOLD)
+      reclaim(*slot, min_active_epoch());
+  }
+
+  template <class T> void retire(T *p) {
+    retire(p, [](void *q) { delete static_cast<T *>(q); });
+  }
+
+  // Waits for a full grace period and frees everything retired before it.
+  // Must not be called from inside a Guard.
+  void synchronize() {
+    uint64_t e = global_.fetch_add(1, std::memory_order_seq_cst);
+    for (auto &slot : slots_) {
+      while (true) {
+        uint64_t v = slot.epoch.load(std::memory_order_seq_cst);
+        if (v == IDLE || v > e)
+          break;
+        std::this_thread::yield();
+      }
+    }
+    for (auto &slot : slots_)
+      reclaim(slot, e + 1);
+  }
+
+  uint64_t current_epoch() const {
+    return global_.load(std::memory_order_relaxed);
+  }
+
+  ~EpochManager() {
+    for (auto &slot : slots_)
+      reclaim(slot, IDLE);
+  }
+
+private:
+  static constexpr uint64_t IDLE = std::numeric_limits<uint64_t>::max();
+
+  struct Retired {
+    uint64_t epoch;
+    void *p;
+    Deleter deleter;
+  };
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{IDLE};
+    std::atomic<bool> in_use{false};
+    std::mutex limbo_mx;
+    std::vector<Retired> limbo;
+  };
+
+  struct ThreadState {
+    Slot *slot = nullptr;
+    uint32_t depth = 0;
+    ~ThreadState() {
+      // Limbo entries stay in the slot for the next owner or synchronize()
+      if (slot)
+        slot->in_use.store(false, std::memory_order_release);
+    }
+  };
+
+  EpochManager() = default;
+
+  ThreadState &local() {
+    thread_local ThreadState ts;
+    if (!ts.slot)
+      ts.slot = acquire_slot();
+    return ts;
+  }
+
+  Slot *acquire_slot() {
+    while (true) {
+      for (auto &slot : slots_) {
+        bool expected = false;
+        if (!slot.in_use.load(std::memory_order_relaxed) &&
+            slot.in_use.compare_exchange_strong(expected, true,
+                                                std::memory_order_acq_rel))
+          return &slot;
+      }
+      std::this_thread::yield(); // More than MAX_THREADS live participants
+    }
+  }
+
+  uint64_t min_active_epoch() const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t min = IDLE;
+    for (auto &slot : slots_) {
+      uint64_t v = slot.epoch.load(std::memory_order_seq_cst);
+      if (v < min)
+        min = v;
+    }
+    return min;
+  }
+
+  // Frees entries retired strictly before `safe_epoch`.
+  static void reclaim(Slot &slot, uint64_t safe_epoch) {
+    std::vector<Retired> ready;
+    {
+      std::lock_guard lock(slot.limbo_mx);
+      auto it = slot.limbo.begin();
+      for (auto &r : slot.limbo) {
+        if (r.epoch < safe_epoch)
+          ready.push_back(r);
+        else
+          *it++ = r;
+      }
+      slot.limbo.erase(it, slot.limbo.end());
+    }
+    for (auto &r : ready)
+      r.deleter(r.p);
+  }
+
+  std::atomic<uint64_t> global_{1};
+  Slot slots_[MAX_THREADS];
+};
+
+} // namespace l3kv
+
+#endif
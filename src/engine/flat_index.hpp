@@ -0,0 +1,257 @@
+#ifndef L3KV_ENGINE_FLAT_INDEX_HPP
+#define L3KV_ENGINE_FLAT_INDEX_HPP
+
+/*
+ * FLAT INDEX - SWISS-TABLE STYLE OPEN ADDRESSING
+ *
+ * Layout:
+ * - Slots are grouped by 16. Each group has 16 control bytes: 0x80 = empty,
+ *   otherwise the top 7 bits of the key hash (H2 fingerprint).
+ * - A probe loads a whole control group and compares all 16 fingerprints in
+ *   one SSE2 instruction (SWAR fallback elsewhere); only fingerprint hits
+ *   touch the slot array.
+ * - A Slot (32 bytes, two per cache line) holds the full hash, the key inline
+ *   when it fits in 14 bytes (else a pointer to a stable heap copy) and the
+ *   value pointer. A hit is: ctrl group -> slot -> value.
+ *
+ * Concurrency:
+ * - Insert-only: keys are never erased (deletes are tombstone values).
+ * - One writer at a time (caller serializes); any number of readers under an
+ *   EpochManager::Guard. A slot is fully written before its control byte is
+ *   released, and growth publishes a new table and retires the old one.
+ *   Long-key copies are shared between generations and owned by the index.
+ */
+
+#include "epoch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define L3KV_FLAT_INDEX_SSE2 1
+#endif
+
+namespace l3kv {
+
+template <class T> class FlatIndex {
+public:
+  static constexpr size_t GROUP = 16;
+  static constexpr size_t INLINE_KEY = 14;
+
+  explicit FlatIndex(size_t capacity = 1024)
+      : table_(new Table(groups_for(capacity))) {}
+
+  ~FlatIndex() {
+    Table *t = table_.load(std::memory_order_relaxed);
+    for_each_slot(*t, [](Slot &s) {
+      if (s.len > INLINE_KEY)
+        delete[] s.heap_key();
+    });
+    delete t;
+  }
+
+  FlatIndex(const FlatIndex &) = delete;
+  FlatIndex &operator=(const FlatIndex &) = delete;
+
+  // Reader side: caller holds an EpochManager::Guard (or is the writer).
+  std::atomic<T *> *find(std::string_view key, uint64_t hash) const {
+    const Table *t = table_.load(std::memory_order_acquire);
+    const uint8_t h2 = fingerprint(hash);
+    size_t g = home_group(*t, hash);
+    for (size_t step = 1;; ++step) {
+      const uint8_t *ctrl = t->groups[g].ctrl;
+      for (uint32_t m = match(ctrl, h2); m; m &= m - 1) {
+        size_t i = std::countr_zero(m);
+        if (load_ctrl(ctrl, i) != h2)
+          continue; // Raced with an in-flight insert
+        Slot &s = t->slots[g * GROUP + i];
+        if (s.hash == hash && s.key() == key)
+          return &s.value;
+      }
+      if (match(ctrl, EMPTY))
+        return nullptr;
+      g = (g + step) & t->group_mask;
+    }
+  }
+
+  // Pulls the home control group and first slots of `hash` into cache, so
+  // a batch of lookups can overlap their misses. Same Guard rule as find().
+  void prefetch(uint64_t hash) const {
+    const Table *t = table_.load(std::memory_order_acquire);
+    size_t g = home_group(*t, hash);
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(t->groups[g].ctrl);
+    __builtin_prefetch(&t->slots[g * GROUP]);
+#endif
+  }
+
+  // Writer side: caller serializes all inserts. `*inserted` (if given) is
+  // set to whether the key was new.
+  std::atomic<T *> &find_or_insert(std::string_view key, uint64_t hash,
+                                   bool *inserted = nullptr) {
+    if (inserted)
+      *inserted = false;
+    if (auto *v = find(key, hash))
+      return *v;
+    if (inserted)
+      *inserted = true;
+    Table *t = table_.load(std::memory_order_relaxed);
+    if ((size_ + 1) * 8 > capacity(*t) * 7)
+      t = grow(t);
+
+    Slot &s = claim(*t, hash, [&](Slot &slot) {
+      slot.hash = hash;
+      slot.len = static_cast<uint16_t>(key.size());
+      if (key.size() <= INLINE_KEY) {
+        std::memcpy(slot.bytes, key.data(), key.size());
+      } else {
+        char *copy = new char[key.size()];
+        std::memcpy(copy, key.data(), key.size());
+        std::memcpy(slot.bytes, &copy, sizeof(copy));
+      }
+    });
+    ++size_;
+    return s.value;
+  }
+
+  // Visits every (key, value) pair of the current table. Readers must hold
+  // a Guard; entries inserted during the walk may or may not be visited.
+  template <class F> void for_each(F f) const {
+    const Table *t = table_.load(std::memory_order_acquire);
+    for_each_slot(*t, [&](Slot &s) { f(s.key(), s.value); });
+  }
+
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uint8_t EMPTY = 0x80;
+
+  struct Slot {
+    uint64_t hash = 0;
+    std::atomic<T *> value{nullptr};
+    uint16_t len = 0;
+    char bytes[INLINE_KEY]; // Inline key, or a `const char *` to a heap copy
+
+    const char *heap_key() const {
+      const char *p;
+      std::memcpy(&p, bytes, sizeof(p));
+      return p;
+    }
+    std::string_view key() const {
+      return {len <= INLINE_KEY ? bytes : heap_key(), len};
+    }
+  };
+  static_assert(sizeof(void *) <= INLINE_KEY);
+
+  struct alignas(GROUP) Group {
+    uint8_t ctrl[GROUP];
+  };
+
+  struct Table {
+    size_t group_mask;
+    std::unique_ptr<Group[]> groups;
+    std::unique_ptr<Slot[]> slots;
+    explicit Table(size_t n_groups)
+        : group_mask(n_groups - 1), groups(new Group[n_groups]),
+          slots(new Slot[n_groups * GROUP]) {
+      for (size_t g = 0; g < n_groups; ++g)
+        std::memset(groups[g].ctrl, EMPTY, GROUP);
+    }
+  };
+
+  std::atomic<Table *> table_;
+  size_t size_ = 0;
+
+  static size_t groups_for(size_t capacity) {
+    return std::bit_ceil(std::max<size_t>(1, (capacity + GROUP - 1) / GROUP));
+  }
+  static size_t capacity(const Table &t) { return (t.group_mask + 1) * GROUP; }
+  static uint8_t fingerprint(uint64_t hash) { return (hash >> 57) & 0x7F; }
+  // Low bits are left to the caller (e.g. shard selection).
+  static size_t home_group(const Table &t, uint64_t hash) {
+    return (hash >> 7) & t.group_mask;
+  }
+
+  static uint8_t load_ctrl(const uint8_t *ctrl, size_t i) {
+    return std::atomic_ref<uint8_t>(const_cast<uint8_t &>(ctrl[i]))
+        .load(std::memory_order_acquire);
+  }
+
+  // Bitmask of control bytes in the group equal to `b`.
+  static uint32_t match(const uint8_t *ctrl, uint8_t b) {
+#ifdef L3KV_FLAT_INDEX_SSE2
+    __m128i group = _mm_load_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)b))));
+#else
+    uint32_t mask = 0;
+    for (size_t half = 0; half < 2; ++half) {
+      uint64_t w;
+      std::memcpy(&w, ctrl + half * 8, 8);
+      uint64_t x = w ^ (0x0101010101010101ULL * b);
+      uint64_t hits = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+      while (hits) {
+        // SWAR can report false positives above a true hit; callers re-check
+        int bit = std::countr_zero(hits);
+        mask |= 1u << (half * 8 + bit / 8);
+        hits &= hits - 1;
+      }
+    }
+    return mask;
+#endif
+  }
+
+  // Finds the first empty slot on `hash`'s probe sequence, fills it with
+  // `init` and then publishes its control byte.
+  template <class Init>
+  static Slot &claim(Table &t, uint64_t hash, Init init) {
+    size_t g = home_group(t, hash);
+    for (size_t step = 1;; ++step) {
+      uint8_t *ctrl = t.groups[g].ctrl;
+      if (uint32_t m = match(ctrl, EMPTY)) {
+        size_t i = std::countr_zero(m);
+        Slot &s = t.slots[g * GROUP + i];
+        init(s);
+        std::atomic_ref<uint8_t>(ctrl[i]).store(fingerprint(hash),
+                                                std::memory_order_release);
+        return s;
+      }
+      g = (g + step) & t.group_mask;
+    }
+  }
+
+  template <class F> static void for_each_slot(const Table &t, F f) {
+    for (size_t g = 0; g <= t.group_mask; ++g) {
+      for (size_t i = 0; i < GROUP; ++i) {
+        if (load_ctrl(t.groups[g].ctrl, i) != EMPTY)
+          f(t.slots[g * GROUP + i]);
+      }
+    }
+  }
+
+  Table *grow(Table *old) {
+    auto *t = new Table((old->group_mask + 1) * 2);
+    for_each_slot(*old, [&](Slot &src) {
+      claim(*t, src.hash, [&](Slot &dst) {
+        dst.hash = src.hash;
+        dst.len = src.len;
+        std::memcpy(dst.bytes, src.bytes, INLINE_KEY);
+        dst.value.store(src.value.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+      });
+    });
+    table_.store(t, std::memory_order_release);
+    EpochManager::instance().retire(old);
+    return t;
+  }
+};
+
+} // namespace l3kv
+
+#endif
@@ -0,0 +1,424 @@
+#ifndef L3KV_ENGINE_HEAP_IMAGE_HPP
+#define L3KV_ENGINE_HEAP_IMAGE_HPP
+
+/*
+ * HEAP IMAGES - MEMORY-MAPPED CHECKPOINTS
+ *
+ * The alternative checkpoint format (CheckpointOptions::Format::HEAP). A
+ * heap image holds the same entries as a snapshot, but laid out to be used
+ * in place: a restart maps the newest image and validates its header, and
+ * the entries are read straight from the mapping when first touched. Each
+ * image is one generation, named after its LSN: "<lsn as 16 hex>.heap".
+ *
+ *   Header:  [Magic:8 "L3KVHEAP"][CRC32C:4][Version:4][LSN:8][Count:8]
+ *            [TreeOff:8][IndexOff:8][Size:8][Wall:8][Logical:4][Node:4]
+ *   Records: snapshot entries (see snapshot.hpp), from HEADER_SIZE on
+ *   Tree:    [CRC32C:4][Nodes:4][Hash:8 x Nodes]             at TreeOff
+ *   Index:   [KeyHash:8][Offset:8] x Count, by KeyHash      at IndexOff
+ *
+ * - Every position is an offset from the start of the file, so the image
+ *   means the same wherever it is mapped.
+ * - The header CRC covers the rest of the header; Size is the file size.
+ *   Wall/Logical/Node is the newest entry timestamp, for the clock.
+ *   Opening checks both and the tree CRC, nothing proportional to the
+ *   entry count. Each record's own CRC is checked when it is read.
+ * - KeyHash is fnv1a_64 of the key. Its top 16 bits are the Merkle leaf
+ *   bucket, so a bucket's keys are one contiguous run of the index.
+ * - Written to "<name>.tmp", synced, then renamed into place, like a
+ *   snapshot: a generation either exists complete or not at all.
+ */
+
+#include "merkle.hpp"
+#include "snapshot.hpp"
+#include "wal_mmap.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace l3kv::heap {
+
+using snapshot::Entry;
+
+// File of the image at `lsn` in `dir`.
+inline std::string path_of(const std::string &dir, uint64_t lsn) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016" PRIx64 ".heap", lsn);
+  return (std::filesystem::path(dir) / name).string();
+}
+
+namespace detail {
+
+constexpr char MAGIC[8] = {'L', '3', 'K', 'V', 'H', 'E', 'A', 'P'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 72;
+constexpr size_t CRC_OFFSET = 8;
+constexpr size_t TREE_HEADER_SIZE = 8;
+constexpr size_t SLOT_SIZE = 16;
+
+struct Header {
+  uint32_t version = VERSION;
+  uint64_t lsn = 0;
+  uint64_t count = 0;
+  uint64_t tree_off = 0;
+  uint64_t index_off = 0;
+  uint64_t size = 0;
+  Timestamp max_ts{0, 0, 0};
+};
+
+// Header bytes, CRC included.
+inline void encode_header(const Header &h, uint8_t (&out)[HEADER_SIZE]) {
+  std::memset(out, 0, sizeof(out));
+  std::memcpy(out, MAGIC, sizeof(MAGIC));
+  std::memcpy(out + 12, &h.version, 4);
+  std::memcpy(out + 16, &h.lsn, 8);
+  std::memcpy(out + 24, &h.count, 8);
+  std::memcpy(out + 32, &h.tree_off, 8);
+  std::memcpy(out + 40, &h.index_off, 8);
+  std::memcpy(out + 48, &h.size, 8);
+  std::memcpy(out + 56, &h.max_ts.wall_time, 8);
+  std::memcpy(out + 64, &h.max_ts.logical, 4);
+  std::memcpy(out + 68, &h.max_ts.node_id, 4);
+  uint32_t crc = crc32c::value(out + 12, HEADER_SIZE - 12);
+  std::memcpy(out + CRC_OFFSET, &crc, 4);
+}
+
+inline bool decode_header(const uint8_t *in, Header &h) {
+  uint32_t crc;
+  std::memcpy(&crc, in + CRC_OFFSET, 4);
+  if (std::memcmp(in, MAGIC, sizeof(MAGIC)) != 0 ||
+      crc32c::value(in + 12, HEADER_SIZE - 12) != crc)
+    return false;
+  std::memcpy(&h.version, in + 12, 4);
+  std::memcpy(&h.lsn, in + 16, 8);
+  std::memcpy(&h.count, in + 24, 8);
+  std::memcpy(&h.tree_off, in + 32, 8);
+  std::memcpy(&h.index_off, in + 40, 8);
+  std::memcpy(&h.size, in + 48, 8);
+  std::memcpy(&h.max_ts.wall_time, in + 56, 8);
+  std::memcpy(&h.max_ts.logical, in + 64, 4);
+  std::memcpy(&h.max_ts.node_id, in + 68, 4);
+  return true;
+}
+
+// "<16 hex>.heap" -> LSN
+inline bool parse_name(const std::string &name, uint64_t &lsn) {
+  if (name.size() != 21 || name.compare(16, 5, ".heap") != 0)
+    return false;
+  lsn = 0;
+  for (size_t i = 0; i < 16; ++i) {
+    char c = name[i];
+    int d = c >= '0' && c <= '9'   ? c - '0'
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                   : -1;
+    if (d < 0)
+      return false;
+    lsn = lsn << 4 | (uint64_t)d;
+  }
+  return true;
+}
+
+inline uint64_t align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+
+} // namespace detail
+
+// Streams entries into a new image; commit() lays out the tree and the
+// index behind them and publishes it atomically. Same interface as
+// snapshot::Writer, except that the tree is always present. An
+// uncommitted image is deleted on destruction.
+class Writer {
+public:
+  Writer(std::string dir, uint64_t lsn)
+      : dir_(std::move(dir)), lsn_(lsn), path_(path_of(dir_, lsn_)),
+        tmp_(path_ + ".tmp") {
+    std::filesystem::remove(tmp_);
+    file_ = std::make_unique<wal::File>(tmp_);
+    buf_.reserve(FLUSH_BYTES);
+    buf_.resize(detail::HEADER_SIZE); // Written last, by commit()
+  }
+
+  ~Writer() {
+    if (!committed_) {
+      file_.reset();
+      std::error_code ec;
+      std::filesystem::remove(tmp_, ec);
+    }
+  }
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  bool add(const Entry &e) {
+    uint8_t h[snapshot::detail::ENTRY_HEADER_SIZE];
+    snapshot::detail::encode_entry(e, h);
+    index_.emplace_back(fnv1a_64(e.key), bytes());
+    if (max_ts_ < e.ts)
+      max_ts_ = e.ts;
+    return put(h, sizeof(h)) && put(e.key.data(), e.key.size()) &&
+           put(e.value.data(), e.value.size());
+  }
+
+  // Merkle tree of the entries added, in MerkleTree::nodes() order.
+  void set_tree(std::vector<uint64_t> nodes) {
+    if (nodes.size() != MerkleTree::NODE_COUNT)
+      throw std::invalid_argument("Heap image: tree size mismatch");
+    tree_ = std::move(nodes);
+  }
+
+  // Writes the tree, the index and the header, syncs and renames the image
+  // into place.
+  bool commit() {
+    if (tree_.empty())
+      return false;
+    detail::Header h;
+    h.lsn = lsn_;
+    h.count = index_.size();
+    h.max_ts = max_ts_;
+
+    pad();
+    h.tree_off = bytes();
+    uint32_t nodes = (uint32_t)tree_.size();
+    uint32_t crc = crc32c::value(&nodes, 4);
+    crc = crc32c::extend(crc, tree_.data(), tree_.size() * 8);
+    put(&crc, 4);
+    put(&nodes, 4);
+    put(tree_.data(), tree_.size() * 8);
+
+    h.index_off = bytes(); // Still 8-aligned
+    std::sort(index_.begin(), index_.end());
+    for (auto &[hash, off] : index_) {
+      put(&hash, 8);
+      put(&off, 8);
+    }
+    h.size = bytes();
+
+    uint8_t head[detail::HEADER_SIZE];
+    detail::encode_header(h, head);
+    if (!flush() || !snapshot::detail::pwrite_all(*file_, head, sizeof(head),
+                                                  0) ||
+        !file_->sync())
+      return false;
+    file_.reset();
+    std::error_code ec;
+    std::filesystem::rename(tmp_, path_, ec);
+    if (ec)
+      return false;
+    committed_ = true;
+    wal::sync_dir(dir_);
+    return true;
+  }
+
+  uint64_t count() const { return index_.size(); }
+  uint64_t bytes() const { return off_ + buf_.size(); }
+
+private:
+  static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+  void pad() {
+    static const uint8_t zeros[8] = {};
+    put(zeros, detail::align8(bytes()) - bytes());
+  }
+
+  bool put(const void *p, size_t n) {
+    const uint8_t *b = static_cast<const uint8_t *>(p);
+    buf_.insert(buf_.end(), b, b + n);
+    return buf_.size() < FLUSH_BYTES || flush();
+  }
+
+  bool flush() {
+    if (ok_ && !buf_.empty()) {
+      ok_ = snapshot::detail::pwrite_all(*file_, buf_.data(), buf_.size(),
+                                         off_);
+      off_ += buf_.size();
+      buf_.clear();
+    }
+    return ok_;
+  }
+
+  std::string dir_;
+  uint64_t lsn_;
+  std::string path_, tmp_;
+  std::unique_ptr<wal::File> file_;
+  std::vector<uint8_t> buf_;
+  uint64_t off_ = 0;
+  std::vector<std::pair<uint64_t, uint64_t>> index_; // KeyHash, offset
+  std::vector<uint64_t> tree_;
+  Timestamp max_ts_{0, 0, 0};
+  bool ok_ = true;
+  bool committed_ = false;
+};
+
+// A mapped image. Immutable and safe to read from any number of threads;
+// entries are identified by their index position.
+class Image {
+public:
+  // Maps the image at `lsn` in `dir`; throws if its header, size or tree
+  // does not check out.
+  Image(const std::string &dir, uint64_t lsn)
+      : path_(path_of(dir, lsn)), map_(path_, false) {
+    const uint8_t *p = map_.data();
+    if (map_.size() < detail::HEADER_SIZE || !detail::decode_header(p, h_))
+      throw corrupt("bad header");
+    if (h_.version != detail::VERSION)
+      throw corrupt("unsupported version");
+    if (h_.lsn != lsn)
+      throw corrupt("LSN mismatch");
+    if (h_.size != map_.size() || h_.tree_off < detail::HEADER_SIZE ||
+        h_.tree_off % 8 || h_.index_off % 8 ||
+        h_.index_off < h_.tree_off + detail::TREE_HEADER_SIZE ||
+        (h_.size - h_.index_off) / detail::SLOT_SIZE != h_.count ||
+        (h_.size - h_.index_off) % detail::SLOT_SIZE)
+      throw corrupt("bad layout");
+
+    uint32_t crc, nodes;
+    std::memcpy(&crc, p + h_.tree_off, 4);
+    std::memcpy(&nodes, p + h_.tree_off + 4, 4);
+    if (nodes != MerkleTree::NODE_COUNT ||
+        h_.tree_off + detail::TREE_HEADER_SIZE + (uint64_t)nodes * 8 !=
+            h_.index_off)
+      throw corrupt("bad tree");
+    const uint8_t *t = p + h_.tree_off + detail::TREE_HEADER_SIZE;
+    if (crc32c::extend(crc32c::value(&nodes, 4), t, (size_t)nodes * 8) != crc)
+      throw corrupt("tree checksum mismatch");
+    tree_ = std::span<const uint64_t>(
+        reinterpret_cast<const uint64_t *>(t), nodes);
+  }
+
+  Image(const Image &) = delete;
+  Image &operator=(const Image &) = delete;
+
+  uint64_t lsn() const { return h_.lsn; }
+  uint64_t count() const { return h_.count; }
+  uint64_t bytes() const { return h_.size; }
+  Timestamp max_ts() const { return h_.max_ts; }
+  const std::string &path() const { return path_; }
+
+  // Merkle tree of the image's entries (MerkleTree::load_nodes()).
+  std::span<const uint64_t> tree() const { return tree_; }
+
+  // Index position of `key`, if the image holds it.
+  std::optional<size_t> find(std::string_view key) const {
+    uint64_t h = fnv1a_64(key);
+    for (size_t i = lower_bound(h); i < h_.count && slot_hash(i) == h; ++i) {
+      if (record(i).entry.key == key)
+        return i;
+    }
+    return std::nullopt;
+  }
+
+  // The entry at index position `i`, CRC checked. Its views point into the
+  // mapping. Throws if the record is damaged.
+  Entry entry(size_t i) const {
+    auto r = record(i);
+    if (!snapshot::detail::check_entry(
+            r.head, r.crc, (const uint8_t *)r.entry.key.data(),
+            r.entry.key.size() + r.entry.value.size()))
+      throw corrupt("checksum mismatch");
+    return r.entry;
+  }
+
+  // Index positions of the keys in Merkle leaf bucket `bucket`.
+  std::pair<size_t, size_t> bucket(uint32_t bucket) const {
+    uint64_t lo = (uint64_t)bucket << 48;
+    size_t first = lower_bound(lo);
+    size_t last = bucket == 0xFFFF ? h_.count : lower_bound(lo + (1ull << 48));
+    return {first, last};
+  }
+
+private:
+  struct Record {
+    const uint8_t *head;
+    uint32_t crc;
+    Entry entry;
+  };
+
+  std::runtime_error corrupt(const char *what) const {
+    return std::runtime_error("Heap image " + path_ + ": " + what);
+  }
+
+  uint64_t slot_hash(size_t i) const {
+    uint64_t h;
+    std::memcpy(&h, map_.data() + h_.index_off + i * detail::SLOT_SIZE, 8);
+    return h;
+  }
+
+  size_t lower_bound(uint64_t h) const {
+    size_t lo = 0, hi = h_.count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (slot_hash(mid) < h)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  // Record `i` with its bounds checked but not its CRC.
+  Record record(size_t i) const {
+    uint64_t off;
+    std::memcpy(&off, map_.data() + h_.index_off + i * detail::SLOT_SIZE + 8,
+                8);
+    if (off < detail::HEADER_SIZE ||
+        off + snapshot::detail::ENTRY_HEADER_SIZE > h_.tree_off)
+      throw corrupt("bad record offset");
+    Record r;
+    r.head = map_.data() + off;
+    uint16_t klen;
+    uint32_t vlen;
+    snapshot::detail::decode_entry(r.head, r.entry, r.crc, klen, vlen);
+    const uint8_t *data = r.head + snapshot::detail::ENTRY_HEADER_SIZE;
+    if (off + snapshot::detail::ENTRY_HEADER_SIZE + klen + vlen > h_.tree_off)
+      throw corrupt("truncated record");
+    r.entry.key = std::string_view((const char *)data, klen);
+    r.entry.value = std::span<const uint8_t>(data + klen, vlen);
+    return r;
+  }
+
+  std::string path_;
+  wal::MappedFile map_;
+  detail::Header h_;
+  std::span<const uint64_t> tree_;
+};
+
+// LSN of the newest image in `dir`.
+inline std::optional<uint64_t> latest(const std::string &dir) {
+  std::optional<uint64_t> best;
+  std::error_code ec;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    uint64_t lsn;
+    if (detail::parse_name(e.path().filename().string(), lsn) &&
+        (!best || lsn > *best))
+      best = lsn;
+  }
+  return best;
+}
+
+// Deletes images older than `lsn`. A mapped image stays readable until it
+// is unmapped.
+inline void remove_older(const std::string &dir, uint64_t lsn) {
+  std::error_code ec;
+  std::vector<std::filesystem::path> doomed;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    uint64_t n = 0;
+    if (detail::parse_name(e.path().filename().string(), n) && n < lsn)
+      doomed.push_back(e.path());
+  }
+  for (auto &p : doomed)
+    std::filesystem::remove(p, ec);
+  if (!doomed.empty())
+    wal::sync_dir(dir);
+}
+
+} // namespace l3kv::heap
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef L3KV_ENGINE_LOG_BUFFER_HPP
+#define L3KV_ENGINE_LOG_BUFFER_HPP
+
+/*
+ * LOG BUFFER - MULTI-PRODUCER WAL APPEND
+ *
+ * Append path (no lock, no staging copy):
+ * - reserve(): one fetch_add on the tail claims [pos, pos + len) of the log.
+ *   Positions are file offsets; the ring slot is pos & (capacity - 1).
+ * - The writer serializes its record straight into the ring (write()),
+ *   leaving the record's marker byte zero, then publish() stores the marker
+ *   with release semantics.
+ *
+ * Flusher (one thread):
+ * - Walks records from `flushed` while their marker is set, then writes the
+ *   whole contiguous run to the file with one pwrite (two on wrap-around).
+ * - Zeroes the flushed bytes and advances `flushed`, which frees the space
+ *   for writers and wakes anyone in wait_flushed().
+ * - A failed write is retried, same range, until it succeeds: the file
+ *   never gets a hole that recovery would stop at. Meanwhile reserve()
+ *   refuses new records (WriteFailed) and wait_flushed() reports failure.
+ *
+ * Records larger than the ring (append_direct()) claim their range the
+ * same way, wait until everything before it is flushed, and are written
+ * straight to the file by their own thread.
+ * - Sleeps when it finds nothing; publishers ring a doorbell only while it
+ *   is asleep (Dekker-style fences on both sides), so a busy log pays no
+ *   wake-up cost per record.
+ *
+ * Traits describe the record framing:
+ *   HEADER_SIZE, MARKER_OFFSET (a byte that is never zero once published)
+ *   and record_size(const uint8_t *header).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "libconveyor/conveyor_modern.hpp"
+
+namespace wal {
+
+// The log buffer is retrying a failed write and takes no new records.
+struct WriteFailed : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+template <class Traits> class LogBuffer {
+public:
+  struct Stats {
+    uint64_t bytes_written = 0;
+    uint64_t flushes = 0; // pwrite batches
+    uint64_t buffer_full_waits = 0;
+  };
+
+  static constexpr size_t MIN_CAPACITY = 4096;
+
+  LogBuffer(storage_handle_t handle, storage_operations_t ops, uint64_t start,
+            size_t capacity)
+      : handle_(handle), ops_(ops),
+        cap_(std::bit_ceil(std::max(capacity, MIN_CAPACITY))),
+        mask_(cap_ - 1), tail_(start), flushed_(start) {
+    ring_ = static_cast<uint8_t *>(std::calloc(cap_, 1));
+    if (!ring_)
+      throw std::bad_alloc();
+    flusher_ = std::thread([this] { flush_loop(); });
+  }
+
+  ~LogBuffer() {
+    stop_.store(true);
+    ring_doorbell();
+    flusher_.join();
+    std::free(ring_);
+  }
+
+  LogBuffer(const LogBuffer &) = delete;
+  LogBuffer &operator=(const LogBuffer &) = delete;
+
+  // Ring size: records up to this size go through reserve().
+  size_t capacity() const { return cap_; }
+
+  // Claims `len` bytes of log; blocks only while the ring is full. Throws
+  // WriteFailed while a failed write is being retried. A claimed range must
+  // be published.
+  uint64_t reserve(size_t len) {
+    if (len > cap_)
+      throw std::length_error("WAL: record larger than the log buffer");
+    if (failed_.load(std::memory_order_acquire))
+      throw WriteFailed("WAL: log write failed, retrying");
+    uint64_t pos = tail_.fetch_add(len, std::memory_order_relaxed);
+    if (pos + len > flushed_.load(std::memory_order_acquire) + cap_) {
+      stat_full_waits_.fetch_add(1, std::memory_order_relaxed);
+      await([&] {
+        return pos + len <= flushed_.load(std::memory_order_acquire) + cap_;
+      });
+    }
+    return pos;
+  }
+
+  // Copies into the reserved range (wrapping as needed).
+  void write(uint64_t pos, const void *data, size_t n) {
+    size_t at = pos & mask_;
+    size_t first = std::min(n, cap_ - at);
+    std::memcpy(ring_ + at, data, first);
+    std::memcpy(ring_, static_cast<const uint8_t *>(data) + first, n - first);
+  }
+
+  // Makes the record at `pos` visible to the flusher.
+  void publish(uint64_t pos, uint8_t marker) {
+    std::atomic_ref<uint8_t>(ring_[(pos + Traits::MARKER_OFFSET) & mask_])
+        .store(marker, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed))
+      ring_doorbell();
+  }
+
+  // Writes a whole record of any size to the file once everything before
+  // it is written; later records wait behind it. Returns the position just
+  // past it. Throws WriteFailed as reserve().
+  uint64_t append_direct(const void *data, size_t n) {
+    if (failed_.load(std::memory_order_acquire))
+      throw WriteFailed("WAL: log write failed, retrying");
+    uint64_t pos = tail_.fetch_add(n, std::memory_order_relaxed);
+    await([&] { return flushed_.load(std::memory_order_acquire) == pos; });
+    {
+      std::lock_guard lock(direct_mx_);
+      write_retrying(pos, n, [&] {
+        return pwrite_all(static_cast<const uint8_t *>(data), n, pos);
+      });
+      flushed_.store(pos + n, std::memory_order_release);
+    }
+    progress();
+    return pos + n;
+  }
+
+  // Blocks until everything before `pos` has been written to the file.
+  // False, without waiting further, once a write before it has failed.
+  bool wait_flushed(uint64_t pos) {
+    bool done = false;
+    await([&] {
+      done = flushed_.load(std::memory_order_acquire) >= pos;
+      return done || failed_.load(std::memory_order_acquire);
+    });
+    return done;
+  }
+
+  uint64_t flushed() const { return flushed_.load(std::memory_order_acquire); }
+
+  // A write failed and is being retried.
+  bool failed() const { return failed_.load(std::memory_order_acquire); }
+
+  Stats stats() const {
+    return {stat_bytes_.load(std::memory_order_relaxed),
+            stat_flushes_.load(std::memory_order_relaxed),
+            stat_full_waits_.load(std::memory_order_relaxed)};
+  }
+
+private:
+  void read(uint64_t pos, void *out, size_t n) const {
+    size_t at = pos & mask_;
+    size_t first = std::min(n, cap_ - at);
+    std::memcpy(out, ring_ + at, first);
+    std::memcpy(static_cast<uint8_t *>(out) + first, ring_, n - first);
+  }
+
+  // Waits on `progress_` until `done()`; every flush and every change of
+  // `failed_` bumps it.
+  template <class Done> void await(Done done) {
+    for (;;) {
+      uint32_t seen = progress_.load(std::memory_order_acquire);
+      if (done())
+        return;
+      progress_.wait(seen, std::memory_order_acquire);
+    }
+  }
+
+  void progress() {
+    progress_.fetch_add(1, std::memory_order_release);
+    progress_.notify_all();
+  }
+
+  bool published(uint64_t pos) const {
+    return std::atomic_ref<uint8_t>(
+               ring_[(pos + Traits::MARKER_OFFSET) & mask_])
+               .load(std::memory_order_acquire) != 0;
+  }
+
+  // `flushed` and the end of the published run after it. A direct write
+  // moves `flushed` past ring slots that later records then reuse, so the
+  // two are read under direct_mx_.
+  std::pair<uint64_t, uint64_t> pending() {
+    std::lock_guard lock(direct_mx_);
+    uint64_t from = flushed_.load(std::memory_order_relaxed);
+    return {from, scan(from)};
+  }
+
+  // End of the contiguous run of published records starting at `pos`.
+  // Stops at one ring length: a header past that would alias bytes that are
+  // still waiting to be flushed (its writer is blocked in reserve()).
+  uint64_t scan(uint64_t pos) const {
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    uint64_t limit = pos + cap_ - Traits::HEADER_SIZE;
+    while (pos < tail && pos <= limit && published(pos)) {
+      uint8_t hdr[Traits::HEADER_SIZE];
+      read(pos, hdr, sizeof(hdr));
+      pos += Traits::record_size(hdr);
+    }
+    return pos;
+  }
+
+  bool write_out(uint64_t from, uint64_t to) {
+    size_t at = from & mask_;
+    size_t n = (size_t)(to - from);
+    size_t first = std::min(n, cap_ - at);
+    return pwrite_all(ring_ + at, first, from) &&
+           pwrite_all(ring_, n - first, from + first);
+  }
+
+  // Clears flushed bytes (markers included) before the space is reused.
+  void zero(uint64_t from, uint64_t to) {
+    size_t at = from & mask_;
+    size_t n = (size_t)(to - from);
+    size_t first = std::min(n, cap_ - at);
+    std::memset(ring_ + at, 0, first);
+    std::memset(ring_, 0, n - first);
+  }
+
+  bool pwrite_all(const uint8_t *p, size_t n, uint64_t off) {
+    while (n > 0) {
+      ssize_t w = ops_.pwrite_fn(handle_, p, n, (off_t)off);
+      if (w <= 0)
+        return false;
+      p += w;
+      n -= (size_t)w;
+      off += (uint64_t)w;
+    }
+    return true;
+  }
+
+  // Runs `write` of [from, from + n) until it succeeds, backing off in
+  // between; skipping the range would leave a hole that ends recovery
+  // there. False if the buffer is destroyed first.
+  template <class Write>
+  bool write_retrying(uint64_t from, uint64_t n, Write write) {
+    auto retry = RETRY_MIN;
+    while (!write()) {
+      if (!failed_.exchange(true, std::memory_order_acq_rel)) {
+        std::cerr << "WAL: log buffer write failed at offset " << from
+                  << ", retrying\n";
+        progress();
+      }
+      if (stop_.load()) {
+        std::cerr << "WAL: log buffer closed with " << n
+                  << " unwritten bytes at offset " << from << "\n";
+        return false;
+      }
+      pause(retry);
+      retry = std::min(retry * 2, RETRY_MAX);
+    }
+    if (failed_.load(std::memory_order_relaxed)) {
+      std::cerr << "WAL: log buffer write at offset " << from
+                << " succeeded, taking writes again\n";
+      failed_.store(false, std::memory_order_release);
+    }
+    stat_bytes_.fetch_add(n, std::memory_order_relaxed);
+    stat_flushes_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void flush_loop() {
+    for (;;) {
+      auto [from, to] = pending();
+      if (to > from) {
+        if (!write_retrying(from, to - from,
+                            [&] { return write_out(from, to); }))
+          return;
+        zero(from, to);
+        flushed_.store(to, std::memory_order_release);
+        progress();
+        continue;
+      }
+      if (stop_.load() && from == tail_.load())
+        return;
+
+      uint32_t bell = doorbell_.load(std::memory_order_acquire);
+      sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto [now, end] = pending();
+      if (end == now && !stop_.load())
+        doorbell_.wait(bell, std::memory_order_acquire);
+      sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // Sleeps `d` between retries; cut short by the destructor.
+  void pause(std::chrono::milliseconds d) {
+    auto until = std::chrono::steady_clock::now() + d;
+    while (!stop_.load() && std::chrono::steady_clock::now() < until)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  void ring_doorbell() {
+    doorbell_.fetch_add(1, std::memory_order_release);
+    doorbell_.notify_one();
+  }
+
+  static constexpr std::chrono::milliseconds RETRY_MIN{1}, RETRY_MAX{1000};
+
+  storage_handle_t handle_;
+  storage_operations_t ops_;
+  const size_t cap_;
+  const size_t mask_;
+  uint8_t *ring_ = nullptr;
+
+  alignas(64) std::atomic<uint64_t> tail_;    // Next position to reserve
+  alignas(64) std::atomic<uint64_t> flushed_; // Written to the file below
+  std::atomic<uint32_t> progress_{0};         // See await()
+  std::mutex direct_mx_;                      // See pending()
+  alignas(64) std::atomic<bool> sleeping_{false};
+  std::atomic<uint32_t> doorbell_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> failed_{false};
+
+  std::atomic<uint64_t> stat_bytes_{0};
+  std::atomic<uint64_t> stat_flushes_{0};
+  std::atomic<uint64_t> stat_full_waits_{0};
+  std::thread flusher_; // Last: starts after everything above exists
+};
+
+} // namespace wal
+
+#endif
@@ -12,14 +12,21 @@
  * - Only dirty branches are rehashed up to the root.
  * - This ensures high write throughput (microsecond latency) without paying the
  * Full Tree Hash cost on every write.
+ *
+ * Persistence:
+ * - `nodes()` exports every level (leaves first, root last) for a checkpoint;
+ * `load_nodes()` installs such an image as is, so a restarted node answers
+ * anti-entropy without rehashing anything.
  */
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -65,6 +72,9 @@ private:
   std::vector<std::unique_ptr<std::mutex>> shards_;
 
 public:
+  // Size of a nodes() image: L4, L3, L2, L1 and L0, in that order
+  static constexpr size_t NODE_COUNT = L4_SIZE + L3_SIZE + 256 + 16 + 1;
+
   MerkleTree() {
     leaves_.resize(L4_SIZE, 0);
     l3_.resize(L3_SIZE, 0);
@@ -98,10 +108,14 @@ public:
     l0_[0] = h_l0;
   }
 
+  // Leaf bucket (0..65535) a key's value hash is folded into.
+  static uint32_t bucket_of(std::string_view key) {
+    return (fnv1a_64(key) >> 48) & 0xFFFF;
+  }
+
   void apply_delta(std::string_view key, uint64_t hash_delta) {
-    uint64_t k_hash = fnv1a_64(key);
-    uint32_t bucket_idx = (k_hash >> 48) & 0xFFFF; // 0..65535
-    size_t shard_idx = bucket_idx >> 8;            // 256 shards
+    uint32_t bucket_idx = bucket_of(key);
+    size_t shard_idx = bucket_idx >> 8; // 256 shards
 
     std::lock_guard<std::mutex> lock(*shards_[shard_idx]);
     leaves_[bucket_idx] ^= hash_delta;
@@ -132,6 +146,46 @@ public:
     return 0;
   }
 
+  // Every node hash, leaves first and the root last (NODE_COUNT values).
+  std::vector<uint64_t> nodes() {
+    std::lock_guard lock(global_mx_);
+    recompute_dirty();
+    std::vector<uint64_t> out;
+    out.reserve(NODE_COUNT);
+    for (size_t s = 0; s < SHARD_COUNT; ++s) {
+      std::lock_guard<std::mutex> slock(*shards_[s]);
+      auto first = leaves_.begin() + s * (L4_SIZE / SHARD_COUNT);
+      out.insert(out.end(), first, first + L4_SIZE / SHARD_COUNT);
+    }
+    for (auto *level : {&l3_, &l2_, &l1_, &l0_})
+      out.insert(out.end(), level->begin(), level->end());
+    return out;
+  }
+
+  // Replaces the whole tree with an image from nodes(). Nothing is rehashed:
+  // the image must be consistent, as a checkpoint's is. Returns false (and
+  // leaves the tree alone) if the size does not match.
+  bool load_nodes(std::span<const uint64_t> image) {
+    if (image.size() != NODE_COUNT)
+      return false;
+    std::lock_guard lock(global_mx_);
+    const uint64_t *p = image.data();
+    for (size_t s = 0; s < SHARD_COUNT; ++s) {
+      std::lock_guard<std::mutex> slock(*shards_[s]);
+      size_t n = L4_SIZE / SHARD_COUNT;
+      std::copy(p, p + n, leaves_.begin() + s * n);
+      std::fill_n(l3_dirty_.begin() + s * (n / 16), n / 16, 0);
+      p += n;
+    }
+    for (auto *level : {&l3_, &l2_, &l1_, &l0_}) {
+      std::copy(p, p + level->size(), level->begin());
+      p += level->size();
+    }
+    for (auto *dirty : {&l2_dirty_, &l1_dirty_, &l0_dirty_})
+      std::fill(dirty->begin(), dirty->end(), 0);
+    return true;
+  }
+
 private:
   void recompute_dirty() {
     // Phase 1: L3 from Leaves (Locking Shards sequentially)
@@ -0,0 +1,161 @@
+#ifndef L3KV_ENGINE_ORDERED_INDEX_HPP
+#define L3KV_ENGINE_ORDERED_INDEX_HPP
+
+/*
+ * ORDERED KEY INDEX - SKIPLIST FOR RANGE AND PREFIX SCANS
+ *
+ * The shard maps hash their keys, so they only answer point lookups. This
+ * index keeps every key in order next to them (like BucketIndex, a key is
+ * added once, when it first enters a shard index) so scans can walk a key
+ * range without visiting the whole keyspace.
+ *
+ * - Insert-only: keys never leave a shard index (deletes are tombstones),
+ *   so nodes are never unlinked and live as long as the index. That makes
+ *   readers lock-free without any reclamation scheme: a scan just follows
+ *   the level 0 links.
+ * - Inserts are lock-free too: a node is linked bottom up with CAS, level 0
+ *   first (that is when it becomes visible). A lost race re-searches and
+ *   retries; a duplicate insert is a no-op.
+ * - Node: [KeyLen:2][Height:1][Pad][Next pointers x height][Key], one
+ *   allocation.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+namespace l3kv {
+
+class OrderedIndex {
+  static constexpr int MAX_HEIGHT = 16; // p = 1/4: ~4^16 keys
+
+  struct alignas(std::atomic<void *>) Node {
+    uint16_t key_len;
+    uint8_t height;
+
+    // `height` links, then the key bytes
+    std::atomic<Node *> *next() {
+      return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+    }
+    const std::atomic<Node *> *next() const {
+      return reinterpret_cast<const std::atomic<Node *> *>(this + 1);
+    }
+    std::string_view key() const {
+      return {reinterpret_cast<const char *>(next() + height), key_len};
+    }
+
+    static Node *make(std::string_view key, int height) {
+      size_t bytes =
+          sizeof(Node) + sizeof(std::atomic<Node *>) * height + key.size();
+      Node *n = new (::operator new(bytes)) Node;
+      n->key_len = (uint16_t)key.size();
+      n->height = (uint8_t)height;
+      for (int i = 0; i < height; ++i)
+        new (n->next() + i) std::atomic<Node *>(nullptr);
+      if (!key.empty())
+        std::memcpy(n->next() + height, key.data(), key.size());
+      return n;
+    }
+  };
+
+public:
+  OrderedIndex() : head_(Node::make({}, MAX_HEIGHT)) {}
+
+  ~OrderedIndex() {
+    Node *n = head_;
+    while (n) {
+      Node *next = n->next()[0].load(std::memory_order_relaxed);
+      ::operator delete(n);
+      n = next;
+    }
+  }
+
+  OrderedIndex(const OrderedIndex &) = delete;
+  OrderedIndex &operator=(const OrderedIndex &) = delete;
+
+  // Returns false if `key` was already present.
+  bool insert(std::string_view key) {
+    Node *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+    if (find(key, preds, succs))
+      return false;
+    int height = random_height();
+    Node *n = Node::make(key, height);
+    for (int i = 0; i < height; ++i)
+      n->next()[i].store(succs[i], std::memory_order_relaxed);
+    // Level 0 decides whether the key is in
+    while (!preds[0]->next()[0].compare_exchange_strong(
+        succs[0], n, std::memory_order_release, std::memory_order_relaxed)) {
+      if (find(key, preds, succs)) {
+        ::operator delete(n); // Inserted by someone else meanwhile
+        return false;
+      }
+      for (int i = 0; i < height; ++i)
+        n->next()[i].store(succs[i], std::memory_order_relaxed);
+    }
+    // Upper levels only speed up searches; link them as races allow
+    for (int i = 1; i < height; ++i) {
+      for (;;) {
+        n->next()[i].store(succs[i], std::memory_order_relaxed);
+        if (preds[i]->next()[i].compare_exchange_strong(
+                succs[i], n, std::memory_order_release,
+                std::memory_order_relaxed))
+          break;
+        find(key, preds, succs);
+      }
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Calls fn(key) for the keys >= `from` in order while it returns true.
+  // Keys inserted during the walk may or may not be seen.
+  template <class Fn>
+  void for_each_from(std::string_view from, Fn &&fn) const {
+    Node *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+    find(from, preds, succs);
+    for (Node *n = succs[0]; n && fn(n->key());
+         n = n->next()[0].load(std::memory_order_acquire)) {
+    }
+  }
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+  // Fills the last node < key (preds) and the first >= key (succs) at each
+  // level; true if succs[0] is `key`.
+  bool find(std::string_view key, Node **preds, Node **succs) const {
+    Node *x = head_;
+    for (int i = MAX_HEIGHT - 1; i >= 0; --i) {
+      Node *next = x->next()[i].load(std::memory_order_acquire);
+      while (next && next->key() < key) {
+        x = next;
+        next = x->next()[i].load(std::memory_order_acquire);
+      }
+      preds[i] = x;
+      succs[i] = next;
+    }
+    return succs[0] && succs[0]->key() == key;
+  }
+
+  static int random_height() {
+    thread_local uint64_t state =
+        0x9E3779B97F4A7C15ull ^ (uint64_t)(uintptr_t)&state;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int h = 1;
+    for (uint64_t r = state; h < MAX_HEIGHT && (r & 3) == 0; r >>= 2)
+      ++h;
+    return h;
+  }
+
+  Node *head_;
+  std::atomic<size_t> size_{0};
+};
+
+} // namespace l3kv
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef L3KV_ENGINE_PAGE_POOL_HPP
+#define L3KV_ENGINE_PAGE_POOL_HPP
+
+/*
+ * PAGE POOL - FIXED-SIZE PAGES FOR LARGE VALUES
+ *
+ * Values of at least `min_value_bytes` are not stored as one contiguous
+ * allocation but cut into pages of PAGE_SIZE bytes, all the same size class
+ * of the shard arena: a multi-megabyte document never needs a contiguous
+ * extent, and freed pages are reused by any other large value.
+ *
+ *   Page: [Refs:4][Pad:4][PAGE_BYTES of value]
+ *
+ * - Pages are immutable once filled and reference counted: when a large
+ *   document is rewritten, the pages whose bytes did not change are shared
+ *   with the new version instead of copied (see Blob::create()).
+ * - Released from any thread (epoch reclamation, ValueRef release); the
+ *   shard arena is synchronized.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+namespace l3kv {
+
+class PagePool {
+public:
+  static constexpr size_t PAGE_SIZE = 16 * 1024; // One allocation
+
+  struct alignas(8) Page {
+    mutable std::atomic<uint32_t> refs{1};
+
+    uint8_t *bytes() { return reinterpret_cast<uint8_t *>(this + 1); }
+    const uint8_t *bytes() const {
+      return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+  };
+  static constexpr size_t PAGE_BYTES = PAGE_SIZE - sizeof(Page);
+
+  // Pages values of at least `min_value_bytes` (never, if 0).
+  PagePool(std::pmr::memory_resource *mr, size_t min_value_bytes)
+      : mr_(mr), min_value_bytes_(min_value_bytes) {}
+
+  PagePool(const PagePool &) = delete;
+  PagePool &operator=(const PagePool &) = delete;
+
+  bool pages(size_t value_bytes) const {
+    return min_value_bytes_ > 0 && value_bytes >= min_value_bytes_;
+  }
+
+  // A fresh page (refcount 1), contents uninitialized.
+  Page *allocate() {
+    void *p = mr_->allocate(PAGE_SIZE, alignof(Page));
+    live_.fetch_add(1, std::memory_order_relaxed);
+    return new (p) Page;
+  }
+
+  static void acquire(const Page *p) {
+    p->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void release(const Page *p) {
+    if (p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      p->~Page();
+      mr_->deallocate(const_cast<Page *>(p), PAGE_SIZE, alignof(Page));
+      live_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Pages currently held by values.
+  uint64_t live_pages() const { return live_.load(std::memory_order_relaxed); }
+
+private:
+  std::pmr::memory_resource *mr_;
+  const size_t min_value_bytes_;
+  std::atomic<uint64_t> live_{0};
+};
+
+} // namespace l3kv
+
+#endif
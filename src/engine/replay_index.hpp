@@ -0,0 +1,119 @@
+#ifndef L3KV_ENGINE_REPLAY_INDEX_HPP
+#define L3KV_ENGINE_REPLAY_INDEX_HPP
+
+/*
+ * REPLAY INDEX - LAST-WRITER-WINS DEDUPLICATION FOR WAL REPLAY
+ *
+ * Most keys are overwritten many times, and replaying every historical write
+ * encodes (and throws away) a document per record. The index collects the
+ * replayed ops of one partition, per key, and drops every op a later full
+ * write supersedes. Only the survivors are applied, in log order.
+ *
+ * A full write W (PUT or DELETE) with timestamp t supersedes the ops logged
+ * before it for its key when all of them are timestamped and none is newer
+ * than t. Under the Engine's replay rule (an op applies unless its
+ * timestamp is older than the entry's) either W applies and replaces the
+ * entry outright, or the entry restored from a checkpoint is newer than t,
+ * in which case those earlier ops were stale as well. Untimestamped
+ * (legacy) ops order by log position only, so they are never dropped.
+ *
+ * Per partition, single-threaded. The ops are views into the recovered log
+ * and must outlive the index (WriteAheadLog::recover's finish step).
+ */
+
+#include "wal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace l3kv {
+
+class ReplayIndex {
+public:
+  void add(const ReplayOp &op) {
+    bool full = op.op == WalOp::PUT || op.op == WalOp::DELETE_;
+    auto [it, fresh] = keys_.try_emplace(op.key);
+    KeyState &k = it->second;
+    if (!fresh && full && op.ts != NO_TS && !k.untimestamped &&
+        !(op.ts < k.max_ts)) {
+      for (size_t i = k.last; i != NONE; i = ops_[i].prev) {
+        ops_[i].dead = true;
+        ++dead_;
+      }
+      fresh = true;
+    }
+    ops_.push_back({op, fresh ? NONE : k.last, false});
+    k.last = ops_.size() - 1;
+    if (fresh) {
+      k.max_ts = op.ts;
+      k.untimestamped = op.ts == NO_TS;
+    } else {
+      if (k.max_ts < op.ts)
+        k.max_ts = op.ts;
+      k.untimestamped |= op.ts == NO_TS;
+    }
+    ++added_;
+    if (dead_ >= COMPACT_MIN && dead_ * 2 >= ops_.size())
+      compact();
+  }
+
+  // Calls fn(const ReplayOp &) for every surviving op, in log order.
+  template <class Fn> void for_each(Fn &&fn) const {
+    for (const Node &n : ops_) {
+      if (!n.dead)
+        fn(n.op);
+    }
+  }
+
+  uint64_t added() const { return added_; }
+  uint64_t live() const { return ops_.size() - dead_; }
+
+private:
+  static constexpr size_t NONE = SIZE_MAX;
+  static constexpr size_t COMPACT_MIN = 1 << 16;
+  static constexpr Timestamp NO_TS{0, 0, 0};
+
+  struct Node {
+    ReplayOp op;
+    size_t prev; // The key's previous live op
+    bool dead;
+  };
+
+  struct KeyState {
+    size_t last = NONE;        // The key's newest op
+    Timestamp max_ts{0, 0, 0}; // Over its live ops
+    bool untimestamped = false;
+  };
+
+  // Drops superseded ops. A key's live ops are always a suffix of its
+  // chain, so `prev` links of survivors only point at survivors.
+  void compact() {
+    std::vector<size_t> moved(ops_.size(), NONE);
+    size_t n = 0;
+    for (size_t i = 0; i < ops_.size(); ++i) {
+      if (ops_[i].dead)
+        continue;
+      moved[i] = n;
+      Node &dst = ops_[n++];
+      dst = ops_[i];
+      if (dst.prev != NONE)
+        dst.prev = moved[dst.prev];
+    }
+    ops_.resize(n);
+    for (auto &[key, k] : keys_)
+      k.last = moved[k.last];
+    dead_ = 0;
+  }
+
+  std::vector<Node> ops_; // In log order
+  std::unordered_map<std::string_view, KeyState> keys_;
+  size_t dead_ = 0;
+  uint64_t added_ = 0;
+};
+
+} // namespace l3kv
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef L3KV_ENGINE_SNAPSHOT_HPP
+#define L3KV_ENGINE_SNAPSHOT_HPP
+
+/*
+ * CHECKPOINT SNAPSHOTS
+ *
+ * A snapshot is every shard entry (tombstones included) as of a WAL position
+ * (its LSN). It lives next to the WAL segments as "<lsn as 16 hex>.snap":
+ *
+ *   Header: [Magic:8 "L3KVSNAP"][Version:4][Flags:4][LSN:8][Count:8]
+ *   Tree:   [CRC32C:4][Nodes:4][Hash:8 x Nodes]    (only with FLAG_TREE)
+ *   Entry:  [CRC32C:4][KeyLen:2][Flags:1][Wall:8][Logical:4][Node:4]
+ *           [Hash:8][ValLen:4][Key][Value]
+ *
+ * - The entry CRC covers everything after it. Hash is the cached value hash
+ *   (EntryMeta::hash), so loading never rehashes values.
+ * - The tree section holds the Merkle tree of exactly the entries in the
+ *   file (MerkleTree::nodes()), so it is installed without hashing. Its
+ *   space is reserved up front and filled in by commit(), like Count.
+ * - Version 1 files (no Flags, no tree) are still read.
+ * - Written to "<name>.tmp", synced, then renamed into place: a snapshot
+ *   file either exists complete or not at all.
+ * - Recovery loads the newest snapshot and replays the WAL from its LSN.
+ */
+
+#include "clock.hpp"
+#include "crc32c.hpp"
+#include "wal_storage.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace l3kv::snapshot {
+
+struct Entry {
+  std::string_view key;
+  Timestamp ts{0, 0, 0};
+  uint64_t hash = 0;
+  uint8_t flags = 0;
+  std::span<const uint8_t> value;
+};
+
+// File of the snapshot at `lsn` in `dir`.
+inline std::string path_of(const std::string &dir, uint64_t lsn) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016" PRIx64 ".snap", lsn);
+  return (std::filesystem::path(dir) / name).string();
+}
+
+namespace detail {
+
+constexpr char MAGIC[8] = {'L', '3', 'K', 'V', 'S', 'N', 'A', 'P'};
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t FLAG_TREE = 1;
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t FLAGS_OFFSET = 12;
+constexpr size_t COUNT_OFFSET = 24;
+constexpr size_t TREE_HEADER_SIZE = 8;
+constexpr size_t ENTRY_HEADER_SIZE = 4 + 2 + 1 + 8 + 4 + 4 + 8 + 4;
+
+// "<16 hex>.snap" -> LSN
+inline bool parse_name(const std::string &name, uint64_t &lsn) {
+  if (name.size() != 21 || name.compare(16, 5, ".snap") != 0)
+    return false;
+  lsn = 0;
+  for (size_t i = 0; i < 16; ++i) {
+    char c = name[i];
+    int d = c >= '0' && c <= '9'   ? c - '0'
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                   : -1;
+    if (d < 0)
+      return false;
+    lsn = lsn << 4 | (uint64_t)d;
+  }
+  return true;
+}
+
+inline bool pwrite_all(wal::File &f, const void *p, size_t n, uint64_t off) {
+  const uint8_t *b = static_cast<const uint8_t *>(p);
+  while (n > 0) {
+    ssize_t w = wal::File::ops().pwrite_fn(f.handle(), b, n, (off_t)off);
+    if (w <= 0)
+      return false;
+    b += w;
+    n -= (size_t)w;
+    off += (uint64_t)w;
+  }
+  return true;
+}
+
+// Entry header with its CRC (covering the key and value too).
+inline void encode_entry(const Entry &e, uint8_t (&h)[ENTRY_HEADER_SIZE]) {
+  uint16_t klen = (uint16_t)e.key.size();
+  uint32_t vlen = (uint32_t)e.value.size();
+  uint8_t *p = h + 4;
+  auto field = [&](const void *v, size_t n) {
+    std::memcpy(p, v, n);
+    p += n;
+  };
+  field(&klen, 2);
+  field(&e.flags, 1);
+  field(&e.ts.wall_time, 8);
+  field(&e.ts.logical, 4);
+  field(&e.ts.node_id, 4);
+  field(&e.hash, 8);
+  field(&vlen, 4);
+
+  uint32_t crc = crc32c::value(h + 4, ENTRY_HEADER_SIZE - 4);
+  crc = crc32c::extend(crc, e.key.data(), e.key.size());
+  crc = crc32c::extend(crc, e.value.data(), e.value.size());
+  std::memcpy(h, &crc, 4);
+}
+
+// Header fields of an entry; the key and value views are left to the
+// caller.
+inline void decode_entry(const uint8_t *h, Entry &e, uint32_t &crc,
+                         uint16_t &klen, uint32_t &vlen) {
+  auto field = [&](void *v, size_t n) {
+    std::memcpy(v, h, n);
+    h += n;
+  };
+  field(&crc, 4);
+  field(&klen, 2);
+  field(&e.flags, 1);
+  field(&e.ts.wall_time, 8);
+  field(&e.ts.logical, 4);
+  field(&e.ts.node_id, 4);
+  field(&e.hash, 8);
+  field(&vlen, 4);
+}
+
+// CRC an entry's header says it has, against its contents.
+inline bool check_entry(const uint8_t *h, uint32_t crc, const uint8_t *data,
+                        size_t n) {
+  uint32_t actual = crc32c::value(h + 4, ENTRY_HEADER_SIZE - 4);
+  return crc32c::extend(actual, data, n) == crc;
+}
+
+// Sequential reads through a large buffer (one pread per refill).
+class Reader {
+  wal::File &f_;
+  uint64_t off_ = 0;
+  std::vector<uint8_t> buf_;
+  size_t pos_ = 0, len_ = 0;
+
+public:
+  explicit Reader(wal::File &f) : f_(f), buf_(1 << 20) {}
+
+  bool read(void *out, size_t n) {
+    uint8_t *o = static_cast<uint8_t *>(out);
+    while (n > 0) {
+      if (pos_ == len_) {
+        ssize_t r = wal::File::ops().pread_fn(f_.handle(), buf_.data(),
+                                              buf_.size(), (off_t)off_);
+        if (r <= 0)
+          return false;
+        off_ += (uint64_t)r;
+        pos_ = 0;
+        len_ = (size_t)r;
+      }
+      size_t take = std::min(n, len_ - pos_);
+      std::memcpy(o, buf_.data() + pos_, take);
+      pos_ += take;
+      o += take;
+      n -= take;
+    }
+    return true;
+  }
+};
+
+} // namespace detail
+
+// Streams entries into a new snapshot; commit() publishes it atomically.
+// An uncommitted snapshot is deleted on destruction. With `tree_nodes` set,
+// space for a tree of that many hashes is reserved and set_tree() must be
+// called before commit().
+class Writer {
+public:
+  Writer(std::string dir, uint64_t lsn, uint32_t tree_nodes = 0)
+      : dir_(std::move(dir)), lsn_(lsn),
+        path_(path_of(dir_, lsn_)), tmp_(path_ + ".tmp"),
+        tree_nodes_(tree_nodes) {
+    std::filesystem::remove(tmp_);
+    file_ = std::make_unique<wal::File>(tmp_);
+    buf_.reserve(FLUSH_BYTES);
+    put(detail::MAGIC, sizeof(detail::MAGIC));
+    uint32_t version = detail::VERSION;
+    uint32_t flags = tree_nodes_ ? detail::FLAG_TREE : 0;
+    uint64_t count = 0;
+    put(&version, 4);
+    put(&flags, 4);
+    put(&lsn_, 8);
+    put(&count, 8); // Patched in commit()
+    if (tree_nodes_) {
+      // Patched in commit()
+      buf_.resize(buf_.size() + detail::TREE_HEADER_SIZE +
+                  (size_t)tree_nodes_ * 8);
+    }
+  }
+
+  ~Writer() {
+    if (!committed_) {
+      file_.reset();
+      std::error_code ec;
+      std::filesystem::remove(tmp_, ec);
+    }
+  }
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  bool add(const Entry &e) {
+    uint8_t h[detail::ENTRY_HEADER_SIZE];
+    detail::encode_entry(e, h);
+    ++count_;
+    return put(h, sizeof(h)) && put(e.key.data(), e.key.size()) &&
+           put(e.value.data(), e.value.size());
+  }
+
+  // Merkle tree of the entries added, in MerkleTree::nodes() order.
+  void set_tree(std::vector<uint64_t> nodes) {
+    if (nodes.size() != tree_nodes_)
+      throw std::invalid_argument("Snapshot: tree size mismatch");
+    tree_ = std::move(nodes);
+  }
+
+  // Flushes, syncs and renames the snapshot into place.
+  bool commit() {
+    if (!ok_ || tree_.size() != tree_nodes_ || !flush() ||
+        !detail::pwrite_all(*file_, &count_, 8, detail::COUNT_OFFSET) ||
+        (tree_nodes_ && !write_tree()) || !file_->sync())
+      return false;
+    file_.reset();
+    std::error_code ec;
+    std::filesystem::rename(tmp_, path_, ec);
+    if (ec)
+      return false;
+    committed_ = true;
+    wal::sync_dir(dir_);
+    return true;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t bytes() const { return off_ + buf_.size(); }
+
+private:
+  static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+  bool write_tree() {
+    std::vector<uint8_t> t(detail::TREE_HEADER_SIZE + tree_.size() * 8);
+    std::memcpy(t.data() + 4, &tree_nodes_, 4);
+    std::memcpy(t.data() + 8, tree_.data(), tree_.size() * 8);
+    uint32_t crc = crc32c::value(t.data() + 4, t.size() - 4);
+    std::memcpy(t.data(), &crc, 4);
+    return detail::pwrite_all(*file_, t.data(), t.size(),
+                              detail::HEADER_SIZE);
+  }
+
+  bool put(const void *p, size_t n) {
+    const uint8_t *b = static_cast<const uint8_t *>(p);
+    buf_.insert(buf_.end(), b, b + n);
+    return buf_.size() < FLUSH_BYTES || flush();
+  }
+
+  bool flush() {
+    if (ok_ && !buf_.empty()) {
+      ok_ = detail::pwrite_all(*file_, buf_.data(), buf_.size(), off_);
+      off_ += buf_.size();
+      buf_.clear();
+    }
+    return ok_;
+  }
+
+  std::string dir_;
+  uint64_t lsn_;
+  std::string path_, tmp_;
+  std::unique_ptr<wal::File> file_;
+  std::vector<uint8_t> buf_;
+  uint64_t off_ = 0;
+  uint64_t count_ = 0;
+  uint32_t tree_nodes_;
+  std::vector<uint64_t> tree_;
+  bool ok_ = true;
+  bool committed_ = false;
+};
+
+// LSN of the newest snapshot in `dir`.
+inline std::optional<uint64_t> latest(const std::string &dir) {
+  std::optional<uint64_t> best;
+  std::error_code ec;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    uint64_t lsn;
+    if (detail::parse_name(e.path().filename().string(), lsn) &&
+        (!best || lsn > *best))
+      best = lsn;
+  }
+  return best;
+}
+
+// Streams every entry of the snapshot at `lsn` to fn(const Entry &).
+// Returns the entry count; throws if the file is damaged. A saved Merkle
+// tree is passed to on_tree(std::span<const uint64_t>) before the first
+// entry.
+template <class Fn, class TreeFn = void (*)(std::span<const uint64_t>)>
+uint64_t load(const std::string &dir, uint64_t lsn, Fn &&fn,
+              TreeFn &&on_tree = [](std::span<const uint64_t>) {}) {
+  std::string path = path_of(dir, lsn);
+  wal::File file(path);
+  detail::Reader in(file);
+  auto corrupt = [&](const char *what) {
+    return std::runtime_error("Snapshot " + path + ": " + what);
+  };
+
+  uint8_t h[detail::HEADER_SIZE];
+  if (!in.read(h, sizeof(h)) ||
+      std::memcmp(h, detail::MAGIC, sizeof(detail::MAGIC)) != 0)
+    throw corrupt("bad header");
+  uint32_t version, flags;
+  uint64_t file_lsn, count;
+  std::memcpy(&version, h + 8, 4);
+  std::memcpy(&flags, h + detail::FLAGS_OFFSET, 4);
+  std::memcpy(&file_lsn, h + 16, 8);
+  std::memcpy(&count, h + detail::COUNT_OFFSET, 8);
+  if (version == 1)
+    flags = 0; // Reserved field
+  else if (version != detail::VERSION)
+    throw corrupt("unsupported version");
+  if (file_lsn != lsn)
+    throw corrupt("LSN mismatch");
+
+  if (flags & detail::FLAG_TREE) {
+    uint8_t th[detail::TREE_HEADER_SIZE];
+    uint32_t crc, nodes;
+    if (!in.read(th, sizeof(th)))
+      throw corrupt("truncated tree");
+    std::memcpy(&crc, th, 4);
+    std::memcpy(&nodes, th + 4, 4);
+    std::vector<uint64_t> t(nodes);
+    if (!in.read(t.data(), t.size() * 8))
+      throw corrupt("truncated tree");
+    uint32_t actual = crc32c::value(th + 4, 4);
+    actual = crc32c::extend(actual, t.data(), t.size() * 8);
+    if (actual != crc)
+      throw corrupt("tree checksum mismatch");
+    on_tree(std::span<const uint64_t>(t));
+  }
+
+  std::vector<uint8_t> data;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint8_t eh[detail::ENTRY_HEADER_SIZE];
+    if (!in.read(eh, sizeof(eh)))
+      throw corrupt("truncated entry");
+    Entry e;
+    uint32_t crc, vlen;
+    uint16_t klen;
+    detail::decode_entry(eh, e, crc, klen, vlen);
+    data.resize((size_t)klen + vlen);
+    if (!in.read(data.data(), data.size()))
+      throw corrupt("truncated entry");
+    if (!detail::check_entry(eh, crc, data.data(), data.size()))
+      throw corrupt("checksum mismatch");
+
+    e.key = std::string_view((const char *)data.data(), klen);
+    e.value = std::span<const uint8_t>(data.data() + klen, vlen);
+    fn(e);
+  }
+  return count;
+}
+
+// Deletes snapshots older than `lsn` and abandoned temporary files.
+inline void remove_older(const std::string &dir, uint64_t lsn) {
+  std::error_code ec;
+  std::vector<std::filesystem::path> doomed;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    std::string name = e.path().filename().string();
+    uint64_t n;
+    if ((detail::parse_name(name, n) && n < lsn) || name.ends_with(".tmp"))
+      doomed.push_back(e.path());
+  }
+  for (auto &p : doomed)
+    std::filesystem::remove(p, ec);
+  if (!doomed.empty())
+    wal::sync_dir(dir);
+}
+
+} // namespace l3kv::snapshot
+
+#endif
@@ -1,20 +1,39 @@
 #pragma once
+#include "arena.hpp"
+#include "bucket_index.hpp"
 #include "clock.hpp"
+#include "epoch.hpp"
+#include "flat_index.hpp"
+#include "heap_image.hpp"
 #include "merkle.hpp"
+#include "ordered_index.hpp"
+#include "page_pool.hpp"
+#include "replay_index.hpp"
 #include "replication_log.hpp"
+#include "snapshot.hpp"
+#include "value_log.hpp"
 #include "wal.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <memory_resource>
 #include <mutex>
 #include <optional>
-#include <shared_mutex>
 #include <span>
 #include <string> // Replaced string_view
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "buffer.hpp"
@@ -22,353 +41,2179 @@
 
 namespace l3kv {
 
-// A wrapper around a single Lite3 buffer using PMR
+// Fixed per-entry header carried by every Blob (replaces the old
+// "<key>:meta" shadow documents).
+struct EntryMeta {
+  static constexpr uint8_t TOMBSTONE = 0x01;
+  static constexpr uint8_t DOCUMENT = 0x02; // The value is a Lite3 document
+
+  Timestamp ts{0, 0, 0}; // HLC time of the last write
+  uint64_t hash = 0;     // fnv1a_64 of the value bytes (Merkle leaf input)
+  uint8_t flags = 0;
+
+  bool is_tombstone() const { return flags & TOMBSTONE; }
+  bool is_document() const { return flags & DOCUMENT; }
+};
+
+// One stored value: header followed by the encoded bytes, in a single
+// allocation from the owning shard's memory resource.
+// Once published into a Shard a Blob is immutable: writers build a new Blob
+// (Copy-on-Write) and swap the pointer, readers never take a lock.
+// Blobs are reference counted: the index slot holds one reference (dropped
+// through EpochManager when the slot is overwritten) and every ValueRef one.
+// An evicted entry is a cold Blob: the header, with the value's ValueLog
+// location in place of its bytes.
+// A patched large document is a delta Blob: a reference to the document
+// Blob (its base) and the patches applied since, in place of the bytes
+// ([Base:8] then [WalOp:1][Len:4][patch_format payload] per patch). Its
+// meta_.hash is still its base's: hashes change once, when the deltas are
+// folded, and the engine folds before handing one out (Engine::get_meta()).
+// A large value is a paged Blob: its length and pages in place of the
+// bytes ([Length:8][PagePool:8][Page:8 per page], see page_pool.hpp).
 class Blob {
 public:
-  lite3cpp::Buffer buf_;
+  EntryMeta meta_;
 
-public:
-  Blob(std::pmr::memory_resource *mr, size_t cap = 1024) : buf_(cap) {
-    buf_.init_object();
+  // Copies `bytes` into a fresh, unpublished Blob (refcount 1). The content
+  // hash is computed here, once per value, and cached in meta_.hash.
+  // A value big enough for `pages` is paged; the pages of `like` (the
+  // value it replaces) that hold the same bytes are shared, not copied.
+  static Blob *create(std::pmr::memory_resource *mr,
+                      std::span<const uint8_t> bytes,
+                      PagePool *pages = nullptr, const Blob *like = nullptr) {
+    Blob *b = store(mr, bytes, pages, like);
+    b->meta_.hash = fnv1a_64(bytes.data(), bytes.size());
+    return b;
   }
 
-  void overwrite(const std::string &data) {
-    bool is_json = false;
-    if (!data.empty()) {
-      char first = data[0];
-      if (first == '{' || first == '[') {
-        is_json = true;
-      }
-    }
+  // Unpublished copy of `src`, header included (no rehash). A copy of a
+  // cold Blob points at the same value log record, one of a paged Blob
+  // shares its pages.
+  static Blob *clone(std::pmr::memory_resource *mr, const Blob &src) {
+    Blob *b = allocate(mr, src.view());
+    b->meta_ = src.meta_;
+    b->cold_ = src.cold_;
+    b->delta_ = src.delta_;
+    b->patches_ = src.patches_;
+    b->paged_ = src.paged_;
+    if (b->delta_)
+      b->base()->acquire();
+    for (size_t i = 0; i < b->page_count(); ++i)
+      PagePool::acquire(b->page(i));
+    return b;
+  }
+
+  // Unpublished delta Blob: `cur` (a document or a delta Blob) with one
+  // more patch. Costs the size of the patches, not of the document.
+  static Blob *patched(std::pmr::memory_resource *mr, const Blob &cur,
+                       WalOp op, std::string_view payload) {
+    const Blob *base = cur.delta_ ? cur.base() : &cur;
+    std::span<const uint8_t> prior = cur.delta_ops();
+    std::vector<uint8_t> bytes(sizeof(base) + prior.size() + 5 +
+                               payload.size());
+    uint8_t *p = bytes.data();
+    uint32_t len = (uint32_t)payload.size();
+    std::memcpy(p, &base, sizeof(base));
+    p += sizeof(base);
+    if (!prior.empty())
+      std::memcpy(p, prior.data(), prior.size());
+    p += prior.size();
+    *p++ = (uint8_t)op;
+    std::memcpy(p, &len, 4);
+    std::memcpy(p + 4, payload.data(), payload.size());
 
-    if (is_json) {
+    Blob *b = allocate(mr, bytes);
+    b->meta_ = cur.meta_; // Hash included: see above
+    b->delta_ = true;
+    b->patches_ = cur.patches_ + 1;
+    base->acquire();
+    return b;
+  }
+
+  // Unpublished cold Blob for a value written to the value log.
+  static Blob *evicted(std::pmr::memory_resource *mr, const EntryMeta &meta,
+                       const ValueLog::Location &loc) {
+    Blob *b = allocate(mr, {(const uint8_t *)&loc, sizeof(loc)});
+    b->meta_ = meta;
+    b->cold_ = true;
+    return b;
+  }
+
+  // Unpublished Blob with a known header (e.g. loaded from a snapshot).
+  static Blob *restore(std::pmr::memory_resource *mr,
+                       std::span<const uint8_t> bytes, const EntryMeta &meta,
+                       PagePool *pages = nullptr) {
+    Blob *b = store(mr, bytes, pages, nullptr);
+    b->meta_ = meta;
+    return b;
+  }
+
+  static Blob *create(std::pmr::memory_resource *mr,
+                      const lite3cpp::Buffer &buf, PagePool *pages = nullptr,
+                      const Blob *like = nullptr) {
+    Blob *b = create(mr, std::span<const uint8_t>(buf.data(), buf.size()),
+                     pages, like);
+    b->meta_.flags |= EntryMeta::DOCUMENT;
+    return b;
+  }
+
+  // Encodes a client payload: JSON documents are converted to Lite3,
+  // anything else is stored as raw bytes (straight from `data`; only the
+  // JSON parser needs its own string).
+  static Blob *encode(std::pmr::memory_resource *mr, std::string_view data,
+                      PagePool *pages = nullptr) {
+    if (!data.empty() && (data[0] == '{' || data[0] == '[')) {
       try {
-        lite3cpp::Buffer new_buf = lite3cpp::lite3_json::from_json_string(data);
-        buf_ = std::move(new_buf);
-        return;
+        std::string text(data);
+        return create(mr, lite3cpp::lite3_json::from_json_string(text),
+                      pages);
       } catch (...) {
-        // Fallback to binary if JSON parsing fails?
-        // Or assume it was meant to be JSON and failed.
-        // For now, let's assume it might be binary if it fails?
-        // No, if it starts with { it's likely JSON.
-        // But maybe binary data starts with {.
+        // Not valid JSON after all: keep the bytes as sent
       }
     }
+    return create(mr,
+                  std::span<const uint8_t>((const uint8_t *)data.data(),
+                                           data.size()),
+                  pages);
+  }
+
+  Blob(const Blob &) = delete;
+  Blob &operator=(const Blob &) = delete;
 
-    // Treat as binary
-    std::vector<uint8_t> vec(data.begin(), data.end());
-    buf_ = lite3cpp::Buffer(std::move(vec));
+  void acquire() const { refs_.fetch_add(1, std::memory_order_relaxed); }
+  static void release(const Blob *b) {
+    if (b && b->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      auto *mr = b->mr_;
+      size_t bytes = sizeof(Blob) + b->size_;
+      const Blob *base = b->delta_ ? b->base() : nullptr;
+      for (size_t i = 0; i < b->page_count(); ++i)
+        b->pool()->release(b->page(i));
+      b->~Blob();
+      mr->deallocate(const_cast<Blob *>(b), bytes, alignof(Blob));
+      release(base);
+    }
   }
 
-  bool set_int(const std::string &key, int64_t val) {
-    buf_.set_i64(0, key, val);
-    return true;
+  // The value bytes, except for a cold, delta or paged Blob (see
+  // location(), to_buffer() and read()).
+  const uint8_t *data() const {
+    return reinterpret_cast<const uint8_t *>(this + 1);
+  }
+  size_t size() const { return size_; }
+  std::span<const uint8_t> view() const { return {data(), size_}; }
+
+  bool cold() const { return cold_; }
+  ValueLog::Location location() const {
+    ValueLog::Location loc;
+    std::memcpy(&loc, data(), sizeof(loc));
+    return loc;
   }
 
-  bool set_str(const std::string &key, const std::string &val) {
-    buf_.set_str(0, key, val);
+  // CLOCK reference bit: set by reads, cleared by the eviction sweep. New
+  // values start referenced.
+  void touch() const {
+    if (!referenced_.load(std::memory_order_relaxed))
+      referenced_.store(true, std::memory_order_relaxed);
+  }
+  bool clear_referenced() const {
+    if (!referenced_.load(std::memory_order_relaxed))
+      return false;
+    referenced_.store(false, std::memory_order_relaxed);
     return true;
   }
 
-  std::span<const uint8_t> view() const { return {buf_.data(), buf_.size()}; }
+  bool delta() const { return delta_; }
+  // Size and number of the patches a delta Blob holds.
+  size_t delta_bytes() const { return delta_ops().size(); }
+  size_t delta_count() const { return patches_; }
+
+  bool paged() const { return paged_; }
+  // Value bytes of a plain or paged Blob.
+  size_t length() const {
+    if (!paged_)
+      return size_;
+    uint64_t len;
+    std::memcpy(&len, data(), 8);
+    return len;
+  }
+
+  // Copies up to out.size() value bytes from `offset` into `out` and
+  // returns how many there were. A paged Blob only touches the pages in
+  // the range. Not for cold or delta Blobs.
+  size_t read(size_t offset, std::span<uint8_t> out) const {
+    size_t len = length();
+    if (offset >= len)
+      return 0;
+    size_t n = std::min(out.size(), len - offset);
+    if (!paged_) {
+      std::memcpy(out.data(), data() + offset, n);
+      return n;
+    }
+    for (size_t done = 0; done < n;) {
+      size_t at = offset + done;
+      size_t in = at % PagePool::PAGE_BYTES;
+      size_t k = std::min(n - done, PagePool::PAGE_BYTES - in);
+      std::memcpy(out.data() + done,
+                  page(at / PagePool::PAGE_BYTES)->bytes() + in, k);
+      done += k;
+    }
+    return n;
+  }
+
+  // Calls fn(bytes) for the value bytes of a plain or paged Blob, in order:
+  // once, or once per page.
+  template <class Fn> void for_each_chunk(Fn &&fn) const {
+    if (!paged_) {
+      fn(view());
+      return;
+    }
+    size_t len = length();
+    for (size_t i = 0, off = 0; off < len; ++i, off += PagePool::PAGE_BYTES)
+      fn(std::span<const uint8_t>(
+          page(i)->bytes(), std::min(PagePool::PAGE_BYTES, len - off)));
+  }
+
+  // Mutable Lite3 copy of the value (e.g. to patch it into a new Blob). For
+  // a delta Blob, its base with the patches applied; for a paged Blob, its
+  // pages gathered into contiguous bytes.
+  lite3cpp::Buffer to_buffer() const {
+    if (paged_) {
+      std::vector<uint8_t> bytes(length());
+      read(0, bytes);
+      return lite3cpp::Buffer(std::move(bytes));
+    }
+    if (!delta_)
+      return lite3cpp::Buffer(std::vector<uint8_t>(data(), data() + size_));
+    auto buf = base()->to_buffer();
+    std::span<const uint8_t> ops = delta_ops();
+    while (!ops.empty()) {
+      uint32_t len;
+      std::memcpy(&len, ops.data() + 1, 4);
+      std::string_view payload((const char *)ops.data() + 5, len);
+      std::string_view field, value;
+      patch_format::decode(payload, field, value);
+      if ((WalOp)ops[0] == WalOp::PATCH_I64_BIN) {
+        int64_t v = 0;
+        patch_format::decode_i64(value, v);
+        buf.set_i64(0, std::string(field), v);
+      } else {
+        buf.set_str(0, std::string(field), std::string(value));
+      }
+      ops = ops.subspan(5 + len);
+    }
+    return buf;
+  }
+
+private:
+  Blob(std::pmr::memory_resource *mr, size_t size) : mr_(mr), size_(size) {}
+  ~Blob() = default;
+
+  static Blob *allocate(std::pmr::memory_resource *mr,
+                        std::span<const uint8_t> bytes) {
+    void *p = mr->allocate(sizeof(Blob) + bytes.size(), alignof(Blob));
+    Blob *b = new (p) Blob(mr, bytes.size());
+    if (!bytes.empty())
+      std::memcpy(b + 1, bytes.data(), bytes.size());
+    return b;
+  }
+
+  // Plain Blob holding `bytes`, or a paged one if `pages` takes them.
+  static Blob *store(std::pmr::memory_resource *mr,
+                     std::span<const uint8_t> bytes, PagePool *pages,
+                     const Blob *like) {
+    if (!pages || !pages->pages(bytes.size()))
+      return allocate(mr, bytes);
+    if (like && like->delta_)
+      like = like->base();
+    if (like && (!like->paged_ || like->pool() != pages))
+      like = nullptr;
+    constexpr size_t PB = PagePool::PAGE_BYTES;
+    size_t n = (bytes.size() + PB - 1) / PB;
+    std::vector<uint8_t> desc(16 + n * sizeof(PagePool::Page *));
+    uint64_t len = bytes.size();
+    std::memcpy(desc.data(), &len, 8);
+    std::memcpy(desc.data() + 8, &pages, 8);
+    for (size_t i = 0; i < n; ++i) {
+      size_t off = i * PB, k = std::min(PB, bytes.size() - off);
+      const PagePool::Page *pg;
+      if (like && like->length() >= off + k &&
+          std::memcmp(like->page(i)->bytes(), bytes.data() + off, k) == 0) {
+        pg = like->page(i); // Unchanged: shared
+        PagePool::acquire(pg);
+      } else {
+        PagePool::Page *fresh = pages->allocate();
+        std::memcpy(fresh->bytes(), bytes.data() + off, k);
+        pg = fresh;
+      }
+      std::memcpy(desc.data() + 16 + i * sizeof(pg), &pg, sizeof(pg));
+    }
+    Blob *b = allocate(mr, desc);
+    b->paged_ = true;
+    return b;
+  }
+
+  PagePool *pool() const {
+    PagePool *p;
+    std::memcpy(&p, data() + 8, sizeof(p));
+    return p;
+  }
+  size_t page_count() const {
+    if (!paged_)
+      return 0;
+    return (size_ - 16) / sizeof(const PagePool::Page *);
+  }
+  const PagePool::Page *page(size_t i) const {
+    const PagePool::Page *p;
+    std::memcpy(&p, data() + 16 + i * sizeof(p), sizeof(p));
+    return p;
+  }
+
+  const Blob *base() const {
+    const Blob *b;
+    std::memcpy(&b, data(), sizeof(b));
+    return b;
+  }
+  std::span<const uint8_t> delta_ops() const {
+    if (!delta_)
+      return {};
+    return view().subspan(sizeof(const Blob *));
+  }
+
+  std::pmr::memory_resource *mr_;
+  size_t size_;
+  mutable std::atomic<uint32_t> refs_{1};
+  mutable std::atomic<bool> referenced_{true};
+  bool cold_ = false;
+  bool delta_ = false;
+  bool paged_ = false;
+  uint32_t patches_ = 0; // Delta Blob: patches held
+};
+
+struct BlobRelease {
+  void operator()(Blob *b) const { Blob::release(b); }
+};
+using BlobPtr = std::unique_ptr<Blob, BlobRelease>; // Unpublished Blob
+
+// Shared read-only handle to a published value. Holding one keeps the bytes
+// alive after a writer replaced the entry; nothing is copied. Handles must
+// not outlive the Engine that returned them.
+//
+// A paged value is handed out as is: the handle pins its Blob, which holds
+// a reference to each of its pages. Its bytes are not contiguous: data() is
+// null, and they are read through chunks() (or read(), to_buffer()).
+class ValueRef {
+  const Blob *blob_ = nullptr;
+
+public:
+  ValueRef() = default;
+  // Adopts a reference already taken with Blob::acquire().
+  explicit ValueRef(const Blob *b) : blob_(b) {}
+  ValueRef(const ValueRef &o) : blob_(o.blob_) {
+    if (blob_)
+      blob_->acquire();
+  }
+  ValueRef(ValueRef &&o) noexcept : blob_(std::exchange(o.blob_, nullptr)) {}
+  ValueRef &operator=(ValueRef o) noexcept {
+    std::swap(blob_, o.blob_);
+    return *this;
+  }
+  ~ValueRef() { Blob::release(blob_); }
+
+  // Contiguous bytes; null for a missing key or a paged value.
+  const uint8_t *data() const {
+    return blob_ && !blob_->paged() ? blob_->data() : nullptr;
+  }
+  size_t size() const { return blob_ ? blob_->length() : 0; }
+  bool empty() const { return size() == 0; }
+  // Whether there is a value (possibly zero bytes long).
+  explicit operator bool() const { return blob_ != nullptr; }
+  bool paged() const { return blob_ && blob_->paged(); }
+
+  // The bytes in order, as one span or one per page. Valid while this
+  // handle lives.
+  std::vector<std::span<const uint8_t>> chunks() const {
+    std::vector<std::span<const uint8_t>> out;
+    if (blob_)
+      blob_->for_each_chunk([&](std::span<const uint8_t> c) {
+        out.push_back(c);
+      });
+    return out;
+  }
+
+  // Copies up to out.size() bytes from `offset`; returns how many.
+  size_t read(size_t offset, std::span<uint8_t> out) const {
+    return blob_ ? blob_->read(offset, out) : 0;
+  }
+
+  // Lite3 copy of the document for field access (empty Buffer if none).
+  lite3cpp::Buffer to_buffer() const {
+    return blob_ ? blob_->to_buffer() : lite3cpp::Buffer();
+  }
+};
+
+// Background checkpoints: a snapshot of all shards, after which the WAL
+// segments it covers are deleted.
+//
+// With Format::HEAP, checkpoints are heap images instead (heap_image.hpp):
+// a restart maps the newest one and serves it in place, copying an entry
+// into its shard only when it is first read or written, and a clean
+// shutdown writes one last image so the next start replays no log at all.
+struct CheckpointOptions {
+  enum class Format { SNAPSHOT, HEAP };
+  uint64_t wal_bytes = 256ull << 20; // WAL growth that triggers one, 0 = off
+  uint32_t poll_ms = 1000;           // How often the checkpointer checks
+  Format format = Format::SNAPSHOT;
+};
+
+// Startup recovery. In the background, the constructor returns at once and
+// shards take requests one by one as their replay ends; a request for a
+// shard that is not replayed yet waits for it and moves it to the front.
+struct RecoveryOptions {
+  bool background = false;
+};
+
+struct RecoveryProgress {
+  enum class Phase { SNAPSHOT, LOG, REPLAY, DONE, FAILED };
+  Phase phase = Phase::SNAPSHOT;
+  size_t shards_ready = 0;
+  size_t shards = 0;
+  uint64_t snapshot_entries = 0; // Loaded so far
+  uint64_t elapsed_ms = 0;
+  std::string error; // Set if FAILED
+};
+
+// Tiered storage. Over the memory budget, values nobody read recently are
+// evicted to a value log; reads fault them back in. Off when the budget is
+// 0.
+struct TieringOptions {
+  uint64_t memory_budget = 0;      // Value bytes kept in RAM
+  uint64_t file_bytes = 64 << 20;  // Value log file size
+  size_t min_value_bytes = 256;    // Smaller values always stay
+  double compact_ratio = 0.5;      // Dead share that triggers compaction
+  uint32_t poll_ms = 100;          // How often memory use is checked
+  std::string dir;                 // Default: "<WAL dir>/vlog"
+};
+
+struct TierStats {
+  uint64_t resident_bytes = 0; // Value memory in all shard arenas
+  uint64_t evicted = 0;        // Values moved to the value log
+  uint64_t faulted = 0;        // Values read back
+  uint64_t compactions = 0;    // Value log files rewritten
+  ValueLog::Stats log;
+};
+
+// Patch buffer. A field patch on a document of at least `min_value_bytes`
+// is appended to the entry as a delta instead of rewriting the document;
+// reads merge the deltas in. A background task folds them into a new
+// document once they reach `fold_bytes`, or `fold_delay_ms` after the first
+// one. Until then the entry keeps the hash of its base in the Merkle tree;
+// anything that exposes hashes to sync (get_merkle_root_hash(), get_meta())
+// folds the pending deltas first, so peers never see a delta identity.
+//
+// Bounds: each patch copies the deltas before it, and each read of the
+// entry applies them all, so an entry holds at most `max_patches` deltas
+// and 8 x `fold_bytes` of them. A patch past either bound folds the
+// entry inline (it rewrites the document, as without the buffer).
+struct DeltaOptions {
+  bool enabled = true;
+  size_t min_value_bytes = 16 << 10;
+  size_t fold_bytes = 512;
+  uint32_t fold_delay_ms = 1000;
+  size_t max_patches = 32;
+};
+
+struct DeltaStats {
+  uint64_t buffered = 0; // Patches stored as deltas
+  uint64_t folded = 0;   // Documents rewritten with their deltas
+};
+
+// Large values. A value of at least `min_value_bytes` is stored as
+// fixed-size pages (page_pool.hpp) instead of one contiguous allocation;
+// rewriting it only allocates the pages that changed, and read() copies
+// only the pages in its range. Off when 0.
+struct PagingOptions {
+  size_t min_value_bytes = 1 << 20;
+};
+
+// Ordered key index (ordered_index.hpp) for scan(). Costs one skiplist node
+// per key, so it is off unless asked for.
+struct OrderedIndexOptions {
+  bool enabled = false;
+};
+
+// Keys in [begin, end); an empty `end` is unbounded.
+struct KeyRange {
+  std::string begin, end;
+
+  // Every key starting with `prefix`.
+  static KeyRange prefix(std::string_view prefix) {
+    KeyRange r{std::string(prefix), std::string(prefix)};
+    while (!r.end.empty() && (uint8_t)r.end.back() == 0xFF)
+      r.end.pop_back();
+    if (!r.end.empty())
+      r.end.back() = (char)((uint8_t)r.end.back() + 1);
+    return r;
+  }
+  bool contains(std::string_view key) const {
+    return key >= begin && (end.empty() || key < end);
+  }
+};
+
+struct ScanPage {
+  std::vector<std::pair<std::string, ValueRef>> entries; // In key order
+  std::string cursor; // Resumes after the last entry; empty when done
+};
+
+// One write of Engine::write_batch().
+struct WriteOp {
+  enum class Type : uint8_t { PUT, PATCH_INT, PATCH_STR, DEL };
+
+  Type type;
+  std::string key;
+  std::string field; // PATCH_INT, PATCH_STR
+  std::string value; // PUT: the document; PATCH_STR: the field value
+  int64_t num = 0;   // PATCH_INT
+
+  static WriteOp put(std::string key, std::string json_body) {
+    return {Type::PUT, std::move(key), {}, std::move(json_body)};
+  }
+  static WriteOp patch_int(std::string key, std::string field, int64_t val) {
+    return {Type::PATCH_INT, std::move(key), std::move(field), {}, val};
+  }
+  static WriteOp patch_str(std::string key, std::string field,
+                           std::string val) {
+    return {Type::PATCH_STR, std::move(key), std::move(field), std::move(val)};
+  }
+  static WriteOp del(std::string key) { return {Type::DEL, std::move(key)}; }
 };
 
 class Engine {
   static constexpr size_t SHARDS = 64;
+  static constexpr size_t INITIAL_CAPACITY = 1024; // Slots per shard index
+
   struct Shard {
-    std::shared_mutex mx;
-    std::pmr::unsynchronized_pool_resource pool;
-    std::unordered_map<std::string, std::unique_ptr<Blob>> map;
-    Shard() : pool(std::pmr::new_delete_resource()) {}
+    std::mutex mx; // Serializes writers; readers use EpochManager
+    ShardArena arena; // Value storage; outlives `index`
+    PagePool pages;   // Large values, from `arena`
+    FlatIndex<Blob> index;
+    std::atomic<bool> ready{false}; // Recovered; set under rec_mx_
+    explicit Shard(size_t paged_min_bytes)
+        : pages(&arena, paged_min_bytes), index(INITIAL_CAPACITY) {}
+    ~Shard() {
+      index.for_each([](std::string_view, std::atomic<Blob *> &b) {
+        Blob::release(b.load(std::memory_order_relaxed));
+      });
+    }
   };
 
   std::vector<std::unique_ptr<Shard>> shards_;
   std::unique_ptr<WriteAheadLog> wal_;
   HybridLogicalClock clock_;
   MerkleTree merkle_;
+  BucketIndex buckets_; // Merkle leaf bucket -> keys, for anti-entropy
+
+  CheckpointOptions ckpt_opts_;
+  std::mutex ckpt_mx_; // One checkpoint at a time
+  std::atomic<uint64_t> ckpt_lsn_{0};
+  // The heap image recovery started from, if any. Entries not in a shard
+  // index yet are read from it (materialize()). Set before any shard is
+  // ready, immutable after.
+  std::unique_ptr<heap::Image> base_;
+  std::mutex ckpt_wait_mx_;
+  std::condition_variable ckpt_cv_;
+  bool ckpt_stop_ = false;
+  std::thread checkpointer_;
+
+  using Phase = RecoveryProgress::Phase;
+  std::atomic<Phase> rec_phase_{Phase::SNAPSHOT};
+  std::atomic<size_t> rec_ready_{0};
+  std::atomic<uint64_t> rec_entries_{0};
+  std::atomic<uint64_t> rec_ms_{0}; // Once DONE
+  std::chrono::steady_clock::time_point rec_started_;
+  std::mutex rec_mx_;
+  std::condition_variable rec_cv_;
+  std::vector<size_t> rec_wanted_; // Shards requests wait for, in order
+  std::vector<uint8_t> rec_taken_; // Shards whose replay has started
+  size_t rec_next_ = 0;            // Next shard in the default order
+  std::string rec_error_;
+  std::thread recovery_;
 
-  Shard &get_shard(const std::string &key) {
-    size_t h = std::hash<std::string>{}(key);
-    return *shards_[h % SHARDS];
+  TieringOptions tier_opts_;
+  std::unique_ptr<ValueLog> vlog_; // Null when tiering is off
+  std::mutex tier_mx_;
+  std::condition_variable tier_cv_;
+  bool tier_stop_ = false;
+  std::deque<std::pair<std::string, std::promise<ValueRef>>> faults_;
+  size_t evict_cursor_ = 0; // Next shard the sweep visits
+  static constexpr uint64_t RESTORE_CHECK_BYTES = 64 << 10;
+  bool restore_spill_ = false; // Checkpoint loading is over the budget
+  uint64_t restore_unchecked_ = 0;
+  std::atomic<uint64_t> evicted_{0}, faulted_{0}, compactions_{0};
+  std::thread tierer_;
+
+  DeltaOptions delta_opts_;
+  // Delta bytes an entry may hold, in fold_bytes (see DeltaOptions)
+  static constexpr size_t MAX_FOLD_LAG = 8;
+  std::mutex fold_mx_; // Taken inside shard locks, never around one
+  std::condition_variable fold_cv_;
+  bool fold_stop_ = false;
+  std::deque<std::string> fold_now_; // Past fold_bytes
+  std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>>
+      fold_later_; // First delta, by due time
+  std::atomic<uint64_t> buffered_{0}, folded_{0};
+  std::thread folder_;
+
+  PagingOptions paging_opts_;
+
+  std::unique_ptr<OrderedIndex> ordered_; // Null unless enabled
+
+  static uint64_t key_hash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
   }
 
-  // ... (Move methods from bottom to top) ...
+  Shard &shard_for(uint64_t h) { return *shards_[h % SHARDS]; }
+
+  // A key entered a shard index.
+  void index_key(std::string_view key) {
+    buckets_.add(key);
+    if (ordered_)
+      ordered_->insert(key);
+  }
 
 private:
-  Timestamp get_local_timestamp_internal(const std::string &key) {
-    return {0, 0, 0};
+  static constexpr Timestamp NO_TS{0, 0, 0};
+
+  // Last-writer-wins on the inline HLC timestamp. Local writes and WAL replay
+  // (`strict` = false) only lose to a strictly newer entry; remote mutations
+  // (`strict` = true) must also beat an equal one. Untimestamped legacy
+  // records are applied in log order.
+  static bool is_stale(const Timestamp &ts, const Blob *cur, bool strict) {
+    if (!cur || ts == NO_TS)
+      return false;
+    return strict ? ts <= cur->meta_.ts : ts < cur->meta_.ts;
   }
 
-  uint64_t hash_blob(const std::unique_ptr<Blob> &blob) {
-    if (!blob)
-      return 0;
-    auto v = blob->view();
-    return fnv1a_64(v.data(), v.size());
+  struct Swap {
+    bool applied = false;
+    Blob *old = nullptr;
+    uint64_t new_hash = 0;
+  };
+
+  // Swaps in `make(shard, current)` for `key` unless the write is stale.
+  // `make` returns a sealed Blob; its timestamp is set here, under the lock.
+  // The caller retires the replaced Blob outside the lock (finish_write).
+  template <class MakeNext>
+  Swap publish(std::string_view key, uint64_t h, const Timestamp &ts,
+               bool strict, MakeNext make) {
+    auto &s = shard_for(h);
+    std::lock_guard lock(s.mx);
+    return publish_locked(s, key, h, ts, strict, make);
+  }
+
+  // publish() with `s.mx` already held (a batch applies several writes to
+  // a shard under one lock).
+  template <class MakeNext>
+  Swap publish_locked(Shard &s, std::string_view key, uint64_t h,
+                      const Timestamp &ts, bool strict, MakeNext &make) {
+    if (base_)
+      materialize(s, key, h);
+    bool inserted;
+    auto &slot = s.index.find_or_insert(key, h, &inserted);
+    if (inserted)
+      index_key(key);
+    Blob *old = slot.load(std::memory_order_relaxed);
+    if (is_stale(ts, old, strict))
+      return {};
+    BlobPtr next = make(s, old);
+    next->meta_.ts = (ts == NO_TS && old) ? old->meta_.ts : ts;
+    uint64_t new_hash = next->meta_.hash;
+    slot.store(next.release(), std::memory_order_release);
+    return {true, old, new_hash};
+  }
+
+  // Drops the index's reference once no lock-free reader can still see `b`.
+  static void retire(Blob *b) {
+    EpochManager::instance().retire(
+        b, [](void *p) { Blob::release(static_cast<Blob *>(p)); });
+  }
+
+  bool finish_write(std::string_view key, const Swap &sw) {
+    if (!sw.applied)
+      return false;
+    // Both hashes are cached in the Blob headers: no value bytes are read
+    uint64_t old_h = sw.old ? sw.old->meta_.hash : 0;
+    if (sw.old && sw.old->cold())
+      vlog_->mark_dead(sw.old->location(), key.size());
+    retire(sw.old);
+    if (old_h != sw.new_hash)
+      merkle_.apply_delta(key, old_h ^ sw.new_hash);
+    return true;
   }
 
-  void apply_put(const std::string &key, const std::string &json_body) {
-    auto &s = get_shard(key);
-    std::unique_lock lock(s.mx);
+  // Document to patch: a copy of `cur`, or an empty object for a tombstone
+  // or missing key. An evicted value is read back under the shard lock
+  // (patches are rare on cold keys) unless `cold` already holds its bytes.
+  lite3cpp::Buffer patch_base(std::string_view key, const Blob *cur,
+                              const std::vector<uint8_t> *cold = nullptr) {
+    if (cur && cur->cold() && !cur->meta_.is_tombstone()) {
+      if (cold)
+        return lite3cpp::Buffer(std::vector<uint8_t>(*cold));
+      std::vector<uint8_t> bytes;
+      if (!vlog_->read(cur->location(), key, bytes))
+        throw std::runtime_error("Value log: cannot read " + std::string(key));
+      return lite3cpp::Buffer(std::move(bytes));
+    }
+    if (cur && !cur->meta_.is_tombstone())
+      return cur->to_buffer();
+    lite3cpp::Buffer buf(1024);
+    buf.init_object();
+    return buf;
+  }
+
+  bool apply_put(std::string_view key, std::string_view json_body,
+                 const Timestamp &ts, bool strict = false) {
+    uint64_t h = key_hash(key);
+    // Encode and hash outside the shard lock
+    auto &s = shard_for(h);
+    BlobPtr next(Blob::encode(&s.arena, json_body, &s.pages));
+
+    return finish_write(key, publish(key, h, ts, strict, [&](Shard &, Blob *) {
+                          return std::move(next);
+                        }));
+  }
+
+  bool apply_patch_int(std::string_view key, const std::string &field,
+                       int64_t val, const Timestamp &ts) {
+    uint64_t h = key_hash(key);
+    std::string delta = patch_format::encode_i64(field, val);
+    return finish_write(
+        key, publish(key, h, ts, false, [&](Shard &s, Blob *cur) {
+          return patched_i64(s, key, cur, field, val, delta);
+        }));
+  }
+
+  // Next version of `cur` with `field` set; `delta` is the encoded patch
+  // (patch_format), kept as is if the patch buffer takes it. `cold` as
+  // patch_base(). Called under the shard lock.
+  BlobPtr patched_i64(Shard &s, std::string_view key, Blob *cur,
+                      const std::string &field, int64_t val,
+                      std::string_view delta,
+                      const std::vector<uint8_t> *cold = nullptr) {
+    if (buffer_patch(key, cur, delta.size()))
+      return BlobPtr(
+          Blob::patched(&s.arena, *cur, WalOp::PATCH_I64_BIN, delta));
+    auto buf = patch_base(key, cur, cold);
+    buf.set_i64(0, field, val);
+    return BlobPtr(Blob::create(&s.arena, buf, &s.pages, cur));
+  }
+
+  bool apply_patch_str(std::string_view key, const std::string &field,
+                       const std::string &val, const Timestamp &ts) {
+    uint64_t h = key_hash(key);
+    std::string delta = patch_format::encode_str(field, val);
+    return finish_write(
+        key, publish(key, h, ts, false, [&](Shard &s, Blob *cur) {
+          return patched_str(s, key, cur, field, val, delta);
+        }));
+  }
 
-    uint64_t old_h = 0;
-    if (s.map.contains(key)) {
-      old_h = hash_blob(s.map[key]);
+  BlobPtr patched_str(Shard &s, std::string_view key, Blob *cur,
+                      const std::string &field, const std::string &val,
+                      std::string_view delta,
+                      const std::vector<uint8_t> *cold = nullptr) {
+    if (buffer_patch(key, cur, delta.size()))
+      return BlobPtr(
+          Blob::patched(&s.arena, *cur, WalOp::PATCH_STR_BIN, delta));
+    auto buf = patch_base(key, cur, cold);
+    buf.set_str(0, field, val);
+    return BlobPtr(Blob::create(&s.arena, buf, &s.pages, cur));
+  }
+
+  // Whether a patch of `patch_bytes` to `cur` goes to the patch buffer;
+  // schedules the fold it will need. Called under the shard lock.
+  bool buffer_patch(std::string_view key, const Blob *cur,
+                    size_t patch_bytes) {
+    if (!delta_opts_.enabled || !cur || cur->cold() ||
+        !cur->meta_.is_document() ||
+        (!cur->delta() && cur->length() < delta_opts_.min_value_bytes))
+      return false;
+    size_t before = cur->delta_bytes();
+    if (before >= delta_opts_.fold_bytes * MAX_FOLD_LAG ||
+        cur->delta_count() >= delta_opts_.max_patches)
+      return false; // Folding fell behind: fold inline
+
+    bool full = before + 5 + patch_bytes >= delta_opts_.fold_bytes;
+    if (!cur->delta() || (full && before < delta_opts_.fold_bytes))
+      schedule_fold(key, full);
+    buffered_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void schedule_fold(std::string_view key, bool now) {
+    {
+      std::lock_guard lock(fold_mx_);
+      if (now)
+        fold_now_.emplace_back(key);
+      else
+        fold_later_.emplace_back(
+            std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(delta_opts_.fold_delay_ms),
+            key);
+    }
+    fold_cv_.notify_one();
+  }
+
+  bool apply_del(std::string_view key, const Timestamp &ts,
+                 bool strict = false) {
+    // Tombstone logic: Don't erase. Set to empty and flag it.
+    uint64_t h = key_hash(key);
+    BlobPtr next = tombstone(shard_for(h));
+
+    return finish_write(key, publish(key, h, ts, strict, [&](Shard &, Blob *) {
+                          return std::move(next);
+                        }));
+  }
+
+  static BlobPtr tombstone(Shard &s) {
+    BlobPtr b(Blob::create(&s.arena, std::span<const uint8_t>()));
+    b->meta_.flags = EntryMeta::TOMBSTONE;
+    return b;
+  }
+
+  // WALs written before EntryMeta kept timestamps in "<key>:meta" shadow
+  // keys, logged right after the data op they describe. Folds one into the
+  // base entry. Returns false if `key` is not such a record.
+  bool migrate_legacy_meta(WalOp op, std::string_view key,
+                           std::string_view payload, Timestamp &max_ts) {
+    constexpr std::string_view SUFFIX = ":meta";
+    if (key.size() <= SUFFIX.size() || !key.ends_with(SUFFIX))
+      return false;
+    std::string_view base = key.substr(0, key.size() - SUFFIX.size());
+
+    Timestamp ts{0, 0, 0};
+    if (op == WalOp::PUT) {
+      // {"ts":W,"l":L,"n":N[,"tombstone":true]}
+      auto buf = lite3cpp::lite3_json::from_json_string(std::string(payload));
+      auto num = [&](const char *f) -> int64_t {
+        auto type = buf.get_type(0, f);
+        if (type == lite3cpp::Type::Float64)
+          return (int64_t)buf.get_f64(0, f);
+        return type == lite3cpp::Type::Int64 ? buf.get_i64(0, f) : 0;
+      };
+      ts = {num("ts"), (uint32_t)num("l"), (uint32_t)num("n")};
+    } else if (op == WalOp::PATCH_STR) {
+      // field:W:L:N
+      std::string p(payload);
+      size_t c1 = p.find(':');
+      size_t c2 = p.find(':', c1 + 1);
+      size_t c3 = p.find(':', c2 + 1);
+      if (c1 == std::string::npos || c2 == std::string::npos ||
+          c3 == std::string::npos)
+        return false;
+      ts = {std::stoll(p.substr(c1 + 1, c2 - c1 - 1)),
+            (uint32_t)std::stoul(p.substr(c2 + 1, c3 - c2 - 1)),
+            (uint32_t)std::stoul(p.substr(c3 + 1))};
     } else {
-      s.map[key] = std::make_unique<Blob>(&s.pool);
+      return false;
     }
 
-    s.map[key]->overwrite(json_body);
-    uint64_t new_h = hash_blob(s.map[key]);
-    lock.unlock();
-    merkle_.apply_delta(key, old_h ^ new_h);
+    uint64_t h = key_hash(base);
+    auto &s = shard_for(h);
+    {
+      std::lock_guard lock(s.mx);
+      if (auto *slot = materialize(s, base, h)) {
+        Blob *cur = slot->load(std::memory_order_relaxed);
+        if (cur && cur->meta_.ts < ts) {
+          Blob *next = Blob::clone(&s.arena, *cur);
+          next->meta_.ts = ts;
+          slot->store(next, std::memory_order_release);
+          retire(cur);
+        }
+      }
+    }
+    if (max_ts < ts)
+      max_ts = ts;
+    return true;
   }
 
-  void apply_patch_int(const std::string &key, const std::string &field,
-                       int64_t val) {
-    auto &s = get_shard(key);
-    std::unique_lock lock(s.mx);
-    if (!s.map.contains(key))
-      s.map[key] = std::make_unique<Blob>(&s.pool);
+  void replay(WalOp op, std::string_view key, std::string_view payload,
+              const Timestamp &ts, Timestamp &max_ts) {
+    if (ts == NO_TS && migrate_legacy_meta(op, key, payload, max_ts))
+      return;
+    if (max_ts < ts)
+      max_ts = ts;
 
-    uint64_t old_h = hash_blob(s.map[key]);
-    s.map[key]->set_int(field, val);
-    uint64_t new_h = hash_blob(s.map[key]);
-    lock.unlock();
-    merkle_.apply_delta(key, old_h ^ new_h);
+    if (op == WalOp::PUT) {
+      apply_put(key, payload, ts);
+    } else if (op == WalOp::PATCH_I64_BIN) {
+      std::string_view field, value;
+      int64_t val;
+      if (!patch_format::decode(payload, field, value) ||
+          !patch_format::decode_i64(value, val))
+        throw std::invalid_argument("bad PATCH_I64_BIN payload");
+      apply_patch_int(key, std::string(field), val, ts);
+    } else if (op == WalOp::PATCH_STR_BIN) {
+      std::string_view field, value;
+      if (!patch_format::decode(payload, field, value))
+        throw std::invalid_argument("bad PATCH_STR_BIN payload");
+      apply_patch_str(key, std::string(field), std::string(value), ts);
+    } else if (op == WalOp::PATCH_I64) {
+      // Text payloads from older logs: "field:value"
+      size_t colon = payload.find(':');
+      if (colon != std::string_view::npos) {
+        std::string_view num = payload.substr(colon + 1);
+        int64_t val = 0;
+        auto [end, ec] =
+            std::from_chars(num.data(), num.data() + num.size(), val);
+        if (ec != std::errc())
+          throw std::invalid_argument("bad PATCH_I64 value");
+        apply_patch_int(key, std::string(payload.substr(0, colon)), val, ts);
+      }
+    } else if (op == WalOp::PATCH_STR) {
+      size_t colon = payload.find(':');
+      if (colon != std::string_view::npos)
+        apply_patch_str(key, std::string(payload.substr(0, colon)),
+                        std::string(payload.substr(colon + 1)), ts);
+    } else if (op == WalOp::DELETE_) {
+      apply_del(key, ts);
+    }
   }
 
-  void apply_patch_str(const std::string &key, const std::string &field,
-                       const std::string &val) {
-    auto &s = get_shard(key);
-    std::unique_lock lock(s.mx);
-    if (!s.map.contains(key))
-      s.map[key] = std::make_unique<Blob>(&s.pool);
+  // Recovery partition of a WAL op: its key's shard. A legacy "<key>:meta"
+  // record goes with its base key, which migrate_legacy_meta() updates.
+  // Only an untimestamped PUT or PATCH_STR can be one: a timestamped
+  // record of a key ending in ":meta" is an ordinary write to that key.
+  static size_t replay_shard(const ReplayOp &r) {
+    constexpr std::string_view SUFFIX = ":meta";
+    std::string_view key = r.key;
+    if (r.ts == NO_TS && (r.op == WalOp::PUT || r.op == WalOp::PATCH_STR) &&
+        key.size() > SUFFIX.size() && key.ends_with(SUFFIX))
+      key.remove_suffix(SUFFIX.size());
+    return key_hash(key) % SHARDS;
+  }
 
-    uint64_t old_h = hash_blob(s.map[key]);
-    s.map[key]->set_str(field, val);
-    uint64_t new_h = hash_blob(s.map[key]);
-    lock.unlock();
-    merkle_.apply_delta(key, old_h ^ new_h);
+  // Inserts a snapshot entry as is: header, cached hash and all. The entry
+  // is folded into the Merkle tree unless the snapshot's tree was loaded.
+  void restore(const snapshot::Entry &e, bool in_tree, Timestamp &max_ts) {
+    uint64_t h = key_hash(e.key);
+    auto &s = shard_for(h);
+    EntryMeta meta{e.ts, e.hash, e.flags};
+    // Over the memory budget, values go straight to the value log. Memory
+    // use is checked every RESTORE_CHECK_BYTES of values.
+    restore_unchecked_ += e.value.size();
+    if (vlog_ && restore_unchecked_ >= RESTORE_CHECK_BYTES) {
+      restore_spill_ = resident_bytes() > tier_opts_.memory_budget;
+      restore_unchecked_ = 0;
+    }
+    Blob *b = restore_spill_ && evictable(e.value.size(), meta)
+                  ? Blob::evicted(&s.arena, meta, vlog_->append(e.key, e.value))
+                  : Blob::restore(&s.arena, e.value, meta, &s.pages);
+    {
+      std::lock_guard lock(s.mx);
+      bool inserted;
+      auto &slot = s.index.find_or_insert(e.key, h, &inserted);
+      if (inserted)
+        index_key(e.key);
+      Blob *old = slot.exchange(b, std::memory_order_release);
+      Blob::release(old); // Not published to readers yet
+    }
+    if (!in_tree)
+      merkle_.apply_delta(e.key, e.hash);
+    if (max_ts < e.ts)
+      max_ts = e.ts;
+    rec_entries_.fetch_add(1, std::memory_order_relaxed);
   }
 
-  bool apply_del(const std::string &key) {
-    auto &s = get_shard(key);
-    std::unique_lock lock(s.mx);
+  // LSN and format of the newest checkpoint, whichever format it has.
+  std::optional<std::pair<uint64_t, CheckpointOptions::Format>>
+  latest_checkpoint() const {
+    using Format = CheckpointOptions::Format;
+    auto snap = snapshot::latest(wal_->dir());
+    auto image = heap::latest(wal_->dir());
+    if (image && (!snap || *image > *snap ||
+                  (*image == *snap && ckpt_opts_.format == Format::HEAP)))
+      return std::pair(*image, Format::HEAP);
+    if (snap)
+      return std::pair(*snap, Format::SNAPSHOT);
+    return std::nullopt;
+  }
 
-    // Tombstone logic: Don't erase. Set to empty.
-    if (!s.map.contains(key)) {
-      s.map[key] = std::make_unique<Blob>(&s.pool);
+  // Loads the newest checkpoint; returns the LSN to replay the WAL from. A
+  // heap image is only mapped: its tree is installed and its entries stay
+  // where they are.
+  uint64_t load_checkpoint(Timestamp &max_ts) {
+    auto latest = latest_checkpoint();
+    if (!latest)
+      return 0;
+    auto [lsn, format] = *latest;
+    if (format == CheckpointOptions::Format::HEAP) {
+      base_ = std::make_unique<heap::Image>(wal_->dir(), lsn);
+      merkle_.load_nodes(base_->tree());
+      max_ts = base_->max_ts();
+      rec_entries_.store(base_->count());
+      if (ordered_) {
+        // Scans must see the keys no shard holds yet
+        for (size_t i = 0; i < base_->count(); ++i)
+          ordered_->insert(base_->entry(i).key);
+      }
+      std::cout << "Checkpoint: Mapped " << base_->count()
+                << " entries at LSN " << lsn << std::endl;
+      ckpt_lsn_.store(lsn);
+      return lsn;
     }
+    // The saved tree arrives before the entries; with it, anti-entropy is
+    // ready without rehashing anything
+    bool in_tree = false;
+    uint64_t n = snapshot::load(
+        wal_->dir(), lsn,
+        [&](const auto &e) { restore(e, in_tree, max_ts); },
+        [&](std::span<const uint64_t> t) { in_tree = merkle_.load_nodes(t); });
+    std::cout << "Checkpoint: Loaded " << n << " entries at LSN " << lsn
+              << (in_tree ? " with Merkle tree" : "") << std::endl;
+    ckpt_lsn_.store(lsn);
+    return lsn;
+  }
 
-    uint64_t old_h = hash_blob(s.map[key]);
-    s.map[key]->overwrite(""); // Set to empty (Tombstone)
-    uint64_t new_h = hash_blob(s.map[key]);
+  void checkpoint_loop() {
+    std::unique_lock lock(ckpt_wait_mx_);
+    while (!ckpt_stop_) {
+      ckpt_cv_.wait_for(lock, std::chrono::milliseconds(ckpt_opts_.poll_ms));
+      if (ckpt_stop_ ||
+          wal_->appended_lsn() - ckpt_lsn_.load() < ckpt_opts_.wal_bytes)
+        continue;
+      lock.unlock();
+      try {
+        checkpoint();
+      } catch (const std::exception &e) {
+        std::cerr << "Checkpoint failed: " << e.what() << "\n";
+      }
+      lock.lock();
+    }
+  }
 
-    lock.unlock();
-    merkle_.apply_delta(key, old_h ^ new_h);
-    return true; // Always "succeeded" in setting tombstone
+  void commit(uint64_t lsn) {
+    if (!wal_->commit(lsn))
+      throw DurabilityError("WAL: write could not be made durable");
   }
 
-public:
-  Engine(std::string wal_path, uint32_t node_id = 1) : clock_(node_id) {
-    wal_ = std::make_unique<WriteAheadLog>(wal_path);
-    for (size_t i = 0; i < SHARDS; ++i)
-      shards_.push_back(std::make_unique<Shard>());
+  // Restores the newest checkpoint, then replays the WAL from its LSN.
+  // Each shard's ops are indexed as they are recovered; once the whole log
+  // is read, only the ops no later write supersedes are replayed, in log
+  // order, one thread per shard at a time. A shard takes requests as soon
+  // as its replay ends.
+  void recover() {
+    Timestamp snap_max{0, 0, 0};
+    uint64_t from = load_checkpoint(snap_max);
+    rec_phase_.store(Phase::LOG);
 
+    std::vector<ReplayIndex> live(SHARDS);
+    std::vector<Timestamp> log_max(SHARDS, NO_TS);    // Over indexed ops
+    std::vector<Timestamp> replay_max(SHARDS, NO_TS); // Legacy ":meta" too
+    std::vector<uint64_t> added(SHARDS), replayed(SHARDS);
     wal_->recover(
-        [this](WalOp op, std::string_view key, std::string_view payload) {
-          try {
-            if (op == WalOp::PUT) {
-              apply_put(std::string(key), std::string(payload));
-            } else if (op == WalOp::PATCH_I64) {
-              std::string p(payload);
-              size_t colon = p.find(':');
-              if (colon != std::string::npos) {
-                std::string field = p.substr(0, colon);
-                int64_t val = std::stoll(p.substr(colon + 1));
-                apply_patch_int(std::string(key), field, val);
-              }
-            } else if (op == WalOp::PATCH_STR) {
-              std::string p(payload);
-              size_t colon = p.find(':');
-              if (colon != std::string::npos) {
-                std::string field = p.substr(0, colon);
-                std::string val = p.substr(colon + 1);
-                apply_patch_str(std::string(key), field, val);
-              }
-            } else if (op == WalOp::DELETE_) {
-              apply_del(std::string(key));
+        SHARDS, replay_shard,
+        [&](size_t shard, const ReplayOp &r) {
+          live[shard].add(r);
+          if (log_max[shard] < r.ts)
+            log_max[shard] = r.ts;
+        },
+        from,
+        [&](size_t) {
+          // The WAL only bounds how many shards replay at once; which one
+          // is next is picked here, so shards with waiting requests go first
+          rec_phase_.store(Phase::REPLAY);
+          size_t shard = next_replay_shard();
+          live[shard].for_each([&](const ReplayOp &r) {
+            try {
+              replay(r.op, r.key, r.payload, r.ts, replay_max[shard]);
+            } catch (const std::exception &e) {
+              std::cerr << "WAL Recovery Skip: " << e.what() << "\n";
             }
-          } catch (const std::exception &e) {
-            std::cerr << "WAL Recovery Skip: " << e.what() << "\n";
+          });
+          added[shard] = live[shard].added();
+          replayed[shard] = live[shard].live();
+          live[shard] = ReplayIndex();
+
+          // New local writes must order after everything already on disk
+          Timestamp max_ts = std::max(replay_max[shard], snap_max);
+          for (const Timestamp &t : log_max)
+            max_ts = std::max(max_ts, t);
+          if (max_ts != NO_TS)
+            clock_.update(max_ts);
+          mark_ready(shard);
+        });
+
+    uint64_t total_added = 0, total_replayed = 0;
+    for (size_t i = 0; i < SHARDS; ++i) {
+      total_added += added[i];
+      total_replayed += replayed[i];
+    }
+    if (total_replayed < total_added)
+      std::cout << "WAL Recovery: Replayed " << total_replayed << " of "
+                << total_added << " ops, the rest were overwritten"
+                << std::endl;
+
+    rec_ms_.store(elapsed_ms());
+    {
+      std::lock_guard lock(rec_mx_);
+      rec_phase_.store(Phase::DONE);
+    }
+    rec_cv_.notify_all();
+    if (ckpt_opts_.wal_bytes > 0)
+      checkpointer_ = std::thread([this] { checkpoint_loop(); });
+    if (vlog_)
+      tierer_ = std::thread([this] { tier_loop(); });
+    if (delta_opts_.enabled)
+      folder_ = std::thread([this] { fold_loop(); });
+  }
+
+  // Shards with waiting requests first, then in index order.
+  size_t next_replay_shard() {
+    std::lock_guard lock(rec_mx_);
+    for (size_t s : rec_wanted_) {
+      if (!rec_taken_[s]) {
+        rec_taken_[s] = 1;
+        return s;
+      }
+    }
+    while (rec_taken_[rec_next_])
+      ++rec_next_;
+    rec_taken_[rec_next_] = 1;
+    return rec_next_;
+  }
+
+  void mark_ready(size_t shard) {
+    {
+      std::lock_guard lock(rec_mx_);
+      shards_[shard]->ready.store(true, std::memory_order_release);
+    }
+    rec_ready_.fetch_add(1, std::memory_order_relaxed);
+    rec_cv_.notify_all();
+  }
+
+  // Blocks until the shard of `key` is recovered, moving it to the front
+  // of the replay order. Every public entry point to the shards calls this
+  // first; replay itself never does. Throws if recovery failed.
+  void await_shard(std::string_view key) {
+    await_shard_at(key_hash(key) % SHARDS);
+  }
+
+  void await_shard_at(size_t i) {
+    Shard &s = *shards_[i];
+    if (s.ready.load(std::memory_order_acquire))
+      return;
+    std::unique_lock lock(rec_mx_);
+    if (!rec_taken_[i] &&
+        std::find(rec_wanted_.begin(), rec_wanted_.end(), i) ==
+            rec_wanted_.end())
+      rec_wanted_.push_back(i);
+    rec_cv_.wait(lock, [&] {
+      return s.ready.load(std::memory_order_acquire) ||
+             rec_phase_.load() == Phase::FAILED;
+    });
+    if (!s.ready.load(std::memory_order_acquire))
+      throw std::runtime_error("Recovery failed: " + rec_error_);
+  }
+
+  uint64_t elapsed_ms() const {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - rec_started_)
+        .count();
+  }
+
+  // The entry's current Blob with a reference taken, or null.
+  BlobPtr pin(std::string_view key, uint64_t h) {
+    auto &s = shard_for(h);
+    {
+      EpochManager::Guard guard;
+      if (auto *slot = s.index.find(key, h)) {
+        if (Blob *b = slot->load(std::memory_order_acquire)) {
+          b->acquire(); // Still referenced by the index within this epoch
+          return BlobPtr(b);
+        }
+      }
+    }
+    if (!base_)
+      return nullptr;
+    std::lock_guard lock(s.mx);
+    auto *slot = materialize(s, key, h);
+    Blob *b = slot ? slot->load(std::memory_order_relaxed) : nullptr;
+    if (b)
+      b->acquire();
+    return BlobPtr(b);
+  }
+
+  // The slot of `key` in its shard, copying the entry in from the heap
+  // image first if the shard does not hold it yet. Null if neither has it.
+  // Caller holds s.mx.
+  std::atomic<Blob *> *materialize(Shard &s, std::string_view key,
+                                   uint64_t h) {
+    auto *slot = s.index.find(key, h);
+    if ((slot && slot->load(std::memory_order_relaxed)) || !base_)
+      return slot;
+    auto i = base_->find(key);
+    if (!i)
+      return slot;
+    auto e = base_->entry(*i);
+    Blob *b = Blob::restore(&s.arena, e.value, {e.ts, e.hash, e.flags},
+                            &s.pages);
+    bool inserted;
+    auto &fresh = s.index.find_or_insert(key, h, &inserted);
+    if (inserted)
+      index_key(key);
+    fresh.store(b, std::memory_order_release);
+    return &fresh;
+  }
+
+  // Reads the value of the cold Blob `stub` back and puts it in place of
+  // `stub`, unless a writer replaced the entry meanwhile. No lock is held
+  // during the read. Returns nullopt if compaction moved the record.
+  std::optional<ValueRef> fault_in(std::string_view key, uint64_t h,
+                                   Blob *stub) {
+    auto &s = shard_for(h);
+    ValueLog::Location loc = stub->location();
+    std::vector<uint8_t> bytes;
+    bool read = vlog_->read(loc, key, bytes);
+    std::lock_guard lock(s.mx);
+    auto *slot = s.index.find(key, h);
+    bool current = slot && slot->load(std::memory_order_relaxed) == stub;
+    if (!read) {
+      if (current)
+        throw std::runtime_error("Value log: cannot read " + std::string(key));
+      return std::nullopt;
+    }
+    Blob *hot = Blob::restore(&s.arena, bytes, stub->meta_, &s.pages);
+    faulted_.fetch_add(1, std::memory_order_relaxed);
+    if (current) {
+      hot->acquire(); // One reference for the index, one for the caller
+      slot->store(hot, std::memory_order_release);
+      vlog_->mark_dead(loc, key.size());
+      retire(stub);
+    }
+    return ValueRef(hot);
+  }
+
+  bool evictable(size_t value_bytes, const EntryMeta &meta) const {
+    return !meta.is_tombstone() && value_bytes >= tier_opts_.min_value_bytes;
+  }
+
+  uint64_t resident_bytes() const { return memory_stats().live_bytes; }
+
+  // CLOCK sweep: moves values not read since the previous sweep to the
+  // value log, shard by shard, until about `excess` bytes are evicted or
+  // every shard was visited once. The value is written outside the shard
+  // lock; an entry rewritten meanwhile is left alone.
+  void evict(uint64_t excess) {
+    uint64_t freed = 0;
+    std::vector<std::pair<std::string, Blob *>> victims;
+    for (size_t n = 0; n < SHARDS && freed < excess; ++n) {
+      Shard &s = *shards_[evict_cursor_++ % SHARDS];
+      {
+        std::lock_guard lock(s.mx);
+        s.index.for_each([&](std::string_view key, std::atomic<Blob *> &v) {
+          Blob *b = v.load(std::memory_order_relaxed);
+          if (!b || b->cold() || b->delta() ||
+              !evictable(b->length(), b->meta_) ||
+              freed >= excess || b->clear_referenced())
+            return;
+          b->acquire();
+          victims.emplace_back(key, b);
+          freed += b->length();
+        });
+      }
+      for (auto &[key, b] : victims) {
+        std::span<const uint8_t> value = b->view();
+        lite3cpp::Buffer gathered;
+        if (b->paged()) {
+          gathered = b->to_buffer();
+          value = {gathered.data(), gathered.size()};
+        }
+        auto loc = vlog_->append(key, value);
+        Blob *stub = Blob::evicted(&s.arena, b->meta_, loc);
+        bool swapped = false;
+        {
+          std::lock_guard lock(s.mx);
+          auto *slot = s.index.find(key, key_hash(key));
+          if (slot && slot->load(std::memory_order_relaxed) == b) {
+            slot->store(stub, std::memory_order_release);
+            swapped = true;
           }
+        }
+        if (swapped) {
+          retire(b);
+          evicted_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          Blob::release(stub);
+          vlog_->mark_dead(loc, key.size());
+        }
+        Blob::release(b);
+      }
+      victims.clear();
+    }
+    if (freed > 0)
+      EpochManager::instance().synchronize(); // Free the evicted values
+  }
+
+  // Moves the live records of one mostly dead value log file to the
+  // active file, then deletes it. Returns false if no file qualifies.
+  bool compact_value_log() {
+    auto file = vlog_->compaction_candidate(tier_opts_.compact_ratio);
+    if (!file)
+      return false;
+    std::lock_guard ckpt(ckpt_mx_); // Checkpoints read pinned cold Blobs
+    vlog_->for_each_record(
+        *file, [&](std::string_view key, std::span<const uint8_t> value,
+                   const ValueLog::Location &at) {
+          uint64_t h = key_hash(key);
+          BlobPtr cur = pin(key, h);
+          if (!cur || !cur->cold() || !(cur->location() == at))
+            return; // Dead record
+          auto &s = shard_for(h);
+          auto loc = vlog_->append(key, value);
+          Blob *moved = Blob::evicted(&s.arena, cur->meta_, loc);
+          {
+            std::lock_guard lock(s.mx);
+            auto *slot = s.index.find(key, h);
+            if (slot && slot->load(std::memory_order_relaxed) == cur.get()) {
+              slot->store(moved, std::memory_order_release);
+              retire(cur.get());
+              return;
+            }
+          }
+          Blob::release(moved);
+          vlog_->mark_dead(loc, key.size());
         });
+    vlog_->drop(*file);
+    compactions_.fetch_add(1, std::memory_order_relaxed);
+    return true;
   }
 
-  lite3cpp::Buffer get(const std::string &key) {
-    auto &s = get_shard(key);
-    std::shared_lock lock(s.mx);
-    if (auto it = s.map.find(key); it != s.map.end()) {
-      return it->second->buf_;
+  // Tiering thread: serves get_async() reads, keeps value memory under the
+  // budget (down to 90% of it once exceeded) and compacts the value log.
+  void tier_loop() {
+    std::unique_lock lock(tier_mx_);
+    for (;;) {
+      tier_cv_.wait_for(lock, std::chrono::milliseconds(tier_opts_.poll_ms),
+                        [&] { return tier_stop_ || !faults_.empty(); });
+      auto faults = std::move(faults_);
+      faults_.clear();
+      bool stop = tier_stop_;
+      lock.unlock();
+      for (auto &[key, promise] : faults) {
+        try {
+          promise.set_value(get(key));
+        } catch (...) {
+          promise.set_exception(std::current_exception());
+        }
+      }
+      if (stop)
+        return;
+      try {
+        uint64_t used = resident_bytes();
+        if (used > tier_opts_.memory_budget)
+          evict(used - tier_opts_.memory_budget / 10 * 9);
+        while (compact_value_log()) {
+        }
+      } catch (const std::exception &e) {
+        std::cerr << "Tiering failed: " << e.what() << "\n";
+      }
+      lock.lock();
     }
-    return lite3cpp::Buffer();
   }
 
-  void put(std::string key, const std::string &json_body) {
-    auto now = clock_.now();
-    std::string meta_key = key + ":meta";
-    std::string meta_val = "{\"ts\":" + std::to_string(now.wall_time) +
-                           ",\"l\":" + std::to_string(now.logical) +
-                           ",\"n\":" + std::to_string(now.node_id) + "}";
+  // Streams every entry to `out` (a snapshot or heap image Writer) and
+  // commits it. Entries of the heap image that no shard holds yet are
+  // copied from it directly. Returns the entry count.
+  template <class Out> uint64_t write_checkpoint(Out &out) {
+    // The tree is built from the entries written, not copied from merkle_:
+    // it must match the fuzzy checkpoint exactly
+    auto tree = std::make_unique<MerkleTree>();
+    // Image entries already written from a shard. One first touched after
+    // its shard was visited is written from the image: that copy is
+    // identical, or was overwritten by a write logged after the LSN.
+    std::vector<bool> covered(base_ ? base_->count() : 0);
+    std::vector<std::pair<std::string, Blob *>> items;
+    std::vector<uint8_t> cold;
+    for (auto &sp : shards_) {
+      // Pin the shard's entries under its lock, serialize them outside it
+      {
+        std::lock_guard slock(sp->mx);
+        sp->index.for_each([&](std::string_view key, std::atomic<Blob *> &v) {
+          if (Blob *b = v.load(std::memory_order_relaxed)) {
+            b->acquire();
+            items.emplace_back(key, b);
+          }
+        });
+      }
+      for (auto &[key, b] : items) {
+        std::span<const uint8_t> value = b->view();
+        uint64_t hash = b->meta_.hash;
+        lite3cpp::Buffer merged;
+        if (b->cold()) {
+          // Compaction waits for ckpt_mx_: the record is still there
+          if (!vlog_->read(b->location(), key, cold))
+            throw std::runtime_error("Checkpoint: cannot read " + key +
+                                     " from the value log");
+          value = cold;
+        } else if (b->delta()) {
+          // Saved folded, with the hash of the merged bytes
+          merged = b->to_buffer();
+          value = {merged.data(), merged.size()};
+          hash = fnv1a_64(value.data(), value.size());
+        } else if (b->paged()) {
+          merged = b->to_buffer();
+          value = {merged.data(), merged.size()};
+        }
+        out.add({key, b->meta_.ts, hash, b->meta_.flags, value});
+        tree->apply_delta(key, hash);
+        if (base_) {
+          if (auto i = base_->find(key))
+            covered[*i] = true;
+        }
+        Blob::release(b);
+      }
+      items.clear();
+    }
+    for (size_t i = 0; i < covered.size(); ++i) {
+      if (covered[i])
+        continue;
+      auto e = base_->entry(i);
+      out.add(e);
+      tree->apply_delta(e.key, e.hash);
+    }
 
-    std::vector<BatchOp> batch;
-    batch.push_back({WalOp::PUT, key, json_body});
-    batch.push_back({WalOp::PUT, meta_key, meta_val});
+    out.set_tree(tree->nodes());
+    // Records below the LSN must be on disk before their segments go
+    wal_->flush();
+    if (!out.commit())
+      throw std::runtime_error(std::is_same_v<Out, heap::Writer>
+                                   ? "Checkpoint: failed to write heap image"
+                                   : "Checkpoint: failed to write snapshot");
+    return out.count();
+  }
 
-    wal_->append_batch(batch);
+  // Rewrites a delta entry as a plain document with its real hash. The
+  // merge runs outside the shard lock; a patch that lands meanwhile wins
+  // and the entry is looked at again later.
+  void fold(const std::string &key) {
+    uint64_t h = key_hash(key);
+    BlobPtr cur = pin(key, h);
+    if (!cur || !cur->delta())
+      return;
+    auto &s = shard_for(h);
+    // Pages the patches did not touch are shared with the base
+    BlobPtr next(
+        Blob::create(&s.arena, cur->to_buffer(), &s.pages, cur.get()));
+    next->meta_.ts = cur->meta_.ts;
+    Swap sw;
+    {
+      std::lock_guard lock(s.mx);
+      auto *slot = s.index.find(key, h);
+      if (slot && slot->load(std::memory_order_relaxed) == cur.get()) {
+        sw = {true, cur.get(), next->meta_.hash};
+        slot->store(next.release(), std::memory_order_release);
+      }
+    }
+    if (finish_write(key, sw)) {
+      folded_.fetch_add(1, std::memory_order_relaxed);
+    } else if (BlobPtr now = pin(key, h); now && now->delta()) {
+      schedule_fold(key, false);
+    }
+  }
 
-    apply_put(key, json_body);
-    apply_put(meta_key, meta_val);
+  // get_meta() as stored: a delta entry has its base's hash (`delta` is set).
+  std::optional<EntryMeta> entry_meta(std::string_view key,
+                                      bool *delta = nullptr) {
+    await_shard(key);
+    uint64_t h = key_hash(key);
+    auto &s = shard_for(h);
+    {
+      EpochManager::Guard guard;
+      if (auto *slot = s.index.find(key, h)) {
+        if (Blob *b = slot->load(std::memory_order_acquire)) {
+          if (delta)
+            *delta = b->delta();
+          return b->meta_;
+        }
+      }
+    }
+    // Read in place: no need to copy the value in
+    if (auto i = base_ ? base_->find(key) : std::nullopt) {
+      auto e = base_->entry(*i);
+      return EntryMeta{e.ts, e.hash, e.flags};
+    }
+    return std::nullopt;
   }
 
-  void patch_int(std::string key, std::string field, int64_t val) {
-    auto now = clock_.now();
-    std::string meta_key = key + ":meta";
-    std::string ts_str = std::to_string(now.wall_time) + ":" +
-                         std::to_string(now.logical) + ":" +
-                         std::to_string(now.node_id);
+  // Folds every entry with deltas queued, whatever their delay.
+  void fold_pending() {
+    std::vector<std::string> due;
+    {
+      std::lock_guard lock(fold_mx_);
+      for (auto &key : fold_now_)
+        due.push_back(std::move(key));
+      for (auto &[when, key] : fold_later_)
+        due.push_back(std::move(key));
+      fold_now_.clear();
+      fold_later_.clear();
+    }
+    for (auto &key : due) {
+      try {
+        fold(key);
+      } catch (const std::exception &e) {
+        std::cerr << "Patch fold failed for " << key << ": " << e.what()
+                  << "\n";
+      }
+    }
+  }
+
+  // Folding thread: entries past fold_bytes at once, the others when their
+  // delay is up.
+  void fold_loop() {
+    std::unique_lock lock(fold_mx_);
+    while (!fold_stop_) {
+      auto now = std::chrono::steady_clock::now();
+      std::vector<std::string> due(std::make_move_iterator(fold_now_.begin()),
+                                   std::make_move_iterator(fold_now_.end()));
+      fold_now_.clear();
+      while (!fold_later_.empty() && fold_later_.front().first <= now) {
+        due.push_back(std::move(fold_later_.front().second));
+        fold_later_.pop_front();
+      }
+      if (due.empty()) {
+        if (fold_later_.empty())
+          fold_cv_.wait(lock);
+        else
+          fold_cv_.wait_until(lock, fold_later_.front().first);
+        continue;
+      }
+      lock.unlock();
+      for (auto &key : due) {
+        try {
+          fold(key);
+        } catch (const std::exception &e) {
+          std::cerr << "Patch fold failed for " << key << ": " << e.what()
+                    << "\n";
+        }
+      }
+      lock.lock();
+    }
+  }
 
-    std::string log_payload_int = field + ":" + std::to_string(val);
-    std::string log_payload_str = field + ":" + ts_str;
+public:
+  // Restores the newest checkpoint in the WAL directory, then replays the
+  // WAL from its LSN: before returning, or in the background if
+  // `rec_opts.background` is set (see RecoveryOptions).
+  Engine(std::string wal_path, uint32_t node_id = 1, WalOptions wal_opts = {},
+         CheckpointOptions ckpt_opts = {}, RecoveryOptions rec_opts = {},
+         TieringOptions tier_opts = {}, DeltaOptions delta_opts = {},
+         PagingOptions paging_opts = {},
+         OrderedIndexOptions index_opts = {})
+      : clock_(node_id), ckpt_opts_(ckpt_opts),
+        rec_started_(std::chrono::steady_clock::now()), rec_taken_(SHARDS, 0),
+        tier_opts_(std::move(tier_opts)), delta_opts_(delta_opts),
+        paging_opts_(paging_opts) {
+    wal_ = std::make_unique<WriteAheadLog>(wal_path, wal_opts);
+    if (index_opts.enabled)
+      ordered_ = std::make_unique<OrderedIndex>();
+    for (size_t i = 0; i < SHARDS; ++i)
+      shards_.push_back(
+          std::make_unique<Shard>(paging_opts_.min_value_bytes));
+    if (tier_opts_.memory_budget > 0) {
+      std::string dir = tier_opts_.dir.empty()
+                            ? (std::filesystem::path(wal_->dir()) / "vlog")
+                                  .string()
+                            : tier_opts_.dir;
+      vlog_ = std::make_unique<ValueLog>(dir, tier_opts_.file_bytes);
+    }
 
-    std::vector<BatchOp> batch;
-    batch.push_back({WalOp::PATCH_I64, key, log_payload_int});
-    batch.push_back({WalOp::PATCH_STR, meta_key, log_payload_str});
+    if (!rec_opts.background) {
+      recover();
+      return;
+    }
+    recovery_ = std::thread([this] {
+      try {
+        recover();
+      } catch (const std::exception &e) {
+        std::cerr << "Recovery failed: " << e.what() << "\n";
+        {
+          std::lock_guard lock(rec_mx_);
+          rec_error_ = e.what();
+          rec_phase_.store(Phase::FAILED);
+        }
+        rec_cv_.notify_all();
+      }
+    });
+  }
+
+  // Waits for a background recovery to end first. With heap images, writes
+  // a final one.
+  ~Engine() {
+    if (recovery_.joinable())
+      recovery_.join();
+    if (checkpointer_.joinable()) {
+      {
+        std::lock_guard lock(ckpt_wait_mx_);
+        ckpt_stop_ = true;
+      }
+      ckpt_cv_.notify_all();
+      checkpointer_.join();
+    }
+    if (tierer_.joinable()) {
+      {
+        std::lock_guard lock(tier_mx_);
+        tier_stop_ = true;
+      }
+      tier_cv_.notify_all();
+      tierer_.join();
+    }
+    if (folder_.joinable()) {
+      {
+        std::lock_guard lock(fold_mx_);
+        fold_stop_ = true;
+      }
+      fold_cv_.notify_all();
+      folder_.join();
+    }
+    if (ckpt_opts_.format == CheckpointOptions::Format::HEAP && recovered()) {
+      try {
+        checkpoint(); // The next start maps it and replays nothing
+      } catch (const std::exception &e) {
+        std::cerr << "Checkpoint failed: " << e.what() << "\n";
+      }
+    }
+    // Retired Blobs point into the shard arenas: free them before the shards
+    EpochManager::instance().synchronize();
+  }
 
-    wal_->append_batch(batch);
+  // Returns a shared handle to the stored bytes (empty for missing keys and
+  // tombstones). The lookup itself is lock-free; the handle pins the value,
+  // pages included for a paged one (see ValueRef).
+  ValueRef get(std::string_view key) {
+    await_shard(key);
+    uint64_t h = key_hash(key);
+    for (;;) {
+      BlobPtr b = pin(key, h);
+      if (!b || b->meta_.is_tombstone())
+        return ValueRef();
+      if (b->delta()) {
+        // Contiguous copy for this reader, deltas merged (the entry keeps
+        // them until folded; see DeltaOptions for the bound)
+        b->touch();
+        auto buf = b->to_buffer();
+        return ValueRef(Blob::restore(
+            &shard_for(h).arena, {buf.data(), buf.size()}, b->meta_));
+      }
+      if (!b->cold()) {
+        b->touch();
+        return ValueRef(b.release());
+      }
+      if (auto v = fault_in(key, h, b.get()))
+        return std::move(*v);
+      // Moved by value log compaction meanwhile: look again
+    }
+  }
 
-    apply_patch_int(key, field, val);
-    apply_patch_str(meta_key, field, ts_str);
+  // Like get(), but an evicted value is read back on the tiering thread;
+  // for anything in memory the future is ready at once.
+  std::future<ValueRef> get_async(std::string_view key) {
+    uint64_t h = key_hash(key);
+    if (vlog_ && shard_for(h).ready.load(std::memory_order_acquire)) {
+      BlobPtr b = pin(key, h);
+      if (b && b->cold() && !b->meta_.is_tombstone()) {
+        std::promise<ValueRef> p;
+        auto f = p.get_future();
+        {
+          std::lock_guard lock(tier_mx_);
+          faults_.emplace_back(std::string(key), std::move(p));
+        }
+        tier_cv_.notify_one();
+        return f;
+      }
+    }
+    std::promise<ValueRef> p;
+    p.set_value(get(key));
+    return p.get_future();
   }
 
-  void patch_str(std::string key, std::string field, std::string val) {
-    auto now = clock_.now();
-    std::string meta_key = key + ":meta";
-    std::string ts_str = std::to_string(now.wall_time) + ":" +
-                         std::to_string(now.logical) + ":" +
-                         std::to_string(now.node_id);
+  // get() for many keys: result i is the value of keys[i]. Keys are grouped
+  // by shard, and each shard is awaited and entered (one epoch guard) once,
+  // with the table slots of the next keys prefetched while one is probed.
+  // Values that need more than a lookup (evicted, delta, or only in the
+  // heap image) are then read with get().
+  std::vector<ValueRef> multi_get(std::span<const std::string_view> keys) {
+    constexpr uint32_t PREFETCH_AHEAD = 8;
+    std::vector<uint64_t> hashes(keys.size());
+    std::vector<uint32_t> start(SHARDS + 1, 0), order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      hashes[i] = key_hash(keys[i]);
+      ++start[hashes[i] % SHARDS + 1];
+    }
+    for (size_t sh = 0; sh < SHARDS; ++sh)
+      start[sh + 1] += start[sh];
+    {
+      std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+      for (size_t i = 0; i < keys.size(); ++i)
+        order[fill[hashes[i] % SHARDS]++] = (uint32_t)i;
+    }
+
+    std::vector<ValueRef> out(keys.size());
+    std::vector<uint32_t> slow;
+    for (size_t sh = 0; sh < SHARDS; ++sh) {
+      uint32_t first = start[sh], last = start[sh + 1];
+      if (first == last)
+        continue;
+      await_shard_at(sh);
+      Shard &s = *shards_[sh];
+      EpochManager::Guard guard;
+      for (uint32_t j = first; j < std::min(last, first + PREFETCH_AHEAD); ++j)
+        s.index.prefetch(hashes[order[j]]);
+      for (uint32_t j = first; j < last; ++j) {
+        if (j + PREFETCH_AHEAD < last)
+          s.index.prefetch(hashes[order[j + PREFETCH_AHEAD]]);
+        uint32_t i = order[j];
+        auto *slot = s.index.find(keys[i], hashes[i]);
+        Blob *b = slot ? slot->load(std::memory_order_acquire) : nullptr;
+        if (!b) {
+          if (base_)
+            slow.push_back(i);
+        } else if (b->cold() || b->delta()) {
+          slow.push_back(i);
+        } else if (!b->meta_.is_tombstone()) {
+          b->acquire(); // Still referenced by the index within this epoch
+          b->touch();
+          out[i] = ValueRef(b);
+        }
+      }
+    }
+    for (uint32_t i : slow)
+      out[i] = get(keys[i]);
+    return out;
+  }
 
-    std::string log_payload_str = field + ":" + val;
-    std::string log_payload_meta = field + ":" + ts_str;
+  // Copies up to out.size() value bytes from `offset` into `out`. Returns
+  // how many there were, or nullopt for a missing key or a tombstone. A
+  // paged value is read in place, from the pages in the range only.
+  std::optional<size_t> read(std::string_view key, size_t offset,
+                             std::span<uint8_t> out) {
+    await_shard(key);
+    uint64_t h = key_hash(key);
+    BlobPtr b = pin(key, h);
+    if (!b || b->meta_.is_tombstone())
+      return std::nullopt;
+    if (!b->cold() && !b->delta()) {
+      b->touch();
+      return b->read(offset, out);
+    }
+    return get(key).read(offset, out);
+  }
 
-    std::vector<BatchOp> batch;
-    batch.push_back({WalOp::PATCH_STR, key, log_payload_str});
-    batch.push_back({WalOp::PATCH_STR, meta_key, log_payload_meta});
+  // Up to `limit` entries of `range` in key order, after `cursor` (the
+  // previous page's ScanPage::cursor). Tombstones are skipped; without
+  // `values`, only keys are returned. Needs OrderedIndexOptions::enabled.
+  // No lock is held across the walk: each entry is read like get(), so a
+  // page sees the writes applied while it was read.
+  ScanPage scan(const KeyRange &range, size_t limit,
+                std::string_view cursor = {}, bool values = true) {
+    if (!ordered_)
+      throw std::logic_error("scan: the ordered index is off");
+    wait_recovered();
+    ScanPage page;
+    if (limit == 0)
+      return page;
+    std::string from = range.begin;
+    if (!cursor.empty())
+      from = std::max(from, std::string(cursor) + '\0'); // Just after it
+    ordered_->for_each_from(from, [&](std::string_view key) {
+      if (!range.contains(key))
+        return false;
+      if (page.entries.size() == limit) {
+        page.cursor = page.entries.back().first; // More to come
+        return false;
+      }
+      auto meta = entry_meta(key);
+      if (!meta || meta->is_tombstone())
+        return true;
+      page.entries.emplace_back(key, values ? get(key) : ValueRef());
+      return true;
+    });
+    return page;
+  }
 
-    wal_->append_batch(batch);
+  bool ordered_index() const { return ordered_ != nullptr; }
 
-    apply_patch_str(key, field, val);
-    apply_patch_str(meta_key, field, ts_str);
+  // Header of the current entry (tombstones included), or nullopt if the
+  // key was never written. The hash is the value's content hash: an entry
+  // with pending patch deltas is folded first (see DeltaOptions).
+  std::optional<EntryMeta> get_meta(std::string_view key) {
+    bool delta = false;
+    auto meta = entry_meta(key, &delta);
+    if (!delta)
+      return meta;
+    uint64_t h = key_hash(key);
+    fold(std::string(key));
+    BlobPtr b = pin(key, h);
+    if (!b || !b->delta())
+      return b ? std::optional(b->meta_) : std::nullopt;
+    // Patched again meanwhile: hash the merged bytes
+    EntryMeta merged = b->meta_;
+    auto buf = b->to_buffer();
+    merged.hash = fnv1a_64(buf.data(), buf.size());
+    return merged;
   }
 
-  bool del(const std::string &key) {
+  // Local writes return once durable per the WAL's durability mode; the
+  // change is visible to readers as soon as it is applied. Throws
+  // DurabilityError if the WAL could not sync it, or (nothing applied) if
+  // it refuses writes while retrying a failed log write.
+  //
+  // Each write logs and applies inside one epoch, so a checkpoint can wait
+  // for every write logged before its LSN to be applied (checkpoint()).
+  void put(std::string key, const std::string &json_body) {
+    await_shard(key);
     auto now = clock_.now();
-    std::string meta_key = key + ":meta";
-    std::string meta_val = "{\"ts\":" + std::to_string(now.wall_time) +
-                           ",\"l\":" + std::to_string(now.logical) +
-                           ",\"n\":" + std::to_string(now.node_id) +
-                           ",\"tombstone\":true}";
+    uint64_t lsn;
+    {
+      EpochManager::Guard guard;
+      lsn = wal_->append(WalOp::PUT, key, json_body, now);
+      apply_put(key, json_body, now);
+    }
+    commit(lsn);
+  }
 
-    std::vector<BatchOp> batch;
-    batch.push_back({WalOp::DELETE_, key, ""});
-    batch.push_back({WalOp::PUT, meta_key, meta_val});
+  void patch_int(std::string key, std::string field, int64_t val) {
+    await_shard(key);
+    auto now = clock_.now();
+    uint64_t lsn;
+    {
+      EpochManager::Guard guard;
+      lsn = wal_->append(WalOp::PATCH_I64_BIN, key,
+                         patch_format::encode_i64(field, val), now);
+      apply_patch_int(key, field, val, now);
+    }
+    commit(lsn);
+  }
 
-    wal_->append_batch(batch);
+  void patch_str(std::string key, std::string field, std::string val) {
+    await_shard(key);
+    auto now = clock_.now();
+    uint64_t lsn;
+    {
+      EpochManager::Guard guard;
+      lsn = wal_->append(WalOp::PATCH_STR_BIN, key,
+                         patch_format::encode_str(field, val), now);
+      apply_patch_str(key, field, val, now);
+    }
+    commit(lsn);
+  }
 
-    bool existed = apply_del(key);
-    apply_put(meta_key, meta_val);
+  bool del(const std::string &key) {
+    await_shard(key);
+    auto now = clock_.now();
+    uint64_t lsn;
+    bool existed;
+    {
+      EpochManager::Guard guard;
+      lsn = wal_->append(WalOp::DELETE_, key, "", now);
+      existed = apply_del(key, now);
+    }
+    commit(lsn);
     return existed;
   }
 
-  // ... apply_mutation remains mostly same but uses modified apply_del ...
+  // Applies `ops` as one WAL record: a bulk load pays one log append (and,
+  // in sync mode, one commit wait) instead of one per write. Ops are
+  // grouped by shard and each touched shard is locked once; ops on the same
+  // key apply in order. The batch is atomic in the log - after a crash it
+  // is replayed whole or not at all - but readers may see it half applied.
+  // A patch of a value that is not a document, or of a cold value that
+  // cannot be read back, throws before anything is logged or applied.
+  // DurabilityError as put().
+  void write_batch(std::span<const WriteOp> ops) {
+    if (ops.empty())
+      return;
+    std::vector<uint64_t> hashes(ops.size());
+    std::vector<uint32_t> start(SHARDS + 1, 0), order(ops.size());
+    for (size_t i = 0; i < ops.size(); ++i) {
+      hashes[i] = key_hash(ops[i].key);
+      ++start[hashes[i] % SHARDS + 1];
+    }
+    for (size_t sh = 0; sh < SHARDS; ++sh)
+      start[sh + 1] += start[sh];
+    {
+      std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+      for (size_t i = 0; i < ops.size(); ++i)
+        order[fill[hashes[i] % SHARDS]++] = (uint32_t)i;
+    }
+    for (size_t sh = 0; sh < SHARDS; ++sh)
+      if (start[sh] != start[sh + 1])
+        await_shard_at(sh);
+
+    // Log record (in shard order) and new values, built outside the locks.
+    // Timestamps follow the input order.
+    std::vector<Timestamp> ts(ops.size());
+    for (auto &t : ts)
+      t = clock_.now();
+    std::vector<BatchOp> log(ops.size());
+    std::vector<BlobPtr> next(ops.size());
+    for (size_t j = 0; j < order.size(); ++j) {
+      uint32_t i = order[j];
+      const WriteOp &w = ops[i];
+      Shard &s = shard_for(hashes[i]);
+      BatchOp &b = log[j];
+      b.key = w.key;
+      b.ts = ts[i];
+      switch (w.type) {
+      case WriteOp::Type::PUT:
+        b.op = WalOp::PUT;
+        b.value = w.value;
+        next[j].reset(Blob::encode(&s.arena, w.value, &s.pages));
+        break;
+      case WriteOp::Type::PATCH_INT:
+        b.op = WalOp::PATCH_I64_BIN;
+        b.value = patch_format::encode_i64(w.field, w.num);
+        break;
+      case WriteOp::Type::PATCH_STR:
+        b.op = WalOp::PATCH_STR_BIN;
+        b.value = patch_format::encode_str(w.field, w.value);
+        break;
+      case WriteOp::Type::DEL:
+        b.op = WalOp::DELETE_;
+        next[j] = tombstone(s);
+        break;
+      }
+    }
+
+    // What each patch applies to, checked before anything is logged: the
+    // first op on a key patches the stored value (a cold one is read back
+    // here, outside the locks), later ones what the batch wrote before them.
+    std::vector<BlobPtr> stored(ops.size());
+    std::vector<std::vector<uint8_t>> cold(ops.size());
+    {
+      std::unordered_map<std::string_view, bool> doc; // Latest is a document
+      for (size_t j = 0; j < order.size(); ++j) {
+        uint32_t i = order[j];
+        const WriteOp &w = ops[i];
+        if (w.type == WriteOp::Type::PUT || w.type == WriteOp::Type::DEL) {
+          doc[w.key] = w.type == WriteOp::Type::DEL ||
+                       next[j]->meta_.is_document();
+          continue;
+        }
+        auto [it, first] = doc.try_emplace(w.key, true);
+        if (first) {
+          stored[j] = pin(w.key, hashes[i]);
+          const Blob *b = stored[j].get();
+          if (b && !b->meta_.is_tombstone()) {
+            it->second = b->meta_.is_document();
+            if (it->second && b->cold() &&
+                !vlog_->read(b->location(), w.key, cold[j]))
+              throw std::runtime_error("Value log: cannot read " + w.key);
+          }
+        }
+        if (!it->second)
+          throw std::runtime_error("Patch: " + w.key + " is not a document");
+      }
+    }
+
+    uint64_t lsn;
+    {
+      EpochManager::Guard guard; // See put()
+      lsn = wal_->append_batch(log);
+      std::vector<Swap> swaps(ops.size());
+      auto finish = [&] {
+        for (size_t j = 0; j < order.size(); ++j)
+          finish_write(ops[order[j]].key, swaps[j]);
+      };
+      try {
+        for (size_t sh = 0; sh < SHARDS; ++sh) {
+          if (start[sh] == start[sh + 1])
+            continue;
+          Shard &s = *shards_[sh];
+          std::lock_guard lock(s.mx);
+          for (uint32_t j = start[sh]; j < start[sh + 1]; ++j) {
+            const WriteOp &w = ops[order[j]];
+            auto make = [&](Shard &s, Blob *cur) {
+              const auto *bytes =
+                  cur && cur->cold() && cur == stored[j].get() ? &cold[j]
+                                                                : nullptr;
+              switch (w.type) {
+              case WriteOp::Type::PATCH_INT:
+                return patched_i64(s, w.key, cur, w.field, w.num,
+                                   log[j].value, bytes);
+              case WriteOp::Type::PATCH_STR:
+                return patched_str(s, w.key, cur, w.field, w.value,
+                                   log[j].value, bytes);
+              default:
+                return std::move(next[j]);
+              }
+            };
+            swaps[j] = publish_locked(s, w.key, hashes[order[j]],
+                                      ts[order[j]], false, make);
+          }
+        }
+      } catch (...) {
+        // The record is logged: the writes already swapped in still retire
+        // what they replaced and reach the Merkle tree
+        finish();
+        throw;
+      }
+      finish();
+    }
+    commit(lsn);
+  }
 
   inline void apply_mutation(const Mutation &m) {
-    // ... (TS checks same as before) ...
-    // 1. Get Local TS (Inlined)
-    std::string meta_key_lookup = m.key + ":meta";
-    auto buf = get(meta_key_lookup);
-    Timestamp local_ts{0, 0, 0};
-    if (buf.size() > 0) {
-      auto type = buf.get_type(0, "ts");
-      if (type == lite3cpp::Type::Int64 || type == lite3cpp::Type::Float64) {
-        int64_t w = buf.get_i64(0, "ts");
-        uint32_t l = (uint32_t)buf.get_i64(0, "l");
-        uint32_t n = (uint32_t)buf.get_i64(0, "n");
-        local_ts = {w, l, n};
-      }
-    }
-
-    if (m.timestamp <= local_ts) {
+    // Cheap pre-check so stale repairs never reach the WAL. The authoritative
+    // check is repeated under the shard lock in publish().
+    auto local = entry_meta(m.key); // Only the timestamp is needed
+    if (local && m.timestamp <= local->ts) {
       std::cerr << "[Store] Rejecting mutation for " << m.key
                 << " (Stale). Inc: " << m.timestamp.wall_time
-                << " Local: " << local_ts.wall_time << "\n";
+                << " Local: " << local->ts.wall_time << "\n";
       return;
     }
-    // std::cerr << "[Store] Applying mutation for " << m.key << "\n";
-
-    std::string meta_key = m.key + ":meta";
-    std::string meta_val = "{\"ts\":" + std::to_string(m.timestamp.wall_time) +
-                           ",\"l\":" + std::to_string(m.timestamp.logical) +
-                           ",\"n\":" + std::to_string(m.timestamp.node_id) +
-                           (m.is_delete ? ",\"tombstone\":true" : "") + "}";
+    clock_.update(m.timestamp);
 
-    std::vector<BatchOp> wal_batch;
+    std::string val_str(m.value.begin(), m.value.end());
+    EpochManager::Guard guard; // See put()
     if (m.is_delete) {
-      wal_batch.push_back({WalOp::DELETE_, m.key, ""});
+      wal_->append(WalOp::DELETE_, m.key, "", m.timestamp);
+      apply_del(m.key, m.timestamp, true);
     } else {
-      std::string val_str(m.value.begin(), m.value.end());
-      wal_batch.push_back({WalOp::PUT, m.key, val_str});
+      wal_->append(WalOp::PUT, m.key, val_str, m.timestamp);
+      apply_put(m.key, val_str, m.timestamp, true);
     }
-    wal_batch.push_back({WalOp::PUT, meta_key, meta_val});
+  }
 
-    wal_->append_batch(wal_batch);
+  void flush() { wal_->flush(); }
+  auto get_wal_stats() { return wal_->stats(); }
 
-    if (m.is_delete) {
-      apply_del(m.key);
+  // Writes a checkpoint (a snapshot or a heap image, per
+  // CheckpointOptions::format) of every shard, then deletes the WAL
+  // segments it covers. Returns the checkpoint LSN. Writes continue
+  // meanwhile: the checkpoint may also hold some writes logged after the
+  // LSN, which replay applies again with the same result (LWW keeps the
+  // newer timestamp).
+  uint64_t checkpoint() {
+    wait_recovered();
+    std::lock_guard lock(ckpt_mx_);
+    uint64_t lsn = wal_->appended_lsn();
+    if (lsn == ckpt_lsn_.load() &&
+        latest_checkpoint() == std::pair(lsn, ckpt_opts_.format))
+      return lsn; // Nothing logged since the last one
+    // A write logged below `lsn` entered its epoch before this point; once
+    // every such epoch has ended, its effect is in the shards.
+    EpochManager::instance().synchronize();
+
+    uint64_t count;
+    if (ckpt_opts_.format == CheckpointOptions::Format::HEAP) {
+      heap::Writer out(wal_->dir(), lsn);
+      count = write_checkpoint(out);
     } else {
-      std::string val_str(m.value.begin(), m.value.end());
-      apply_put(m.key, val_str);
+      snapshot::Writer out(wal_->dir(), lsn, MerkleTree::NODE_COUNT);
+      count = write_checkpoint(out);
     }
-    apply_put(meta_key, meta_val);
+    ckpt_lsn_.store(lsn);
+    size_t removed = wal_->remove_segments_before(lsn);
+    snapshot::remove_older(wal_->dir(), lsn);
+    heap::remove_older(wal_->dir(), lsn);
+    std::cout << "Checkpoint: " << count << " entries at LSN " << lsn
+              << ", " << removed << " WAL segment(s) removed" << std::endl;
+    return lsn;
   }
 
-  void flush() { wal_->flush(); }
-  auto get_wal_stats() { return wal_->stats(); }
-  uint64_t get_merkle_root_hash() { return merkle_.get_root_hash(); }
+  uint64_t checkpoint_lsn() const { return ckpt_lsn_.load(); }
+
+  // True once every shard is recovered. Anti-entropy must not compare the
+  // Merkle tree before then.
+  bool recovered() const { return rec_phase_.load() == Phase::DONE; }
+
+  // Blocks until recovery has ended; throws if it failed.
+  void wait_recovered() {
+    std::unique_lock lock(rec_mx_);
+    rec_cv_.wait(lock, [&] {
+      return rec_phase_.load() == Phase::DONE ||
+             rec_phase_.load() == Phase::FAILED;
+    });
+    if (rec_phase_.load() == Phase::FAILED)
+      throw std::runtime_error("Recovery failed: " + rec_error_);
+  }
+
+  RecoveryProgress recovery_progress() {
+    RecoveryProgress p;
+    p.phase = rec_phase_.load();
+    p.shards_ready = rec_ready_.load(std::memory_order_relaxed);
+    p.shards = SHARDS;
+    p.snapshot_entries = rec_entries_.load(std::memory_order_relaxed);
+    p.elapsed_ms = p.phase == Phase::DONE ? rec_ms_.load() : elapsed_ms();
+    if (p.phase == Phase::FAILED) {
+      std::lock_guard lock(rec_mx_);
+      p.error = rec_error_;
+    }
+    return p;
+  }
+  size_t wal_segment_count() const { return wal_->segment_count(); }
+
+  // Value memory of one shard, or of all shards when `shard` is negative.
+  ShardArena::Stats memory_stats(int shard = -1) const {
+    if (shard >= 0)
+      return shards_[shard % SHARDS]->arena.stats();
+    ShardArena::Stats total;
+    for (auto &s : shards_)
+      total += s->arena.stats();
+    return total;
+  }
+  static constexpr size_t shard_count() { return SHARDS; }
+
+  TierStats tier_stats() const {
+    TierStats t;
+    t.resident_bytes = resident_bytes();
+    t.evicted = evicted_.load(std::memory_order_relaxed);
+    t.faulted = faulted_.load(std::memory_order_relaxed);
+    t.compactions = compactions_.load(std::memory_order_relaxed);
+    if (vlog_)
+      t.log = vlog_->stats();
+    return t;
+  }
+  DeltaStats delta_stats() const {
+    return {buffered_.load(std::memory_order_relaxed),
+            folded_.load(std::memory_order_relaxed)};
+  }
+  // Pages held by paged values, in all shards (PagePool::PAGE_SIZE each).
+  uint64_t live_pages() const {
+    uint64_t n = 0;
+    for (auto &s : shards_)
+      n += s->pages.live_pages();
+    return n;
+  }
+
+  // Pending patch deltas are folded first: the tree then holds the content
+  // hash of every value, as a peer holding the same values has.
+  uint64_t get_merkle_root_hash() {
+    fold_pending();
+    return merkle_.get_root_hash();
+  }
   uint64_t get_merkle_node(int level, int index) {
     return merkle_.get_node_hash(level, index);
   }
 
+  // Keys of one Merkle leaf bucket with their cached value hashes.
+  // Tombstones are included: sync relies on the hash mismatch.
   std::vector<std::pair<std::string, uint64_t>>
   get_bucket_keys(int bucket_idx) {
     std::vector<std::pair<std::string, uint64_t>> result;
-    for (auto &shard : shards_) {
-      std::shared_lock lock(shard->mx);
-      for (auto &[k, v] : shard->map) {
-        uint64_t kh = fnv1a_64(k);
-        uint32_t b = (kh >> 48) & 0xFFFF;
-        if (b == (uint32_t)bucket_idx) {
-          if (v->view().size() > 0) // Only send non-tombstones? No, we MUST
-                                    // send tombstones for sync!
-            result.push_back({k, hash_blob(v)});
-          else {
-            // It's a tombstone. Existing sync logic relies on hash mismatch.
-            // If we send hash of empty blob, and they have value, hashes
-            // differ. So we include it.
-            result.push_back({k, hash_blob(v)});
-          }
-        }
-      }
+    auto keys = buckets_.keys((uint32_t)bucket_idx);
+    if (base_) {
+      // Plus the heap image keys no shard holds yet
+      auto [first, last] = base_->bucket((uint32_t)bucket_idx);
+      for (size_t i = first; i < last; ++i)
+        keys.emplace_back(base_->entry(i).key);
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    for (auto &key : keys) {
+      if (auto meta = get_meta(key))
+        result.push_back({std::move(key), meta->hash});
     }
     return result;
   }
@@ -7,6 +7,8 @@
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
 #include <string_view>
 #include <thread>
@@ -33,6 +35,18 @@ class SyncManager {
     SYNC_PUT_VAL = 0x07
   };
 
+  // Sync protocol version, appended to SYNC_INIT and SYNC_REQ_BUCKET (older
+  // peers ignore trailing bytes there; their messages carry none, which
+  // reads as version 1).
+  //   1: SYNC_PUT_VAL meta is the Lite3 "<key>:meta" document
+  //   2: ... or the binary WIRE_META_SIZE block
+  // Replies use a peer's binary format only once it has advertised it, so
+  // mixed-version clusters keep syncing through a rolling upgrade.
+  static constexpr uint8_t PROTOCOL_VERSION = 2;
+
+  std::mutex versions_mx_;
+  std::map<NodeID, uint8_t> peer_versions_; // Last advertised
+
 public:
   SyncManager(IMesh &mesh, Engine &engine, uint32_t node_id)
       : mesh_(mesh), engine_(engine), node_id_(node_id) {}
@@ -51,6 +65,8 @@ public:
   }
 
   void trigger_gossip() {
+    if (!engine_.recovered())
+      return; // The Merkle tree is still incomplete
     std::random_device rd;
     std::mt19937 rng(rd());
     // Pick random peer
@@ -66,8 +82,8 @@ public:
   // Handle incoming Control messages
   void handle_message(NodeID /*ignored_from*/,
                       const std::vector<uint8_t> &payload) {
-    if (payload.size() < 5)
-      return;
+    if (payload.size() < 5 || !engine_.recovered())
+      return; // Peers retry on their next round
     MsgType type = (MsgType)payload[0];
     NodeID sender_id;
     std::memcpy(&sender_id, &payload[1], 4);
@@ -118,9 +134,10 @@ private:
     uint64_t root = engine_.get_merkle_root_hash();
     std::vector<uint8_t> pay;
     pay.push_back(SYNC_INIT);
-    pay.resize(1 + 4 + 8);
+    pay.resize(1 + 4 + 8 + 1);
     std::memcpy(&pay[1], &node_id_, 4);
     std::memcpy(&pay[5], &root, 8);
+    pay[13] = PROTOCOL_VERSION;
     mesh_.send(target, Lane::Control, pay);
 
 #ifndef LITE3CPP_DISABLE_OBSERVABILITY
@@ -141,6 +158,7 @@ private:
   void on_sync_init(NodeID from, const std::vector<uint8_t> &buf) {
     if (buf.size() < 13)
       return;
+    note_version(from, buf, 13);
     uint64_t their_root;
     std::memcpy(&their_root, &buf[5], 8);
 
@@ -264,15 +282,17 @@ private:
   void send_req_bucket(NodeID to, uint32_t bucket_idx) {
     std::vector<uint8_t> pay;
     pay.push_back(SYNC_REQ_BUCKET);
-    pay.resize(1 + 4 + 4);
+    pay.resize(1 + 4 + 4 + 1);
     std::memcpy(&pay[1], &node_id_, 4);
     std::memcpy(&pay[5], &bucket_idx, 4);
+    pay[9] = PROTOCOL_VERSION;
     mesh_.send(to, Lane::Control, pay);
   }
 
   void on_req_bucket(NodeID from, const std::vector<uint8_t> &buf) {
     if (buf.size() < 9)
       return;
+    note_version(from, buf, 9);
     uint32_t bucket_idx;
     std::memcpy(&bucket_idx, &buf[5], 4);
 
@@ -294,10 +314,6 @@ private:
     std::memcpy(&pay[old], &count, 4);
 
     for (auto &pair : keys) {
-      if (pair.first.size() >= 5 &&
-          pair.first.compare(pair.first.size() - 5, 5, ":meta") == 0) {
-        continue; // Skip internal meta keys
-      }
       // Format: [KeyLen:2][Key][Hash:8]
       uint16_t klen = (uint16_t)pair.first.size();
       size_t p = pay.size();
@@ -334,23 +350,9 @@ private:
 
       pos += 2 + klen + 8;
 
-      // Check local
-      // We can't easily check hash without getting blob?
-      // Engine::get_bucket_keys scanned everything.
-      // Let's just use Engine::get() -> hash.
-      // Or optimize?
-      // For MVP: Simple.
-
-      // Wait, Engine::get() returns Buffer.
-      // We need to re-hash.
-      auto local_buf = engine_.get(key);
-      uint64_t my_h = 0;
-      if (local_buf.size() > 0) {
-        my_h = fnv1a_64(local_buf.data(),
-                        local_buf.size()); // Duplicate hash logic?
-        // Ideally expose hash_blob in public or allow getting hash.
-        // Re-hashing is safe for now.
-      }
+      // Cached content hash (tombstones included, as in get_bucket_keys)
+      auto meta = engine_.get_meta(key);
+      uint64_t my_h = meta ? meta->hash : 0;
 
       if (my_h != their_h) {
         std::cerr << "[Sync] Requesting Key: " << key << "\n";
@@ -376,15 +378,14 @@ private:
     std::string key((const char *)&buf[5], buf.size() - 5);
     std::cerr << "[Sync] OnGetVal: " << key << "\n";
 
-    // To get Meta:
-    auto meta = engine_.get(key + ":meta");
-    if (meta.size() == 0) {
+    auto meta = engine_.get_meta(key);
+    if (!meta) {
       std::cerr << "[Sync] Key (Meta) not found locally: " << key << "\n";
       return;
     }
 
     auto val = engine_.get(key);
-    // Even if val is empty, if meta exists, we send it (as empty val + meta).
+    // Tombstones are sent too (as empty val + meta).
 
     std::vector<uint8_t> pay;
     pay.push_back(SYNC_PUT_VAL);
@@ -396,8 +397,9 @@ private:
     std::memcpy(&pay[p], &klen, 2);
     pay.insert(pay.end(), key.begin(), key.end());
 
-    // Meta
-    std::string meta_s(meta.data(), meta.data() + meta.size());
+    // Meta, in the newest format `from` understands
+    std::string meta_s = peer_version(from) >= 2 ? encode_meta(*meta)
+                                                 : encode_legacy_meta(*meta);
     uint16_t mlen = (uint16_t)meta_s.size();
     size_t pos = pay.size();
     pay.resize(pos + 2);
@@ -405,9 +407,8 @@ private:
     pay.insert(pay.end(), meta_s.begin(), meta_s.end());
 
     // Value
-    if (val.size() > 0) {
-      pay.insert(pay.end(), val.data(), val.data() + val.size());
-    }
+    for (auto chunk : val.chunks())
+      pay.insert(pay.end(), chunk.begin(), chunk.end());
 
     std::cerr << "[Sync] Sending PutVal for " << key << " Size: " << pay.size()
               << "\n";
@@ -469,10 +470,57 @@ private:
     bool is_tombstone;
   };
 
+  void note_version(NodeID from, const std::vector<uint8_t> &buf,
+                    size_t at) {
+    uint8_t v = buf.size() > at ? buf[at] : 1;
+    std::lock_guard lock(versions_mx_);
+    peer_versions_[from] = v;
+  }
+
+  uint8_t peer_version(NodeID peer) {
+    std::lock_guard lock(versions_mx_);
+    auto it = peer_versions_.find(peer);
+    return it == peer_versions_.end() ? 1 : it->second;
+  }
+
+  // [Wall:8][Logical:4][Node:4][Flags:1]
+  static constexpr uint16_t WIRE_META_SIZE = 17;
+
+  static std::string encode_meta(const EntryMeta &meta) {
+    std::string out(WIRE_META_SIZE, '\0');
+    std::memcpy(&out[0], &meta.ts.wall_time, 8);
+    std::memcpy(&out[8], &meta.ts.logical, 4);
+    std::memcpy(&out[12], &meta.ts.node_id, 4);
+    out[16] = (char)meta.flags;
+    return out;
+  }
+
+  // The "<key>:meta" document version 1 peers stored and sent
+  static std::string encode_legacy_meta(const EntryMeta &meta) {
+    std::string json = "{\"ts\":" + std::to_string(meta.ts.wall_time) +
+                       ",\"l\":" + std::to_string(meta.ts.logical) +
+                       ",\"n\":" + std::to_string(meta.ts.node_id) +
+                       (meta.is_tombstone() ? ",\"tombstone\":true" : "") +
+                       "}";
+    auto buf = lite3cpp::lite3_json::from_json_string(json);
+    return std::string((const char *)buf.data(), buf.size());
+  }
+
   ParsedMeta parse_meta(const std::string &meta_bytes) {
     if (meta_bytes.empty())
       return {{0, 0, 0}, false};
 
+    if (meta_bytes.size() == WIRE_META_SIZE) {
+      Timestamp ts;
+      std::memcpy(&ts.wall_time, meta_bytes.data(), 8);
+      std::memcpy(&ts.logical, meta_bytes.data() + 8, 4);
+      std::memcpy(&ts.node_id, meta_bytes.data() + 12, 4);
+      uint8_t flags = (uint8_t)meta_bytes[16];
+      return {ts, (flags & EntryMeta::TOMBSTONE) != 0};
+    }
+
+    // Older peers send the Lite3-encoded "<key>:meta" document
+
     try {
       std::vector<uint8_t> data(meta_bytes.begin(), meta_bytes.end());
       lite3cpp::Buffer buf(std::move(data));
@@ -0,0 +1,260 @@
+#ifndef L3KV_ENGINE_VALUE_LOG_HPP
+#define L3KV_ENGINE_VALUE_LOG_HPP
+
+/*
+ * VALUE LOG - SPILL SPACE FOR EVICTED VALUES
+ *
+ * Append-only files (Bitcask/WiscKey style) holding the values the Engine
+ * evicts to stay within its memory budget. There is no separate index: an
+ * evicted entry keeps its header in the shard map and a Location in place
+ * of its bytes.
+ *
+ *   File:   "<id as 16 hex>.vlog", appended to until `file_bytes`
+ *   Record: [CRC32C:4][KeyLen:2][ValLen:4][Key][Value]
+ *
+ * - Not a source of truth: the WAL and checkpoints hold every value, so the
+ *   directory is cleared on open and nothing is synced.
+ * - Space is reclaimed per file. mark_dead() counts the records no entry
+ *   points at anymore; a sealed file with enough of them is a compaction
+ *   candidate. The Engine moves its live records (for_each_record() and
+ *   append()) and drop()s it.
+ * - Readers hold a file by reference, so a dropped file stays open until
+ *   the reads in flight are done.
+ */
+
+#include "crc32c.hpp"
+#include "wal_storage.hpp"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace l3kv {
+
+class ValueLog {
+public:
+  static constexpr size_t HEADER_SIZE = 4 + 2 + 4;
+
+  // Where one record lives.
+  struct Location {
+    uint32_t file = 0;
+    uint32_t len = 0;    // Value bytes
+    uint64_t offset = 0; // Record start
+    bool operator==(const Location &) const = default;
+  };
+
+  struct Stats {
+    uint64_t files = 0;
+    uint64_t bytes = 0;      // Appended, dead records included
+    uint64_t dead_bytes = 0; // Reclaimable by compaction
+  };
+
+  ValueLog(std::string dir, uint64_t file_bytes)
+      : dir_(std::move(dir)), file_bytes_(file_bytes) {
+    namespace fs = std::filesystem;
+    fs::create_directories(dir_);
+    for (auto &e : fs::directory_iterator(dir_)) {
+      if (e.is_regular_file() && e.path().extension() == ".vlog")
+        fs::remove(e.path());
+    }
+    open_locked(0);
+  }
+
+  ValueLog(const ValueLog &) = delete;
+  ValueLog &operator=(const ValueLog &) = delete;
+
+  const std::string &dir() const { return dir_; }
+
+  Location append(std::string_view key, std::span<const uint8_t> value) {
+    std::vector<uint8_t> rec(HEADER_SIZE + key.size() + value.size());
+    uint16_t klen = (uint16_t)key.size();
+    uint32_t vlen = (uint32_t)value.size();
+    std::memcpy(rec.data() + 4, &klen, 2);
+    std::memcpy(rec.data() + 6, &vlen, 4);
+    std::memcpy(rec.data() + HEADER_SIZE, key.data(), key.size());
+    if (!value.empty())
+      std::memcpy(rec.data() + HEADER_SIZE + key.size(), value.data(),
+                  value.size());
+    uint32_t crc = crc32c::value(rec.data() + 4, rec.size() - 4);
+    std::memcpy(rec.data(), &crc, 4);
+
+    std::lock_guard lock(mx_);
+    auto &[id, f] = *files_.rbegin();
+    if (f->size > 0 && f->size + rec.size() > file_bytes_)
+      open_locked(id + 1); // Seals the current file
+    return append_locked(rec, vlen);
+  }
+
+  // Reads the value at `loc` into `out`. Returns false if the record is
+  // damaged or belongs to another key.
+  bool read(const Location &loc, std::string_view key,
+            std::vector<uint8_t> &out) {
+    auto f = find(loc.file);
+    if (!f)
+      return false;
+    std::vector<uint8_t> rec(HEADER_SIZE + key.size() + loc.len);
+    if (!pread_all(f->file, rec.data(), rec.size(), loc.offset) ||
+        !check(rec.data(), rec.size()) ||
+        std::string_view((const char *)rec.data() + HEADER_SIZE,
+                         key.size()) != key)
+      return false;
+    out.assign(rec.begin() + HEADER_SIZE + key.size(), rec.end());
+    return true;
+  }
+
+  // The record at `loc` is no longer referenced.
+  void mark_dead(const Location &loc, size_t key_len) {
+    if (auto f = find(loc.file))
+      f->dead.fetch_add(HEADER_SIZE + key_len + loc.len,
+                        std::memory_order_relaxed);
+  }
+
+  // A sealed file whose dead share is at least `ratio`, if any.
+  std::optional<uint32_t> compaction_candidate(double ratio) {
+    std::lock_guard lock(mx_);
+    for (auto it = files_.begin(); std::next(it) != files_.end(); ++it) {
+      auto &f = it->second;
+      if (f->size > 0 &&
+          (double)f->dead.load(std::memory_order_relaxed) >= ratio * f->size)
+        return it->first;
+    }
+    return std::nullopt;
+  }
+
+  // Calls fn(key, value, Location) for every intact record of a sealed
+  // file, in file order.
+  template <class Fn> void for_each_record(uint32_t file, Fn &&fn) {
+    auto f = find(file);
+    if (!f)
+      return;
+    std::vector<uint8_t> buf;
+    for (uint64_t off = 0; off + HEADER_SIZE <= f->size;) {
+      uint8_t h[HEADER_SIZE];
+      if (!pread_all(f->file, h, sizeof(h), off))
+        return;
+      uint16_t klen;
+      uint32_t vlen;
+      std::memcpy(&klen, h + 4, 2);
+      std::memcpy(&vlen, h + 6, 4);
+      buf.resize(HEADER_SIZE + klen + vlen);
+      if (!pread_all(f->file, buf.data(), buf.size(), off) ||
+          !check(buf.data(), buf.size()))
+        return;
+      std::string_view key((const char *)buf.data() + HEADER_SIZE, klen);
+      fn(key, std::span<const uint8_t>(buf.data() + HEADER_SIZE + klen, vlen),
+         Location{file, vlen, off});
+      off += buf.size();
+    }
+  }
+
+  // Deletes a sealed file.
+  void drop(uint32_t file) {
+    std::string path;
+    {
+      std::lock_guard lock(mx_);
+      auto it = files_.find(file);
+      if (it == files_.end() || std::next(it) == files_.end())
+        return;
+      path = path_of(file);
+      files_.erase(it);
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+
+  Stats stats() const {
+    std::lock_guard lock(mx_);
+    Stats s;
+    s.files = files_.size();
+    for (auto &[id, f] : files_) {
+      s.bytes += f->size;
+      s.dead_bytes += f->dead.load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+
+private:
+  struct FileState {
+    wal::File file;
+    uint64_t size = 0; // Guarded by mx_; records below it are immutable
+    std::atomic<uint64_t> dead{0};
+    explicit FileState(const std::string &path) : file(path) {}
+  };
+
+  std::string path_of(uint32_t id) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx32 ".vlog", id);
+    return (std::filesystem::path(dir_) / name).string();
+  }
+
+  void open_locked(uint32_t id) {
+    files_.emplace(id, std::make_shared<FileState>(path_of(id)));
+  }
+
+  Location append_locked(const std::vector<uint8_t> &rec, uint32_t vlen) {
+    auto &[id, f] = *files_.rbegin();
+    if (!pwrite_all(f->file, rec.data(), rec.size(), f->size))
+      throw std::runtime_error("Value log: write failed in " + dir_);
+    Location loc{id, vlen, f->size};
+    f->size += rec.size();
+    return loc;
+  }
+
+  std::shared_ptr<FileState> find(uint32_t id) const {
+    std::lock_guard lock(mx_);
+    auto it = files_.find(id);
+    return it == files_.end() ? nullptr : it->second;
+  }
+
+  static bool check(const uint8_t *rec, size_t n) {
+    uint32_t crc;
+    std::memcpy(&crc, rec, 4);
+    return crc32c::value(rec + 4, n - 4) == crc;
+  }
+
+  static bool pwrite_all(wal::File &f, const uint8_t *p, size_t n,
+                         uint64_t off) {
+    while (n > 0) {
+      ssize_t w = wal::File::ops().pwrite_fn(f.handle(), p, n, (off_t)off);
+      if (w <= 0)
+        return false;
+      p += w;
+      n -= (size_t)w;
+      off += (uint64_t)w;
+    }
+    return true;
+  }
+
+  static bool pread_all(wal::File &f, uint8_t *p, size_t n, uint64_t off) {
+    while (n > 0) {
+      ssize_t r = wal::File::ops().pread_fn(f.handle(), p, n, (off_t)off);
+      if (r <= 0)
+        return false;
+      p += r;
+      n -= (size_t)r;
+      off += (uint64_t)r;
+    }
+    return true;
+  }
+
+  std::string dir_;
+  const uint64_t file_bytes_;
+  mutable std::mutex mx_;
+  std::map<uint32_t, std::shared_ptr<FileState>> files_; // By id
+};
+
+} // namespace l3kv
+
+#endif
@@ -1,15 +1,29 @@
 #pragma once
+#include "clock.hpp"
+#include "crc32c.hpp"
 #include "libconveyor/conveyor_modern.hpp"
+#include "log_buffer.hpp"
+#include "wal_mmap.hpp"
+#include "wal_segments.hpp"
 #include "wal_storage.hpp"
+#include "wal_uring.hpp"
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstring>
+#include <exception>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 namespace l3kv {
@@ -19,52 +33,183 @@ enum class WalOp : uint8_t {
   PATCH_I64 = 2,
   DELETE_ = 3,
   BATCH = 4,
-  PATCH_STR = 5
+  PATCH_STR = 5,
+  BATCH_TS = 6, // BATCH with the HLC timestamp of every op inline
+  // Patches with a binary payload (patch_format); PATCH_I64 and PATCH_STR
+  // carry "field:value" text and are only replayed.
+  PATCH_I64_BIN = 7,
+  PATCH_STR_BIN = 8
 };
 
+// Binary patch payload: [FieldLen:varint][Field][Value]. PATCH_I64_BIN's
+// value is a zigzag varint, PATCH_STR_BIN's is the rest of the payload.
+namespace patch_format {
+
+inline void put_varint(std::string &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char)v);
+}
+
+// Consumes a varint from the front of `in`.
+inline bool get_varint(std::string_view &in, uint64_t &v) {
+  v = 0;
+  for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    uint8_t b = (uint8_t)in.front();
+    in.remove_prefix(1);
+    v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+inline std::string encode_i64(std::string_view field, int64_t val) {
+  std::string out;
+  out.reserve(field.size() + 12);
+  put_varint(out, field.size());
+  out.append(field);
+  put_varint(out, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+  return out;
+}
+
+inline std::string encode_str(std::string_view field, std::string_view val) {
+  std::string out;
+  out.reserve(field.size() + val.size() + 2);
+  put_varint(out, field.size());
+  out.append(field);
+  out.append(val);
+  return out;
+}
+
+// Splits a payload into its field and (still encoded) value.
+inline bool decode(std::string_view payload, std::string_view &field,
+                   std::string_view &value) {
+  uint64_t len;
+  if (!get_varint(payload, len) || len > payload.size())
+    return false;
+  field = payload.substr(0, (size_t)len);
+  value = payload.substr((size_t)len);
+  return true;
+}
+
+inline bool decode_i64(std::string_view value, int64_t &out) {
+  uint64_t z;
+  if (!get_varint(value, z) || !value.empty())
+    return false;
+  out = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+  return true;
+}
+
+} // namespace patch_format
+
 struct BatchOp {
   WalOp op;
   std::string key;
   std::string value;
+  Timestamp ts{0, 0, 0}; // Zero = untimestamped (legacy records)
+};
+
+// One op handed out by recovery. The views point into the mapped log (or a
+// copy of a record that straddles two segments).
+struct ReplayOp {
+  WalOp op;
+  std::string_view key;
+  std::string_view payload;
+  Timestamp ts{0, 0, 0}; // Zero for untimestamped records (legacy)
 };
 
 #pragma pack(push, 1)
 struct LogHeader {
   uint32_t crc;
-  uint8_t op;
+  uint8_t op; // WalOp in the low 6 bits, record format flags above
   uint16_t key_len;
   uint32_t payload_len;
+
+  // Record checksummed with CRC32C. Records without it (older files) carry
+  // the original bitwise CRC32 and are still verified with it.
+  static constexpr uint8_t FLAG_CRC32C = 0x80;
+  // Payload starts with the op's raw HLC timestamp:
+  // [Wall:8][Logical:4][Node:4]. Lets a single op skip the BATCH_TS
+  // framing. Counted in payload_len.
+  static constexpr uint8_t FLAG_TS = 0x40;
+  static constexpr uint8_t OP_MASK = 0x3F;
+  static constexpr size_t TS_SIZE = 16;
 };
 #pragma pack(pop)
 
+struct WalOptions {
+  // BUFFERED: lock-free log buffer + flusher thread (wal::LogBuffer)
+  // IO_URING: wal::UringWriter (Linux), falls back to BUFFERED
+  enum class Writer { BUFFERED, IO_URING };
+
+  // When a write call returns:
+  // - NONE: once the record is handed to the writer (lost on power failure)
+  // - GROUP: once a shared sync covers it; one leader syncs for everyone
+  //   who arrived within group_commit_us (or group_commit_bytes)
+  // - ALWAYS: once the caller's own sync covers it
+  enum class Durability { NONE, GROUP, ALWAYS };
+
+  wal::FileOptions file;
+  uint64_t segment_bytes = 64 * 1024 * 1024; // Per segment file (>= 1 MiB)
+  Writer writer = Writer::BUFFERED;
+  size_t buffer_bytes = 16 * 1024 * 1024;  // Log buffer ring (>= 4 KiB)
+  unsigned uring_depth = 4;                // Batch buffers (>= 2)
+  size_t uring_buffer_bytes = 1024 * 1024; // Per batch buffer
+  Durability durability = Durability::NONE;
+  uint32_t group_commit_us = 500;
+  size_t group_commit_bytes = 256 * 1024;
+  unsigned recovery_threads = 0; // Parallel replay, 0 = one per core
+};
+
+// A write could not be made durable: it was applied but the WAL failed to
+// write or sync it, or it was refused (nothing applied) while the log
+// buffer retries a failed write.
+struct DurabilityError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
 class WriteAheadLog {
-  struct FileHandle {
-    HANDLE h;
-    FileHandle(const std::string &p) {
-      h = CreateFileA(p.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
-                      NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-      if (h == INVALID_HANDLE_VALUE) {
-        DWORD err = GetLastError();
-        throw std::runtime_error("Failed to open WAL file: " + p +
-                                 " Error: " + std::to_string(err));
-      }
-    }
-    ~FileHandle() {
-      if (h != INVALID_HANDLE_VALUE)
-        CloseHandle(h);
+  wal::Segments segs_; // Destroyed LAST (after the writers drain into it)
+
+  struct RecordTraits {
+    static constexpr size_t HEADER_SIZE = sizeof(LogHeader);
+    static constexpr size_t MARKER_OFFSET = offsetof(LogHeader, op);
+    static size_t record_size(const uint8_t *header) {
+      LogHeader h;
+      std::memcpy(&h, header, sizeof(h));
+      return sizeof(h) + h.key_len + h.payload_len;
     }
   };
-
-  std::string path_;
-  FileHandle file_; // Destroyed LAST (after wal_)
-  std::unique_ptr<libconveyor::v2::Conveyor>
-      wal_; // Destroyed FIRST (flushes to file_)
-
-  std::mutex mx_;
-  std::vector<uint8_t> scratch_;
-
+  std::unique_ptr<wal::LogBuffer<RecordTraits>> buf_;
+#ifdef L3KV_WAL_URING
+  std::unique_ptr<wal::UringWriter> uring_; // Replaces buf_ when selected
+#endif
+  WalOptions opts_;
+  std::atomic<uint64_t> appended_{0}; // Highest record end handed out
+  std::atomic<uint64_t> durable_{0};
+  std::atomic<uint64_t> syncs_{0};
+
+  // Group commit: at most one leader syncs at a time, the rest wait on it
+  std::mutex group_mx_;
+  std::condition_variable group_cv_;
+  bool group_leader_ = false;
+
+  // Covers the stored op byte (flags included), key and payload.
   static uint32_t compute_crc(uint8_t op, std::string_view key,
                               std::string_view payload) {
+    if (op & LogHeader::FLAG_CRC32C) {
+      uint32_t crc = crc32c::extend(0, &op, sizeof(op));
+      crc = crc32c::extend(crc, key.data(), key.size());
+      return crc32c::extend(crc, payload.data(), payload.size());
+    }
+    return compute_crc_legacy(op, key, payload);
+  }
+
+  static uint32_t compute_crc_legacy(uint8_t op, std::string_view key,
+                                     std::string_view payload) {
     uint32_t crc = 0xFFFFFFFF;
     auto process = [&](const void *data, size_t len) {
       const uint8_t *p = (const uint8_t *)data;
@@ -81,255 +226,617 @@ class WriteAheadLog {
   }
 
 public:
-  explicit WriteAheadLog(std::string path)
-      : path_(std::move(path)), file_(path_) {
-    // Conveyor is initialized in recover() to avoid contention with read loop
+  // `path` is the segment directory (an older single-file WAL there is
+  // adopted as the first segment).
+  explicit WriteAheadLog(std::string path, WalOptions opts = {})
+      : segs_(std::move(path), opts.file, opts.segment_bytes), opts_(opts) {
+    // Writers are created in recover(), once the end of the log is known
   }
 
-  void append(WalOp op, std::string_view key, std::string_view payload) {
-    std::lock_guard lock(mx_);
-    uint32_t crc = compute_crc((uint8_t)op, key, payload);
+  // Returns the log position just past the record, for wait_durable().
+  uint64_t append(WalOp op, std::string_view key, std::string_view payload) {
+    return append_record((uint8_t)op, (uint16_t)key.size(),
+                         (uint32_t)payload.size(), [&](auto &&put) {
+                           put(key.data(), key.size());
+                           put(payload.data(), payload.size());
+                         });
+  }
 
-    LogHeader h{crc, (uint8_t)op, (uint16_t)key.size(),
-                (uint32_t)payload.size()};
-    size_t total_len = sizeof(h) + key.size() + payload.size();
+  // One op with its HLC timestamp (FLAG_TS record).
+  uint64_t append(WalOp op, std::string_view key, std::string_view payload,
+                  const Timestamp &ts) {
+    uint8_t op_byte = (uint8_t)op | LogHeader::FLAG_TS;
+    uint32_t len = (uint32_t)(LogHeader::TS_SIZE + payload.size());
+    return append_record(op_byte, (uint16_t)key.size(), len, [&](auto &&put) {
+      put(key.data(), key.size());
+      put(&ts.wall_time, 8);
+      put(&ts.logical, 4);
+      put(&ts.node_id, 4);
+      put(payload.data(), payload.size());
+    });
+  }
 
-    if (scratch_.capacity() < total_len)
-      scratch_.reserve(total_len * 2);
-    scratch_.clear();
+  // [Count:4]{[Op:1][KeyLen:2][Key][Wall:8][Logical:4][Node:4][ValLen:4][Val]}
+  uint64_t append_batch(const std::vector<BatchOp> &ops) {
+    size_t size = 4;
+    for (const auto &op : ops)
+      size += 1 + 2 + op.key.size() + 16 + 4 + op.value.size();
+
+    uint8_t op_byte = (uint8_t)WalOp::BATCH_TS;
+    return append_record(op_byte, 0, (uint32_t)size, [&](auto &&put) {
+      uint32_t count = (uint32_t)ops.size();
+      put(&count, 4);
+      for (const auto &op : ops) {
+        uint8_t op_byte = (uint8_t)op.op;
+        uint16_t klen = (uint16_t)op.key.size();
+        uint32_t vlen = (uint32_t)op.value.size();
+        put(&op_byte, 1);
+        put(&klen, 2);
+        put(op.key.data(), op.key.size());
+        put(&op.ts.wall_time, 8);
+        put(&op.ts.logical, 4);
+        put(&op.ts.node_id, 4);
+        put(&vlen, 4);
+        put(op.value.data(), op.value.size());
+      }
+    });
+  }
 
-    const uint8_t *p = (const uint8_t *)&h;
-    scratch_.insert(scratch_.end(), p, p + sizeof(h));
-    scratch_.insert(scratch_.end(), key.begin(), key.end());
-    scratch_.insert(scratch_.end(), payload.begin(), payload.end());
+  // Records without a timestamp (appends without one, legacy BATCH) are
+  // reported with a zero Timestamp.
+  using RecoverCallback = std::function<void(
+      WalOp, std::string_view, std::string_view, const Timestamp &)>;
+
+private:
+  // Serializes a record straight into its reserved log buffer space: the
+  // body through put(ptr, n), checksummed as it is copied, then the header.
+  // The op byte goes last and publishes the record to the flusher.
+  template <class Body>
+  uint64_t append_record(uint8_t op, uint16_t key_len, uint32_t payload_len,
+                         Body &&body) {
+    uint8_t op_byte = op | LogHeader::FLAG_CRC32C;
+    uint32_t crc = crc32c::extend(0, &op_byte, sizeof(op_byte));
+    size_t total = sizeof(LogHeader) + key_len + payload_len;
+
+    // The whole record in a staging buffer, for the io_uring writer and
+    // for records larger than the log buffer
+    auto staged = [&] {
+      thread_local std::vector<uint8_t> scratch;
+      scratch.resize(total);
+      size_t at = sizeof(LogHeader);
+      body([&](const void *p, size_t n) {
+        std::memcpy(scratch.data() + at, p, n);
+        at += n;
+        crc = crc32c::extend(crc, p, n);
+      });
+      LogHeader h{crc, op_byte, key_len, payload_len};
+      std::memcpy(scratch.data(), &h, sizeof(h));
+      return scratch.data();
+    };
+
+#ifdef L3KV_WAL_URING
+    if (uring_)
+      return note_appended(uring_->append(staged(), total));
+#endif
+
+    uint64_t pos;
+    try {
+      if (total > buf_->capacity())
+        return note_appended(buf_->append_direct(staged(), total));
+      pos = buf_->reserve(total);
+    } catch (const wal::WriteFailed &e) {
+      throw DurabilityError(e.what());
+    }
+    uint64_t at = pos + sizeof(LogHeader);
+    body([&](const void *p, size_t n) {
+      buf_->write(at, p, n);
+      at += n;
+      crc = crc32c::extend(crc, p, n);
+    });
+    LogHeader h{crc, 0, key_len, payload_len};
+    const uint8_t *hb = (const uint8_t *)&h;
+    constexpr size_t M = RecordTraits::MARKER_OFFSET;
+    buf_->write(pos, hb, M);
+    buf_->write(pos + M + 1, hb + M + 1, sizeof(h) - M - 1);
+    buf_->publish(pos, op_byte);
+    return note_appended(pos + total);
+  }
 
-    auto res = wal_->write(scratch_);
-    if (!res)
-      std::cerr << "WAL Write Error: " << res.error().message() << "\n";
+  uint64_t note_appended(uint64_t pos) {
+    // Concurrent appenders finish out of order: keep the maximum
+    uint64_t cur = appended_.load(std::memory_order_relaxed);
+    while (cur < pos && !appended_.compare_exchange_weak(
+                            cur, pos, std::memory_order_release))
+      ;
+    // Enough pending bytes: cut the leader's gathering window short
+    if (opts_.durability == WalOptions::Durability::GROUP &&
+        pos - durable_.load(std::memory_order_relaxed) >=
+            opts_.group_commit_bytes)
+      group_cv_.notify_all();
+    return pos;
   }
 
-  void append_batch(const std::vector<BatchOp> &ops) {
-    // Serialize batch
-    // [Count:4][Op:1][KeyLen:2][Key][ValLen:4][Val]...
+  void note_durable(uint64_t pos) {
+    uint64_t cur = durable_.load(std::memory_order_relaxed);
+    while (cur < pos && !durable_.compare_exchange_weak(
+                            cur, pos, std::memory_order_release))
+      ;
+  }
 
-    size_t estimated_size = 4;
-    for (const auto &op : ops) {
-      estimated_size += 1 + 2 + op.key.size() + 4 + op.value.size();
+  // Leader/follower: the first writer to find no sync running becomes the
+  // leader, waits up to group_commit_us for followers to append, then syncs
+  // everything appended so far. Followers sleep until a sync covers them
+  // (or take over as leader if it did not).
+  bool group_commit(uint64_t lsn) {
+    std::unique_lock lock(group_mx_);
+    while (durable_.load(std::memory_order_acquire) < lsn) {
+      if (group_leader_) {
+        group_cv_.wait(lock);
+        continue;
+      }
+      group_leader_ = true;
+      group_cv_.wait_for(
+          lock, std::chrono::microseconds(opts_.group_commit_us), [&] {
+            return appended_.load(std::memory_order_acquire) -
+                       durable_.load(std::memory_order_relaxed) >=
+                   opts_.group_commit_bytes;
+          });
+      lock.unlock();
+      bool ok = wait_durable(appended_.load(std::memory_order_acquire));
+      lock.lock();
+      group_leader_ = false;
+      group_cv_.notify_all();
+      if (!ok)
+        return false;
     }
+    return true;
+  }
 
-    std::vector<uint8_t> buf;
-    buf.reserve(estimated_size);
+  // Calls fn(op, key, value, ts) for each op of a BATCH or BATCH_TS
+  // payload. The views point into `payload`.
+  template <class Fn>
+  static void decode_batch(std::string_view payload, bool with_ts, Fn &&fn) {
+    const uint8_t *ptr = (const uint8_t *)payload.data();
+    const uint8_t *end = ptr + payload.size();
 
-    uint32_t count = (uint32_t)ops.size();
-    auto append4 = [&](uint32_t v) {
-      uint8_t *p = (uint8_t *)&v;
-      buf.insert(buf.end(), p, p + 4);
-    };
-    auto append2 = [&](uint16_t v) {
-      uint8_t *p = (uint8_t *)&v;
-      buf.insert(buf.end(), p, p + 2);
-    };
+    if (payload.size() < 4) {
+      std::cerr << "WAL: Corrupt batch (too small)\n";
+      return;
+    }
+    uint32_t count;
+    std::memcpy(&count, ptr, 4);
+    ptr += 4;
+
+    for (uint32_t i = 0; i < count; ++i) {
+      if (ptr + 1 > end)
+        break;
+      uint8_t op_byte = *ptr++;
+
+      if (ptr + 2 > end)
+        break;
+      uint16_t klen;
+      std::memcpy(&klen, ptr, 2);
+      ptr += 2;
+
+      if (ptr + klen > end)
+        break;
+      std::string_view k((const char *)ptr, klen);
+      ptr += klen;
+
+      Timestamp ts{0, 0, 0};
+      if (with_ts) {
+        if (ptr + 16 > end)
+          break;
+        std::memcpy(&ts.wall_time, ptr, 8);
+        std::memcpy(&ts.logical, ptr + 8, 4);
+        std::memcpy(&ts.node_id, ptr + 12, 4);
+        ptr += 16;
+      }
+
+      if (ptr + 4 > end)
+        break;
+      uint32_t vlen;
+      std::memcpy(&vlen, ptr, 4);
+      ptr += 4;
 
-    append4(count);
+      if (ptr + vlen > end)
+        break;
+      std::string_view v((const char *)ptr, vlen);
+      ptr += vlen;
 
-    for (const auto &op : ops) {
-      buf.push_back((uint8_t)op.op);
-      append2((uint16_t)op.key.size());
-      buf.insert(buf.end(), op.key.begin(), op.key.end());
-      append4((uint32_t)op.value.size());
-      buf.insert(buf.end(), op.value.begin(), op.value.end());
+      fn((WalOp)op_byte, k, v, ts);
     }
+  }
 
-    append(WalOp::BATCH, "", std::string_view((char *)buf.data(), buf.size()));
+  // Runs fn(i) for every i in [0, n) on up to `threads` threads (the
+  // caller's included). Rethrows the first exception once all are done.
+  template <class Fn>
+  static void parallel_for(size_t n, unsigned threads, Fn &&fn) {
+    std::atomic<size_t> next{0};
+    std::mutex error_mx;
+    std::exception_ptr error;
+    auto work = [&] {
+      for (size_t i; (i = next.fetch_add(1)) < n;) {
+        try {
+          fn(i);
+        } catch (...) {
+          std::lock_guard lock(error_mx);
+          if (!error)
+            error = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(threads, n); ++t)
+      pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+      t.join();
+    if (error)
+      std::rethrow_exception(error);
   }
 
-  using RecoverCallback =
-      std::function<void(WalOp, std::string_view, std::string_view)>;
-  void recover(RecoverCallback callback) {
-    std::cout << "DEBUG: WAL::recover start" << std::endl;
+  // A record found by the recovery scan.
+  struct Scanned {
+    uint64_t pos;       // Log position of its header
+    const uint8_t *rec; // Header, key and payload, contiguous
+    LogHeader h;
+  };
 
-    LARGE_INTEGER fileSize;
-    if (!GetFileSizeEx(file_.h, &fileSize)) {
-      std::cerr << "WAL: Failed to get file size. Error: " << GetLastError()
-                << "\n";
-      throw std::runtime_error("WAL: Failed to get file size");
-    }
+  // Log bytes validated and applied per recovery round. Bounds the memory
+  // spent on the per-partition op lists.
+  static constexpr uint64_t RECOVERY_WINDOW = 64ull << 20;
+
+  // Copies out a record that straddles two segment files. Null at the end
+  // of the log or for a torn record.
+  const uint8_t *read_straddling(uint64_t pos, LogHeader &h,
+                                 std::vector<std::unique_ptr<uint8_t[]>> &out) {
+    if (segs_.read(&h, sizeof(h), pos) != (ssize_t)sizeof(h) || h.op == 0)
+      return nullptr;
+    size_t len = sizeof(h) + h.key_len + h.payload_len;
+    auto buf = std::make_unique<uint8_t[]>(len);
+    if (segs_.read(buf.get(), len, pos) != (ssize_t)len)
+      return nullptr;
+    out.push_back(std::move(buf));
+    return out.back().get();
+  }
 
-    off_t offset = 0;
-
-    if (fileSize.QuadPart > 0) {
-      // Initialize temporary Reader Conveyor for buffered recovery
-      libconveyor::v2::Config read_cfg;
-      read_cfg.handle = (storage_handle_t)file_.h;
-      read_cfg.ops = wal::WindowsStorage::get_ops();
-      read_cfg.write_capacity = 64 * 1024;
-      read_cfg.read_capacity = 10 * 1024 * 1024;
-
-      std::cout << "DEBUG: Creating reader conveyor..." << std::endl;
-      auto read_create_res = libconveyor::v2::Conveyor::create(read_cfg);
-
-      if (!read_create_res) {
-        std::cerr << "WAL Recovery: Failed to create reader conveyor: "
-                  << read_create_res.error().message()
-                  << ". Skipping recovery.\n";
-      } else {
-        std::cout << "DEBUG: Reader created." << std::endl;
-        auto &reader = read_create_res.value();
-
-        struct Buffered {
-          libconveyor::v2::Conveyor &r;
-          off_t &off;
-          std::vector<uint8_t> &buf;
-
-          bool read(void *dest, size_t len, const char *ctx) {
-            buf.resize(len);
-            auto res = r.read(buf);
-            if (!res) {
-              std::cerr << "WAL Recovery [" << ctx
-                        << "]: Read error: " << res.error().message() << "\n";
-              return false;
-            }
-            if (res.value() != len) {
-              if (res.value() == 0 && std::strcmp(ctx, "HEADER") == 0)
-                return false;
-              if (res.value() > 0) {
-                std::cerr << "WAL Recovery [" << ctx << "]: Partial read ("
-                          << res.value() << "/" << len << ")\n";
-              }
-              return false;
-            }
-            std::memcpy(dest, buf.data(), len);
-            off += (off_t)len;
-            return true;
-          }
-        };
+public:
+  // Replays records from log position `from` (a checkpoint LSN; 0 = the
+  // oldest segment) and opens the log for appends after the last intact
+  // record. Serial form of the partitioned recover() below: every op goes
+  // to `callback`, one at a time, in log order.
+  void recover(RecoverCallback callback, uint64_t from = 0) {
+    recover(
+        1, [](const ReplayOp &) -> size_t { return 0; },
+        [&](size_t, const ReplayOp &r) {
+          callback(r.op, r.key, r.payload, r.ts);
+        },
+        from);
+  }
 
-        std::vector<uint8_t> read_buf;
-        Buffered b{reader, offset, read_buf};
+  using PartitionFn = std::function<size_t(const ReplayOp &)>;
+  using ApplyFn = std::function<void(size_t partition, const ReplayOp &)>;
+  using FinishFn = std::function<void(size_t partition)>;
+
+  // Parallel replay. Segments are memory-mapped and read in windows of
+  // RECOVERY_WINDOW bytes:
+  // 1. One pass over the record headers finds the record boundaries.
+  // 2. Chunks of records are CRC-checked in parallel, and their ops (batch
+  //    members included) sorted into `partitions` lists by partition(op).
+  // 3. Each partition's ops are applied in log order by
+  //    apply(partition, op) on a single thread; partitions run in parallel.
+  // Replay stops at the first bad record, as a serial scan would. Op views
+  // point into the mapping and are valid only during apply(), unless
+  // `finish` is given: then the whole log stays mapped until
+  // finish(partition) has run for every partition (in parallel), so apply()
+  // may hold on to ops and finish() apply them. The log is already open for
+  // appends when finish() runs.
+  void recover(size_t partitions, PartitionFn partition, ApplyFn apply,
+               uint64_t from = 0, FinishFn finish = nullptr) {
+    std::cout << "DEBUG: WAL::recover start" << std::endl;
+    auto started = std::chrono::steady_clock::now();
+
+    uint64_t begin = segs_.begin();
+    uint64_t file_size = segs_.end();
+    if (from > file_size) {
+      // Everything on disk is older than the checkpoint
+      std::cerr << "WAL Recovery: Log ends at " << file_size
+                << " before checkpoint " << from << ", starting over there\n";
+      segs_.reset(from);
+      file_size = from;
+    } else if (from < begin) {
+      // The oldest segment may start mid-record: only a checkpoint LSN is
+      // a known record boundary past removed segments.
+      throw std::runtime_error("WAL: records before " + std::to_string(begin) +
+                               " were removed; recover from a checkpoint");
+    }
 
-        while (true) {
-          LogHeader h;
-          if (!b.read(&h, sizeof(h), "HEADER"))
+    unsigned threads = opts_.recovery_threads;
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    auto extents = segs_.extents();
+    std::unique_ptr<wal::MappedFile> map;
+    std::vector<std::unique_ptr<wal::MappedFile>> kept_maps; // For finish
+    std::vector<std::unique_ptr<uint8_t[]>> kept_straddling;
+    const wal::Segments::Extent *ext = nullptr;
+    uint64_t valid_end = from; // End of the last intact record
+    uint64_t records = 0;
+    std::atomic<uint64_t> zero_crc{0};
+    bool done = false;
+
+    while (!done) {
+      if (!ext || valid_end >= ext->end) {
+        auto it = std::find_if(extents.begin(), extents.end(), [&](auto &e) {
+          return e.start <= valid_end && valid_end < e.end;
+        });
+        if (it == extents.end())
+          break;
+        ext = &*it;
+        if (finish && map)
+          kept_maps.push_back(std::move(map));
+        map.reset(); // Unmap the previous segment first
+        map = std::make_unique<wal::MappedFile>(ext->path);
+      }
+      uint64_t limit =
+          ext->start + std::min<uint64_t>(map->size(), ext->end - ext->start);
+
+      // 1. Record boundaries, up to the window size or the segment end
+      std::vector<Scanned> recs;
+      std::vector<std::unique_ptr<uint8_t[]>> straddling;
+      uint64_t pos = valid_end;
+      while (pos < limit && pos - valid_end < RECOVERY_WINDOW) {
+        LogHeader h;
+        const uint8_t *rec = nullptr;
+        if (pos + sizeof(h) <= limit) {
+          rec = map->data() + (pos - ext->start);
+          std::memcpy(&h, rec, sizeof(h));
+          if (h.op == 0) {
+            done = true; // Preallocated, never written space: end of log
             break;
-
-          std::string key(h.key_len, '\0');
-          std::string payload(h.payload_len, '\0');
-
-          if (h.key_len > 0) {
-            if (!b.read(key.data(), h.key_len, "KEY")) {
-              std::cerr << "WAL Recovery: Truncated key at offset " << offset
-                        << "\n";
-              break;
-            }
           }
-
-          if (h.payload_len > 0) {
-            if (!b.read(payload.data(), h.payload_len, "PAYLOAD")) {
-              std::cerr << "WAL Recovery: Truncated payload at offset "
-                        << offset << "\n";
-              break;
-            }
+          if (pos + sizeof(h) + h.key_len + h.payload_len > limit)
+            rec = nullptr;
+        }
+        if (!rec) {
+          // Runs past this segment: the window ends with a copy of it
+          rec = read_straddling(pos, h, straddling);
+          if (!rec) {
+            done = true;
+            break;
           }
+          recs.push_back({pos, rec, h});
+          pos += sizeof(h) + h.key_len + h.payload_len;
+          break;
+        }
+        recs.push_back({pos, rec, h});
+        pos += sizeof(h) + h.key_len + h.payload_len;
+      }
+      if (recs.empty()) {
+        if (!done && pos >= limit && limit < ext->end)
+          done = true; // The file ends before the next segment starts
+        continue;
+      }
 
-          uint32_t computed = compute_crc(h.op, key, payload);
-          if (computed != h.crc) {
-            if (h.crc == 0 && computed != 0) {
-              std::cerr << "WAL WARNING: Zero CRC allowed for legacy.\n";
-            } else {
-              std::cerr << "WAL ERROR: CRC Mismatch at offset " << offset
-                        << ". Corrupt.\n";
-              break;
+      // 2. Validate and partition, chunk by chunk
+      constexpr size_t NONE = SIZE_MAX;
+      size_t chunks = std::min<size_t>(recs.size(), (size_t)threads * 4);
+      std::vector<size_t> bad(chunks, NONE); // First bad record per chunk
+      std::vector<std::vector<std::vector<ReplayOp>>> parts(
+          chunks, std::vector<std::vector<ReplayOp>>(partitions));
+      parallel_for(chunks, threads, [&](size_t c) {
+        size_t lo = recs.size() * c / chunks;
+        size_t hi = recs.size() * (c + 1) / chunks;
+        auto add = [&](WalOp op, std::string_view key,
+                       std::string_view payload, const Timestamp &ts) {
+          ReplayOp r{op, key, payload, ts};
+          parts[c][partition(r) % partitions].push_back(r);
+        };
+        for (size_t i = lo; i < hi; ++i) {
+          const Scanned &r = recs[i];
+          std::string_view key((const char *)r.rec + sizeof(LogHeader),
+                               r.h.key_len);
+          std::string_view payload(key.data() + key.size(), r.h.payload_len);
+          uint32_t computed = compute_crc(r.h.op, key, payload);
+          if (computed != r.h.crc) {
+            if (r.h.crc != 0 || computed == 0) {
+              bad[c] = i;
+              return;
             }
+            zero_crc.fetch_add(1, std::memory_order_relaxed); // Legacy
           }
-
-          if ((WalOp)h.op == WalOp::BATCH) {
-            const uint8_t *ptr = (const uint8_t *)payload.data();
-            const uint8_t *end = ptr + payload.size();
-
-            if (payload.size() < 4) {
-              std::cerr << "WAL: Corrupt batch (too small)\n";
+          WalOp op = (WalOp)(r.h.op & LogHeader::OP_MASK);
+          Timestamp ts{0, 0, 0};
+          if (r.h.op & LogHeader::FLAG_TS) {
+            if (payload.size() < LogHeader::TS_SIZE) {
+              std::cerr << "WAL: Corrupt record at " << r.pos
+                        << " (timestamp missing)\n";
               continue;
             }
-            uint32_t count = *(uint32_t *)ptr;
-            ptr += 4;
-
-            for (uint32_t i = 0; i < count; ++i) {
-              if (ptr + 1 > end)
-                break;
-              uint8_t op_byte = *ptr++;
-
-              if (ptr + 2 > end)
-                break;
-              uint16_t klen = *(uint16_t *)ptr;
-              ptr += 2;
-
-              if (ptr + klen > end)
-                break;
-              std::string_view k((const char *)ptr, klen);
-              ptr += klen;
-
-              if (ptr + 4 > end)
-                break;
-              uint32_t vlen = *(uint32_t *)ptr;
-              ptr += 4;
-
-              if (ptr + vlen > end)
-                break;
-              std::string_view v((const char *)ptr, vlen);
-              ptr += vlen;
-
-              callback((WalOp)op_byte, k, v);
-            }
-          } else {
-            callback((WalOp)h.op, key, payload);
+            std::memcpy(&ts.wall_time, payload.data(), 8);
+            std::memcpy(&ts.logical, payload.data() + 8, 4);
+            std::memcpy(&ts.node_id, payload.data() + 12, 4);
+            payload.remove_prefix(LogHeader::TS_SIZE);
           }
+          if (op == WalOp::BATCH || op == WalOp::BATCH_TS)
+            decode_batch(payload, op == WalOp::BATCH_TS, add);
+          else
+            add(op, key, payload, ts);
+        }
+      });
+
+      // Chunks past the first bad record hold ops from beyond the end of
+      // the valid log: drop them.
+      size_t used = chunks;
+      valid_end = pos;
+      records += recs.size();
+      for (size_t c = 0; c < chunks; ++c) {
+        if (bad[c] != NONE) {
+          const Scanned &r = recs[bad[c]];
+          std::cerr << "WAL ERROR: CRC Mismatch at offset " << r.pos
+                    << ". Corrupt.\n";
+          used = c + 1;
+          valid_end = r.pos;
+          records -= recs.size() - bad[c];
+          done = true;
+          break;
         }
-        std::cout << "DEBUG: Recovery loop done. Offset: " << offset
-                  << std::endl;
       }
-    } else {
-      std::cout << "DEBUG: WAL file is empty (Cold Start). Skipping recovery."
-                << std::endl;
+
+      // 3. Apply, one thread per partition at a time
+      parallel_for(partitions, threads, [&](size_t p) {
+        for (size_t c = 0; c < used; ++c) {
+          for (const ReplayOp &op : parts[c][p])
+            apply(p, op);
+        }
+      });
+      if (finish) {
+        for (auto &b : straddling)
+          kept_straddling.push_back(std::move(b));
+      }
     }
 
-    std::cerr << "WAL Recovery: Completed at offset " << offset << "\n";
-
-    // Initialize Writer Conveyor
-    libconveyor::v2::Config cfg;
-    cfg.handle = (storage_handle_t)file_.h;
-    cfg.ops = wal::WindowsStorage::get_ops();
-    cfg.write_capacity = 20 * 1024 * 1024;
-    cfg.read_capacity = 5 * 1024 * 1024;
-
-    std::cout << "DEBUG: Creating Writer Conveyor..." << std::endl;
-    auto create_res = libconveyor::v2::Conveyor::create(cfg);
-    if (!create_res)
-      throw std::system_error(create_res.error());
-    wal_ = std::make_unique<libconveyor::v2::Conveyor>(
-        std::move(create_res.value()));
-    std::cout << "DEBUG: Writer Conveyor created." << std::endl;
-
-    auto seek_res = wal_->seek(0, SEEK_END);
-    if (!seek_res) {
-      std::cerr << "WAL: Seeding failure: " << seek_res.error().message()
+    if (uint64_t n = zero_crc.load())
+      std::cerr << "WAL WARNING: " << n
+                << " record(s) with a zero CRC allowed for legacy.\n";
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - started)
+                  .count();
+    std::cerr << "WAL Recovery: Completed at offset " << valid_end << " ("
+              << records << " records, " << threads << " threads, " << ms
+              << " ms)\n";
+
+    // Drop a torn record or preallocated zeros so new appends continue
+    // right after the last valid record. The op views kept for finish()
+    // all lie before it.
+    if (file_size > valid_end && !segs_.truncate(valid_end)) {
+      std::cerr << "WAL: Failed to truncate tail at offset " << valid_end
                 << "\n";
     }
+    open_writer(valid_end);
+
+    if (finish)
+      parallel_for(partitions, threads, finish);
   }
 
-  void flush() {
-    std::lock_guard lock(mx_);
-    if (wal_) {
-      auto res = wal_->flush();
-      if (!res) {
-        std::cerr << "WAL Flush Error: " << res.error().message() << "\n";
+private:
+  // Starts taking appends at `end`, the end of the recovered log.
+  void open_writer(uint64_t end) {
+    appended_.store(end);
+    durable_.store(end);
+#ifdef L3KV_WAL_URING
+    if (opts_.writer == WalOptions::Writer::IO_URING) {
+      uring_ = wal::UringWriter::create(
+          segs_, end, {opts_.uring_depth, opts_.uring_buffer_bytes});
+      if (uring_) {
+        std::cout << "WAL: io_uring writer (depth " << opts_.uring_depth
+                  << ")" << std::endl;
+        return;
       }
+      std::cerr << "WAL: Falling back to the buffered writer\n";
+    }
+#else
+    if (opts_.writer == WalOptions::Writer::IO_URING)
+      std::cerr << "WAL: io_uring not supported on this platform, using the "
+                   "buffered writer\n";
+#endif
+
+    buf_ = std::make_unique<wal::LogBuffer<RecordTraits>>(
+        segs_.handle(), wal::Segments::ops(), end, opts_.buffer_bytes);
+  }
+
+public:
+  // Blocks until everything up to `lsn` is durable, syncing if needed.
+  // Appends never wait on the sync; they keep filling the log buffer.
+  bool wait_durable(uint64_t lsn) {
+    if (durable_.load(std::memory_order_acquire) >= lsn)
+      return true;
+#ifdef L3KV_WAL_URING
+    if (uring_) {
+      uint64_t upto = uring_->appended();
+      if (!uring_->wait(upto))
+        return false;
+      syncs_.fetch_add(1, std::memory_order_relaxed);
+      note_durable(upto);
+      return true;
     }
+#endif
+    if (!buf_)
+      return false;
+    if (!buf_->wait_flushed(lsn)) {
+      std::cerr << "WAL Flush Error: log buffer write failed\n";
+      return false;
+    }
+    // Everything the flusher has written so far rides on this sync
+    uint64_t upto = buf_->flushed();
+    if (!segs_.sync()) {
+      std::cerr << "WAL Sync Error\n";
+      return false;
+    }
+    syncs_.fetch_add(1, std::memory_order_relaxed);
+    note_durable(upto);
+    return true;
+  }
+
+  // Returns once the record ending at `lsn` is as durable as the configured
+  // mode promises; false if the sync failed.
+  bool commit(uint64_t lsn) {
+    switch (opts_.durability) {
+    case WalOptions::Durability::NONE:
+      return true;
+    case WalOptions::Durability::ALWAYS:
+      return wait_durable(lsn);
+    case WalOptions::Durability::GROUP:
+      return group_commit(lsn);
+    }
+    return true;
+  }
+
+  void flush() { wait_durable(appended_.load(std::memory_order_acquire)); }
+
+  // Position just past the newest record handed to the writer.
+  uint64_t appended_lsn() const {
+    return appended_.load(std::memory_order_acquire);
+  }
+
+  // Deletes segments that hold only records before `lsn` (a durable
+  // checkpoint). Returns how many were removed.
+  size_t remove_segments_before(uint64_t lsn) {
+    return segs_.remove_before(lsn);
+  }
+
+  size_t segment_count() const { return segs_.count(); }
+  const std::string &dir() const { return segs_.dir(); }
+
+  uint64_t durable_lsn() const {
+    return durable_.load(std::memory_order_acquire);
+  }
+
+  // Syncs issued by wait_durable() (one per group in GROUP mode).
+  uint64_t sync_count() const {
+    return syncs_.load(std::memory_order_relaxed);
   }
 
   auto stats() {
-    if (!wal_)
-      return libconveyor::v2::Conveyor::Stats{};
-    return wal_->stats();
+#ifdef L3KV_WAL_URING
+    if (uring_) {
+      auto u = uring_->stats();
+      libconveyor::v2::Conveyor::Stats st{};
+      st.bytes_written = u.bytes_written;
+      st.write_buffer_full_events = u.buffer_full_events;
+      if (u.batches)
+        st.avg_write_latency = std::chrono::milliseconds(
+            u.total_latency_us / u.batches / 1000);
+      return st;
+    }
+#endif
+    libconveyor::v2::Conveyor::Stats st{};
+    if (buf_) {
+      auto b = buf_->stats();
+      st.bytes_written = b.bytes_written;
+      st.write_buffer_full_events = b.buffer_full_waits;
+    }
+    return st;
   }
 };
 
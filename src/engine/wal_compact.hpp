@@ -0,0 +1,111 @@
+#ifndef L3KV_ENGINE_WAL_COMPACT_HPP
+#define L3KV_ENGINE_WAL_COMPACT_HPP
+
+/*
+ * OFFLINE WAL COMPACTION
+ *
+ * Rewrites a WAL directory down to its live set: the newest checkpoint
+ * (snapshot or heap image) is copied as is, and the log after it is
+ * replayed through a ReplayIndex and written back with only the surviving
+ * ops. Opening the result yields the same entries and timestamps as opening
+ * the original.
+ *
+ * - Survivors keep their log order and timestamps; they are packed into
+ *   BATCH_TS records of up to BATCH_BYTES each.
+ * - The new log starts at the checkpoint's LSN, so the checkpoint still
+ *   names the position replay resumes from.
+ * - The source must not be in use. Opening it trims a torn tail, exactly
+ *   as a server start would.
+ */
+
+#include "heap_image.hpp"
+#include "replay_index.hpp"
+#include "snapshot.hpp"
+#include "wal.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace l3kv {
+
+struct CompactStats {
+  uint64_t lsn = 0; // Where both logs start (the checkpoint LSN, or 0)
+  uint64_t ops_in = 0;
+  uint64_t ops_out = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+};
+
+// Writes the compacted copy of the WAL at `src` to `dst`, which must not
+// exist yet (or be empty).
+inline CompactStats compact_wal(const std::string &src, const std::string &dst,
+                                WalOptions opts = {}) {
+  namespace fs = std::filesystem;
+  constexpr size_t BATCH_BYTES = 1 << 20;
+  if (fs::exists(dst) && !fs::is_empty(dst))
+    throw std::runtime_error("Compact: " + dst + " is not empty");
+  opts.durability = WalOptions::Durability::NONE;
+
+  CompactStats stats;
+  // The newest checkpoint file, in either format
+  auto snap = snapshot::latest(src);
+  auto image = heap::latest(src);
+  std::string from, copy;
+  if (image && (!snap || *image > *snap)) {
+    stats.lsn = *image;
+    from = heap::path_of(src, *image);
+    copy = heap::path_of(dst, *image);
+  } else if (snap) {
+    stats.lsn = *snap;
+    from = snapshot::path_of(src, *snap);
+    copy = snapshot::path_of(dst, *snap);
+  }
+
+  WriteAheadLog in(src, opts);
+  WriteAheadLog out(dst, opts);
+  out.recover([](WalOp, std::string_view, std::string_view,
+                 const Timestamp &) {},
+              stats.lsn); // Empty: the new log starts at the LSN
+
+  // One partition keeps every survivor in log order
+  ReplayIndex live;
+  in.recover(
+      1, [](const ReplayOp &) -> size_t { return 0; },
+      [&](size_t, const ReplayOp &op) { live.add(op); }, stats.lsn,
+      [&](size_t) {
+        std::vector<BatchOp> batch;
+        size_t bytes = 0;
+        live.for_each([&](const ReplayOp &op) {
+          batch.push_back({op.op, std::string(op.key),
+                           std::string(op.payload), op.ts});
+          bytes += op.key.size() + op.payload.size();
+          if (bytes >= BATCH_BYTES) {
+            out.append_batch(batch);
+            batch.clear();
+            bytes = 0;
+          }
+        });
+        if (!batch.empty())
+          out.append_batch(batch);
+      });
+  out.flush();
+
+  stats.ops_in = live.added();
+  stats.ops_out = live.live();
+  stats.bytes_in = in.appended_lsn() - stats.lsn;
+  stats.bytes_out = out.appended_lsn() - stats.lsn;
+
+  if (!from.empty()) {
+    fs::copy_file(from, copy);
+    if (!wal::File(copy).sync())
+      throw std::runtime_error("Compact: failed to sync " + copy);
+    wal::sync_dir(dst);
+  }
+  return stats;
+}
+
+} // namespace l3kv
+
+#endif
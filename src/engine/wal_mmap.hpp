@@ -0,0 +1,100 @@
+#ifndef L3KV_ENGINE_WAL_MMAP_HPP
+#define L3KV_ENGINE_WAL_MMAP_HPP
+
+/*
+ * READ-ONLY FILE MAPPING (WAL RECOVERY, HEAP IMAGES)
+ *
+ * Recovery reads each segment once, front to back, and hands out views of
+ * the mapped bytes instead of copying records out. Heap images are probed
+ * at random (`sequential` = false).
+ * - POSIX: mmap(PROT_READ, MAP_PRIVATE) with MADV_SEQUENTIAL (or
+ *   MADV_RANDOM), opened through a separate descriptor (never O_DIRECT).
+ * - Windows: the file is read into memory; the views work the same.
+ * An empty file maps to an empty range.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <vector>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace wal {
+
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path, bool sequential = true) {
+#ifdef _WIN32
+    (void)sequential;
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+      throw std::runtime_error("WAL: Failed to open " + path);
+    bytes_.resize((size_t)in.tellg());
+    in.seekg(0);
+    if (!in.read((char *)bytes_.data(), (std::streamsize)bytes_.size()))
+      throw std::runtime_error("WAL: Failed to read " + path);
+    data_ = bytes_.data();
+    size_ = bytes_.size();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error("WAL: Failed to open " + path + ": " +
+                               std::strerror(errno));
+    struct stat sb;
+    if (::fstat(fd, &sb) != 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::runtime_error("WAL: Failed to stat " + path + ": " +
+                               std::strerror(err));
+    }
+    size_ = (size_t)sb.st_size;
+    if (size_ > 0) {
+      void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error("WAL: Failed to map " + path + ": " +
+                                 std::strerror(err));
+      }
+      ::madvise(p, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+      data_ = static_cast<const uint8_t *>(p);
+    }
+    ::close(fd); // The mapping keeps the file open
+#endif
+  }
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (data_)
+      ::munmap(const_cast<uint8_t *>(data_), size_);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<uint8_t> bytes_;
+#endif
+};
+
+} // namespace wal
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef L3KV_ENGINE_WAL_SEGMENTS_HPP
+#define L3KV_ENGINE_WAL_SEGMENTS_HPP
+
+/*
+ * SEGMENTED WAL STORAGE
+ *
+ * The log is one logical byte stream and LSNs are positions in it. On disk
+ * it is a directory of segment files, each named after the position of its
+ * first byte ("<start as 16 hex digits>.wal"):
+ * - A segment covers [start, start of the next segment). Records may
+ *   straddle a boundary; readers see the concatenation.
+ * - The last segment takes writes until `segment_bytes` past its start,
+ *   then the next one is created on demand. Starts are block aligned, so
+ *   O_DIRECT offsets stay aligned inside every file.
+ * - `remove_before(lsn)` deletes the segments a checkpoint made redundant,
+ *   which bounds both disk use and replay time.
+ *
+ * `Segments` is a storage backend itself: handle() + ops() route pread and
+ * pwrite to the right file, so the log buffer works on log positions.
+ * Recovery maps the files listed by extents() directly.
+ *
+ * A WAL written before segmentation (a single file at the WAL path) is moved
+ * into the directory as the segment starting at 0.
+ */
+
+#include "wal_storage.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wal {
+
+class Segments {
+public:
+  static constexpr uint64_t ALIGN = 4096;
+  static constexpr uint64_t MIN_SEGMENT_BYTES = 1 << 20;
+
+  Segments(std::string dir, const FileOptions &opts, uint64_t segment_bytes)
+      : dir_(std::move(dir)), opts_(opts),
+        segment_bytes_(
+            align_up(std::max(segment_bytes, MIN_SEGMENT_BYTES))) {
+    namespace fs = std::filesystem;
+    if (fs::is_regular_file(dir_))
+      adopt_legacy();
+    fs::create_directories(dir_);
+
+    for (auto &e : fs::directory_iterator(dir_)) {
+      uint64_t start;
+      if (e.is_regular_file() &&
+          parse_name(e.path().filename().string(), start))
+        segs_.emplace(start, std::make_shared<Segment>(path_of(start), opts_));
+    }
+    if (segs_.empty())
+      open_locked(0);
+    update_limit_locked();
+  }
+
+  Segments(const Segments &) = delete;
+  Segments &operator=(const Segments &) = delete;
+
+  storage_handle_t handle() { return static_cast<storage_handle_t>(this); }
+  static storage_operations_t ops() {
+    return {pwrite_impl, pread_impl, lseek_impl};
+  }
+
+  const std::string &dir() const { return dir_; }
+  uint64_t segment_bytes() const { return segment_bytes_; }
+
+  std::string path_of(uint64_t start) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".wal", start);
+    return (std::filesystem::path(dir_) / name).string();
+  }
+
+  bool direct() const {
+    std::lock_guard lock(mx_);
+    return segs_.rbegin()->second->file.direct();
+  }
+
+  // Position of the oldest byte still on disk.
+  uint64_t begin() const {
+    std::lock_guard lock(mx_);
+    return segs_.begin()->first;
+  }
+
+  // Position just past the last segment's file (preallocated space
+  // included; recovery stops at the first zero header).
+  uint64_t end() const {
+    std::lock_guard lock(mx_);
+    auto &[start, seg] = *segs_.rbegin();
+    return start + (uint64_t)seg->file.size();
+  }
+
+  size_t count() const {
+    std::lock_guard lock(mx_);
+    return segs_.size();
+  }
+
+  // Log range held by one segment file.
+  struct Extent {
+    uint64_t start = 0;
+    uint64_t end = 0; // Its file size or the next start, whichever is less
+    std::string path;
+  };
+
+  std::vector<Extent> extents() const {
+    std::lock_guard lock(mx_);
+    std::vector<Extent> out;
+    for (auto it = segs_.begin(); it != segs_.end(); ++it) {
+      uint64_t end = it->first + (uint64_t)it->second->file.size();
+      if (auto next = std::next(it); next != segs_.end())
+        end = std::min(end, next->first);
+      out.push_back({it->first, end, path_of(it->first)});
+    }
+    return out;
+  }
+
+  ssize_t write(const void *buf, size_t n, uint64_t pos) {
+    return pwrite_impl(handle(), buf, n, (off_t)pos);
+  }
+  ssize_t read(void *buf, size_t n, uint64_t pos) {
+    return pread_impl(handle(), buf, n, (off_t)pos);
+  }
+
+  // Calls fn(File &, file offset, offset into the range, length) for each
+  // per-segment piece of [pos, pos + len), creating segments as needed. For
+  // writers that bypass the storage ops (io_uring).
+  template <class Fn> bool for_each_extent(uint64_t pos, size_t len, Fn &&fn) {
+    size_t done = 0;
+    while (done < len) {
+      auto [seg, start, end] = locate(pos + done, true);
+      if (!seg)
+        return false;
+      size_t n = (size_t)std::min<uint64_t>(len - done, end - (pos + done));
+      fn(seg->file, pos + done - start, done, n);
+      seg->dirty.store(true, std::memory_order_release);
+      done += n;
+    }
+    return true;
+  }
+
+  // Syncs every segment written since the last sync.
+  bool sync() {
+    std::vector<std::shared_ptr<Segment>> dirty;
+    {
+      std::lock_guard lock(mx_);
+      for (auto &[start, seg] : segs_) {
+        if (seg->dirty.exchange(false, std::memory_order_acq_rel))
+          dirty.push_back(seg);
+      }
+    }
+    bool ok = true;
+    for (auto &seg : dirty) {
+      if (!seg->file.sync()) {
+        seg->dirty.store(true, std::memory_order_release);
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  // Drops everything from `pos` on (a torn tail found by recovery).
+  bool truncate(uint64_t pos) {
+    std::lock_guard lock(mx_);
+    while (segs_.size() > 1 && segs_.rbegin()->first > pos)
+      remove_locked(std::prev(segs_.end()));
+    auto &[start, seg] = *segs_.rbegin();
+    bool ok = seg->file.truncate((int64_t)(pos > start ? pos - start : 0));
+    update_limit_locked();
+    sync_dir(dir_);
+    return ok;
+  }
+
+  // Starts an empty log at `pos`: recovery found the log ending before a
+  // checkpoint that already covers it.
+  void reset(uint64_t pos) {
+    std::lock_guard lock(mx_);
+    while (!segs_.empty())
+      remove_locked(segs_.begin());
+    open_locked(pos & ~(ALIGN - 1));
+    update_limit_locked();
+  }
+
+  // Deletes the segments that end at or before `lsn`. The last segment is
+  // always kept. Returns the number removed.
+  size_t remove_before(uint64_t lsn) {
+    std::lock_guard lock(mx_);
+    size_t n = 0;
+    while (segs_.size() > 1 && std::next(segs_.begin())->first <= lsn) {
+      remove_locked(segs_.begin());
+      ++n;
+    }
+    if (n)
+      sync_dir(dir_);
+    return n;
+  }
+
+private:
+  struct Segment {
+    File file;
+    std::atomic<bool> dirty{false};
+    Segment(const std::string &path, const FileOptions &opts)
+        : file(path, opts) {}
+  };
+
+  struct Located {
+    std::shared_ptr<Segment> seg;
+    uint64_t start = 0;
+    uint64_t end = 0; // Start of the next segment (or the write limit)
+  };
+
+  static uint64_t align_up(uint64_t v) {
+    return (v + ALIGN - 1) & ~(ALIGN - 1);
+  }
+
+  static bool parse_name(const std::string &name, uint64_t &start) {
+    if (name.size() != 20 || name.compare(16, 4, ".wal") != 0)
+      return false;
+    start = 0;
+    for (size_t i = 0; i < 16; ++i) {
+      char c = name[i];
+      int d = c >= '0' && c <= '9'   ? c - '0'
+              : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                                     : -1;
+      if (d < 0)
+        return false;
+      start = start << 4 | (uint64_t)d;
+    }
+    return true;
+  }
+
+  void adopt_legacy() {
+    namespace fs = std::filesystem;
+    std::string tmp = dir_ + ".legacy";
+    fs::rename(dir_, tmp);
+    fs::create_directories(dir_);
+    fs::rename(tmp, path_of(0));
+    auto parent = fs::absolute(dir_).parent_path().string();
+    sync_dir(dir_);
+    sync_dir(parent);
+    std::cout << "WAL: Moved single-file log into " << dir_ << "/"
+              << std::endl;
+  }
+
+  void open_locked(uint64_t start) {
+    segs_.emplace(start, std::make_shared<Segment>(path_of(start), opts_));
+    sync_dir(dir_);
+  }
+
+  using SegmentMap = std::map<uint64_t, std::shared_ptr<Segment>>;
+
+  void remove_locked(SegmentMap::iterator it) {
+    std::string path = path_of(it->first);
+    segs_.erase(it);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    if (ec)
+      std::cerr << "WAL: Failed to remove segment " << path << ": "
+                << ec.message() << "\n";
+  }
+
+  // The last segment grows to segment_bytes (or its current size, for an
+  // adopted legacy file) before the next one starts.
+  void update_limit_locked() {
+    auto &[start, seg] = *segs_.rbegin();
+    limit_ = align_up(
+        std::max(start + segment_bytes_, start + (uint64_t)seg->file.size()));
+  }
+
+  Located locate(uint64_t pos, bool create) {
+    std::lock_guard lock(mx_);
+    if (create) {
+      while (pos >= limit_) {
+        open_locked(limit_);
+        limit_ += segment_bytes_;
+      }
+    }
+    auto it = segs_.upper_bound(pos);
+    if (it == segs_.begin())
+      return {};
+    uint64_t end = it == segs_.end() ? limit_ : it->first;
+    --it;
+    return {it->second, it->first, end};
+  }
+
+  static ssize_t pwrite_impl(storage_handle_t h, const void *buf, size_t count,
+                             off_t offset) {
+    auto *self = static_cast<Segments *>(h);
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    size_t done = 0;
+    while (done < count) {
+      uint64_t pos = (uint64_t)offset + done;
+      auto [seg, start, end] = self->locate(pos, true);
+      if (!seg)
+        return done ? (ssize_t)done : -1;
+      size_t n = (size_t)std::min<uint64_t>(count - done, end - pos);
+      ssize_t w = File::ops().pwrite_fn(seg->file.handle(), p + done, n,
+                                        (off_t)(pos - start));
+      if (w <= 0)
+        return done ? (ssize_t)done : -1;
+      seg->dirty.store(true, std::memory_order_release);
+      done += (size_t)w;
+    }
+    return (ssize_t)done;
+  }
+
+  static ssize_t pread_impl(storage_handle_t h, void *buf, size_t count,
+                            off_t offset) {
+    auto *self = static_cast<Segments *>(h);
+    uint8_t *p = static_cast<uint8_t *>(buf);
+    size_t done = 0;
+    while (done < count) {
+      uint64_t pos = (uint64_t)offset + done;
+      auto [seg, start, end] = self->locate(pos, false);
+      if (!seg)
+        break;
+      size_t n = (size_t)std::min<uint64_t>(count - done, end - pos);
+      ssize_t r = File::ops().pread_fn(seg->file.handle(), p + done, n,
+                                       (off_t)(pos - start));
+      if (r < 0)
+        return done ? (ssize_t)done : -1;
+      done += (size_t)r;
+      if ((size_t)r < n)
+        break; // End of this file: nothing readable past it
+    }
+    return (ssize_t)done;
+  }
+
+  static off_t lseek_impl(storage_handle_t h, off_t offset, int whence) {
+    auto *self = static_cast<Segments *>(h);
+    if (whence == SEEK_END)
+      return (off_t)self->end() + offset;
+    return whence == SEEK_SET ? offset : -1;
+  }
+
+  std::string dir_;
+  FileOptions opts_;
+  const uint64_t segment_bytes_;
+
+  mutable std::mutex mx_;
+  SegmentMap segs_;    // By start position
+  uint64_t limit_ = 0; // The last segment ends here
+};
+
+} // namespace wal
+
+#endif
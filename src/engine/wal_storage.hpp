@@ -1,7 +1,39 @@
 #pragma once
 
+/*
+ * WAL STORAGE BACKENDS
+ *
+ * `wal::File` owns the log file and hands libconveyor the matching
+ * `storage_operations_t`, chosen at compile time:
+ * - Windows: HANDLE + OVERLAPPED ReadFile/WriteFile.
+ * - POSIX: fd + pread/pwrite, fdatasync for durability.
+ *
+ * POSIX options (FileOptions):
+ * - `preallocate_bytes`: extend the file with fallocate() in chunks of this
+ *   size ahead of the writer, so appends do not allocate blocks or change
+ *   the file size and fdatasync() only has to flush data. The unwritten
+ *   tail reads back as zeros; recovery stops at the first zero header and
+ *   the WAL trims the tail on open and close.
+ * - `direct`: O_DIRECT. Every transfer goes through an aligned bounce
+ *   buffer; partially covered head/tail blocks are read back first.
+ *   Falls back to buffered I/O when the filesystem refuses O_DIRECT.
+ */
+
 #include "libconveyor/conveyor_modern.hpp"
 
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace wal {
+
+struct FileOptions {
+  bool direct = false;
+  uint64_t preallocate_bytes = 0; // 0 = grow on demand
+};
+
+} // namespace wal
+
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
@@ -81,8 +113,353 @@ struct WindowsStorage {
   }
 };
 
+// Direct I/O and preallocation are not implemented on Windows; the options
+// are accepted and ignored.
+class File {
+  HANDLE h_ = INVALID_HANDLE_VALUE;
+
+public:
+  File(const std::string &path, const FileOptions & = {}) {
+    h_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                     FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                     FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h_ == INVALID_HANDLE_VALUE) {
+      DWORD err = GetLastError();
+      throw std::runtime_error("Failed to open WAL file: " + path +
+                               " Error: " + std::to_string(err));
+    }
+  }
+  ~File() {
+    if (h_ != INVALID_HANDLE_VALUE)
+      CloseHandle(h_);
+  }
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  storage_handle_t handle() const { return (storage_handle_t)h_; }
+  static storage_operations_t ops() { return WindowsStorage::get_ops(); }
+  bool direct() const { return false; }
+
+  int64_t size() const {
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(h_, &sz))
+      throw std::runtime_error("WAL: Failed to get file size. Error: " +
+                               std::to_string(GetLastError()));
+    return sz.QuadPart;
+  }
+
+  bool sync() { return FlushFileBuffers(h_) != 0; }
+
+  bool truncate(int64_t len) {
+    LARGE_INTEGER li;
+    li.QuadPart = len;
+    return SetFilePointerEx(h_, li, NULL, FILE_BEGIN) && SetEndOfFile(h_);
+  }
+
+};
+
+// NTFS journals directory changes itself; there is no directory handle to
+// flush.
+inline bool sync_dir(const std::string &) { return true; }
+
 } // namespace wal
 
 #else
-// POSIX implementation placeholder
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace wal {
+
+// POSIX implementation of storage operations on a plain file descriptor.
+// Per-descriptor state (O_DIRECT bounce buffer, preallocation watermark)
+// lives in a small registry, since libconveyor only passes the handle.
+struct PosixStorage {
+  static constexpr size_t ALIGN = 4096; // Logical block size for O_DIRECT
+
+  struct State {
+    std::mutex mx;
+    bool direct = false;
+    uint64_t prealloc_chunk = 0;
+    off_t prealloc_end = 0; // File is allocated up to here
+    off_t high_water = 0;   // End of the furthest write
+    uint8_t *bounce = nullptr;
+    size_t bounce_cap = 0;
+
+    ~State() { std::free(bounce); }
+
+    uint8_t *bounce_buffer(size_t n) {
+      if (n > bounce_cap) {
+        std::free(bounce);
+        bounce = static_cast<uint8_t *>(std::aligned_alloc(ALIGN, n));
+        bounce_cap = bounce ? n : 0;
+      }
+      return bounce;
+    }
+  };
+
+  static int to_fd(storage_handle_t h) { return (int)(intptr_t)h; }
+  static storage_handle_t to_handle(int fd) {
+    return (storage_handle_t)(intptr_t)fd;
+  }
+
+  static void attach(int fd, std::shared_ptr<State> st) {
+    std::lock_guard lock(registry_mx());
+    registry()[fd] = std::move(st);
+  }
+  static void detach(int fd) {
+    std::lock_guard lock(registry_mx());
+    registry().erase(fd);
+  }
+  static std::shared_ptr<State> state(int fd) {
+    std::lock_guard lock(registry_mx());
+    auto it = registry().find(fd);
+    return it == registry().end() ? nullptr : it->second;
+  }
+
+  static ssize_t pwrite_impl(storage_handle_t handle, const void *buf,
+                             size_t count, off_t offset) {
+    int fd = to_fd(handle);
+    auto st = state(fd);
+    if (!st)
+      return pwrite_all(fd, buf, count, offset);
+
+    std::lock_guard lock(st->mx);
+    off_t end = offset + (off_t)count;
+    if (st->prealloc_chunk && end > st->prealloc_end)
+      preallocate(fd, *st, end);
+
+    ssize_t n = st->direct ? pwrite_direct(fd, *st, buf, count, offset)
+                           : pwrite_all(fd, buf, count, offset);
+    if (n > 0)
+      st->high_water = std::max(st->high_water, offset + (off_t)n);
+    return n;
+  }
+
+  static ssize_t pread_impl(storage_handle_t handle, void *buf, size_t count,
+                            off_t offset) {
+    int fd = to_fd(handle);
+    auto st = state(fd);
+    if (!st || !st->direct)
+      return pread_retry(fd, buf, count, offset);
+
+    std::lock_guard lock(st->mx);
+    return pread_direct(fd, *st, buf, count, offset);
+  }
+
+  static off_t lseek_impl(storage_handle_t handle, off_t offset, int whence) {
+    return ::lseek(to_fd(handle), offset, whence);
+  }
+
+  static storage_operations_t get_ops() {
+    return {pwrite_impl, pread_impl, lseek_impl};
+  }
+
+private:
+  static std::mutex &registry_mx() {
+    static std::mutex mx;
+    return mx;
+  }
+  static std::unordered_map<int, std::shared_ptr<State>> &registry() {
+    static std::unordered_map<int, std::shared_ptr<State>> map;
+    return map;
+  }
+
+  static off_t align_down(off_t v) { return v & ~(off_t)(ALIGN - 1); }
+  static off_t align_up(off_t v) { return align_down(v + (off_t)ALIGN - 1); }
+
+  static ssize_t pwrite_all(int fd, const void *buf, size_t count,
+                            off_t offset) {
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    size_t done = 0;
+    while (done < count) {
+      ssize_t n = ::pwrite(fd, p + done, count - done, offset + (off_t)done);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return -1;
+      }
+      done += (size_t)n;
+    }
+    return (ssize_t)done;
+  }
+
+  static ssize_t pread_retry(int fd, void *buf, size_t count, off_t offset) {
+    ssize_t n;
+    do {
+      n = ::pread(fd, buf, count, offset);
+    } while (n < 0 && errno == EINTR);
+    return n;
+  }
+
+  // Reads one aligned block into `dst`, zero-filling past EOF.
+  static bool read_block(int fd, uint8_t *dst, off_t at) {
+    ssize_t n = pread_retry(fd, dst, ALIGN, at);
+    if (n < 0)
+      return false;
+    std::memset(dst + n, 0, ALIGN - (size_t)n);
+    return true;
+  }
+
+  static ssize_t pwrite_direct(int fd, State &st, const void *buf,
+                               size_t count, off_t offset) {
+    off_t lo = align_down(offset);
+    off_t hi = align_up(offset + (off_t)count);
+    size_t span = (size_t)(hi - lo);
+    uint8_t *b = st.bounce_buffer(span);
+    if (!b) {
+      errno = ENOMEM;
+      return -1;
+    }
+
+    // Preserve bytes around the write that share its first/last block.
+    if (lo != offset && !read_block(fd, b, lo))
+      return -1;
+    off_t tail = hi - (off_t)ALIGN;
+    if (hi != offset + (off_t)count && (tail != lo || lo == offset) &&
+        !read_block(fd, b + (tail - lo), tail))
+      return -1;
+
+    std::memcpy(b + (offset - lo), buf, count);
+    if (pwrite_all(fd, b, span, lo) < 0)
+      return -1;
+    return (ssize_t)count;
+  }
+
+  static ssize_t pread_direct(int fd, State &st, void *buf, size_t count,
+                              off_t offset) {
+    off_t lo = align_down(offset);
+    off_t hi = align_up(offset + (off_t)count);
+    uint8_t *b = st.bounce_buffer((size_t)(hi - lo));
+    if (!b) {
+      errno = ENOMEM;
+      return -1;
+    }
+    ssize_t n = pread_retry(fd, b, (size_t)(hi - lo), lo);
+    if (n < 0)
+      return -1;
+    off_t skip = offset - lo;
+    if (n <= skip)
+      return 0;
+    size_t got = std::min(count, (size_t)(n - skip));
+    std::memcpy(buf, b + skip, got);
+    return (ssize_t)got;
+  }
+
+public:
+  static void preallocate(int fd, State &st, off_t end) {
+    off_t chunk = (off_t)st.prealloc_chunk;
+    off_t target = (end + chunk - 1) / chunk * chunk;
+#ifdef __linux__
+    int rc = ::fallocate(fd, 0, st.prealloc_end, target - st.prealloc_end);
+#else
+    int rc = ::posix_fallocate(fd, st.prealloc_end, target - st.prealloc_end);
+#endif
+    if (rc != 0) {
+      // Unsupported by the filesystem: grow on demand from now on.
+      st.prealloc_chunk = 0;
+      return;
+    }
+    st.prealloc_end = target;
+  }
+};
+
+class File {
+  int fd_ = -1;
+  std::shared_ptr<PosixStorage::State> st_;
+
+public:
+  File(const std::string &path, const FileOptions &opts = {}) {
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+    bool direct = false;
+#ifdef O_DIRECT
+    if (opts.direct) {
+      fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      direct = fd_ >= 0;
+    }
+#endif
+    if (fd_ < 0)
+      fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0)
+      throw std::runtime_error("Failed to open WAL file: " + path +
+                               " Error: " + std::strerror(errno));
+
+    st_ = std::make_shared<PosixStorage::State>();
+    st_->direct = direct;
+    st_->prealloc_chunk = opts.preallocate_bytes;
+    st_->prealloc_end = st_->high_water = (off_t)size();
+    PosixStorage::attach(fd_, st_);
+  }
+
+  ~File() {
+    if (fd_ < 0)
+      return;
+    // Drop the preallocated (or block-padded) tail past the last record.
+    if (st_->high_water < (off_t)size())
+      (void)::ftruncate(fd_, st_->high_water);
+    PosixStorage::detach(fd_);
+    ::close(fd_);
+  }
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  storage_handle_t handle() const { return PosixStorage::to_handle(fd_); }
+  static storage_operations_t ops() { return PosixStorage::get_ops(); }
+  bool direct() const { return st_->direct; }
+
+  int64_t size() const {
+    struct stat sb;
+    if (::fstat(fd_, &sb) != 0)
+      throw std::runtime_error(std::string("WAL: Failed to get file size: ") +
+                               std::strerror(errno));
+    return sb.st_size;
+  }
+
+  bool sync() {
+#if defined(__APPLE__)
+    return ::fsync(fd_) == 0;
+#else
+    return ::fdatasync(fd_) == 0;
+#endif
+  }
+
+  int fd() const { return fd_; }
+
+  // For writers that bypass the storage ops (io_uring): account a write
+  // ending at `end` as pwrite_impl would, preallocating ahead if enabled.
+  void reserve(int64_t end) {
+    std::lock_guard lock(st_->mx);
+    if (st_->prealloc_chunk && (off_t)end > st_->prealloc_end)
+      PosixStorage::preallocate(fd_, *st_, (off_t)end);
+    st_->high_water = std::max(st_->high_water, (off_t)end);
+  }
+
+  bool truncate(int64_t len) {
+    std::lock_guard lock(st_->mx);
+    if (::ftruncate(fd_, (off_t)len) != 0)
+      return false;
+    st_->prealloc_end = st_->high_water = (off_t)len;
+    return true;
+  }
+
+};
+
+// Makes file creations, renames and removals in `dir` durable.
+inline bool sync_dir(const std::string &dir) {
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+} // namespace wal
 #endif
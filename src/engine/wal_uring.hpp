@@ -0,0 +1,521 @@
+#ifndef L3KV_ENGINE_WAL_URING_HPP
+#define L3KV_ENGINE_WAL_URING_HPP
+
+/*
+ * IO_URING WAL WRITER (Linux)
+ *
+ * Batching:
+ * - Records are copied into one of `depth` 4 KiB-aligned buffers. A buffer
+ *   is sealed when it fills, or when a caller waits for a position it
+ *   covers. The writer's I/O thread issues it as a WRITE linked
+ *   (IOSQE_IO_LINK) to an FDATASYNC, so the kernel orders the sync after
+ *   the write without a round trip.
+ * - Up to `depth - 1` batches are in flight while the next one fills;
+ *   appenders only block when every buffer is busy.
+ *
+ * Completion:
+ * - Positions (LSNs) are log positions (wal::Segments). A batch crossing a
+ *   segment boundary is written as one WRITE per file, each file synced.
+ * - A reaper thread collects CQEs and advances `durable()` in submission
+ *   order once a batch's syncs are done.
+ * - `wait(lsn)` blocks on that, not on the WAL mutex, so every writer that
+ *   arrives while a batch is in flight shares the next sync.
+ *
+ * O_DIRECT:
+ * - Writes are padded to the block size. The partial tail block is carried
+ *   into the next buffer and rewritten there; that write is flagged
+ *   IOSQE_IO_DRAIN so it cannot overtake the earlier write of the block.
+ *
+ * Talks to the kernel through the raw syscalls (no liburing dependency).
+ */
+
+#if defined(__linux__) && !defined(_WIN32) &&                                  \
+    __has_include(<linux/io_uring.h>)
+#define L3KV_WAL_URING 1
+
+#include "wal_segments.hpp"
+#include "wal_storage.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wal {
+
+// Minimal single-issuer ring: SQ is filled under the writer's mutex, CQ is
+// drained only by the reaper thread.
+class Ring {
+  int fd_ = -1;
+  void *sq_map_ = MAP_FAILED, *cq_map_ = MAP_FAILED;
+  size_t sq_map_len_ = 0, cq_map_len_ = 0;
+  io_uring_sqe *sqes_ = (io_uring_sqe *)MAP_FAILED;
+  size_t sqes_len_ = 0;
+
+  unsigned *sq_tail_ = nullptr, *sq_mask_ = nullptr, *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr, *cq_mask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned pending_ = 0; // SQEs queued since the last submit()
+
+public:
+  Ring() = default;
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  ~Ring() {
+    if (sqes_ != MAP_FAILED)
+      munmap(sqes_, sqes_len_);
+    if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_)
+      munmap(cq_map_, cq_map_len_);
+    if (sq_map_ != MAP_FAILED)
+      munmap(sq_map_, sq_map_len_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  // Returns 0 or -errno (ENOSYS / EPERM where io_uring is unavailable).
+  int init(unsigned entries) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd_ < 0)
+      return -errno;
+
+    sq_map_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_map_len_ = cq_map_len_ = std::max(sq_map_len_, cq_map_len_);
+
+    sq_map_ = mmap(nullptr, sq_map_len_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED)
+      return -errno;
+    cq_map_ = single ? sq_map_
+                     : mmap(nullptr, cq_map_len_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_map_ == MAP_FAILED)
+      return -errno;
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe *)mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, fd_,
+                                 IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED)
+      return -errno;
+
+    auto *sq = (uint8_t *)sq_map_;
+    auto *cq = (uint8_t *)cq_map_;
+    sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask_ = (unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *)(sq + p.sq_off.array);
+    cq_head_ = (unsigned *)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask_ = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+  }
+
+  // The ring is sized so the SQ never fills: at most four SQEs per buffer
+  // (a buffer spans at most two segments) plus one stop NOP are ever queued.
+  io_uring_sqe *next_sqe() {
+    unsigned tail = *sq_tail_ + pending_;
+    unsigned idx = tail & *sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++pending_;
+    return sqe;
+  }
+
+  int submit() {
+    unsigned n = pending_;
+    pending_ = 0;
+    __atomic_store_n(sq_tail_, *sq_tail_ + n, __ATOMIC_RELEASE);
+    while (n > 0) {
+      int r = (int)syscall(__NR_io_uring_enter, fd_, n, 0, 0, nullptr, 0);
+      if (r < 0) {
+        if (errno == EINTR)
+          continue;
+        return -errno;
+      }
+      n -= (unsigned)r;
+    }
+    return 0;
+  }
+
+  // Blocks until at least one CQE is available, then hands each to `fn`.
+  template <class Fn> int reap(Fn &&fn) {
+    unsigned head = *cq_head_;
+    while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      int r = (int)syscall(__NR_io_uring_enter, fd_, 0, 1,
+                           IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r < 0 && errno != EINTR)
+        return -errno;
+    }
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+      fn(cqes_[head & *cq_mask_]);
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return 0;
+  }
+};
+
+class UringWriter {
+public:
+  static constexpr size_t ALIGN = PosixStorage::ALIGN;
+
+  struct Options {
+    unsigned depth = 4;            // Buffers, at least 2
+    size_t buffer_bytes = 1 << 20; // Rounded up to ALIGN
+  };
+
+  struct Stats {
+    uint64_t bytes_written = 0;
+    uint64_t batches = 0;
+    uint64_t buffer_full_events = 0; // Appender waited for a free buffer
+    uint64_t total_latency_us = 0;   // Seal -> durable, summed
+  };
+
+  // Null if io_uring is unavailable (old kernel, seccomp); the caller falls
+  // back to the conveyor path.
+  static std::unique_ptr<UringWriter> create(Segments &segs, uint64_t start,
+                                             Options opts) {
+    std::unique_ptr<UringWriter> w(new UringWriter(segs, start, opts));
+    int err = w->ring_.init(4 * (unsigned)w->slots_.size() + 2);
+    if (err < 0) {
+      std::cerr << "WAL: io_uring unavailable (" << std::strerror(-err)
+                << ")\n";
+      return nullptr;
+    }
+    if (!w->load_tail_block())
+      return nullptr;
+    w->io_thread_ = std::thread([p = w.get()] { p->io_loop(); });
+    return w;
+  }
+
+  ~UringWriter() {
+    if (io_thread_.joinable()) {
+      wait(appended());
+      {
+        std::lock_guard lock(mx_);
+        doorbell(STOP);
+      }
+      io_thread_.join();
+    }
+    for (auto &s : slots_)
+      std::free(s.buf);
+  }
+
+  UringWriter(const UringWriter &) = delete;
+  UringWriter &operator=(const UringWriter &) = delete;
+
+  // Queues a record; returns the position just past it.
+  uint64_t append(const void *data, size_t n) {
+    // seal_locked() may drop mx_ mid-record; keep other records out of
+    // the gap so every record stays contiguous in the log.
+    std::lock_guard order(append_mx_);
+    std::unique_lock lock(mx_);
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (n > 0) {
+      Slot &s = slots_[cur_];
+      size_t take = std::min(n, cap_ - s.len);
+      std::memcpy(s.buf + s.len, p, take);
+      s.len += take;
+      p += take;
+      n -= take;
+      if (s.len == cap_)
+        seal_locked(lock);
+    }
+    return slots_[cur_].base + slots_[cur_].len;
+  }
+
+  // Blocks until everything before `lsn` is on stable storage. Seals the
+  // partially filled buffer if it holds part of that range.
+  bool wait(uint64_t lsn) {
+    std::unique_lock lock(mx_);
+    if (lsn > sealed_)
+      seal_locked(lock);
+    cv_.wait(lock, [&] { return durable_ >= lsn || failed_; });
+    return durable_ >= lsn;
+  }
+
+  uint64_t appended() const {
+    std::lock_guard lock(mx_);
+    return slots_[cur_].base + slots_[cur_].len;
+  }
+
+  uint64_t durable() const {
+    std::lock_guard lock(mx_);
+    return durable_;
+  }
+
+  Stats stats() const {
+    std::lock_guard lock(mx_);
+    return stats_;
+  }
+
+private:
+  static constexpr uint64_t WAKE = ~0ull - 1;
+  static constexpr uint64_t STOP = ~0ull;
+
+  enum class State : uint8_t { FILLING, SEALED, IN_FLIGHT };
+
+  struct Slot {
+    uint8_t *buf = nullptr;
+    uint64_t base = 0; // File offset of buf[0]
+    size_t len = 0;    // Bytes of buf holding log data
+    size_t wlen = 0;   // Bytes written (len padded for O_DIRECT)
+    State state = State::FILLING;
+    bool drain = false; // Rewrites a block an earlier batch also wrote
+    size_t piece_len[2] = {0, 0}; // Per-segment WRITE lengths
+    int pending = 0;    // CQEs still expected
+    int res = 0;        // First error
+    std::chrono::steady_clock::time_point sealed;
+  };
+
+  UringWriter(Segments &segs, uint64_t start, Options opts)
+      : segs_(segs), direct_(segs.direct()),
+        cap_((std::clamp<size_t>(opts.buffer_bytes, 2 * ALIGN,
+                                 segs.segment_bytes()) +
+              ALIGN - 1) &
+             ~(ALIGN - 1)),
+        slots_(std::max(opts.depth, 2u)), durable_(start), sealed_(start) {
+    for (auto &s : slots_)
+      s.buf = static_cast<uint8_t *>(std::aligned_alloc(ALIGN, cap_));
+    slots_[0].base = start;
+  }
+
+  bool load_tail_block() {
+    if (!direct_)
+      return true;
+    // O_DIRECT: start on a block boundary with the partial block preloaded
+    Slot &s = slots_[0];
+    uint64_t base = s.base & ~(uint64_t)(ALIGN - 1);
+    size_t carry = (size_t)(s.base - base);
+    if (carry && segs_.read(s.buf, ALIGN, base) < (ssize_t)carry) {
+      std::cerr << "WAL: io_uring failed to read tail block\n";
+      return false;
+    }
+    s.base = base;
+    s.len = carry;
+    return true;
+  }
+
+  // A NOP completes inline, so any thread may ring it; it only wakes the
+  // I/O thread out of its CQ wait.
+  void doorbell(uint64_t tag) {
+    io_uring_sqe *sqe = ring_.next_sqe();
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = tag;
+    int err = ring_.submit();
+    if (err < 0)
+      fail_locked("submit", err);
+  }
+
+  void fail_locked(const char *what, int err) {
+    std::cerr << "WAL: io_uring " << what << " failed: " << std::strerror(-err)
+              << "\n";
+    failed_ = true;
+    cv_.notify_all();
+  }
+
+  // Hands slots_[cur_] (if it holds unsealed data) to the I/O thread and
+  // moves on to the next buffer. Waits first if that one is still busy;
+  // cur_ keeps accepting appends meanwhile.
+  void seal_locked(std::unique_lock<std::mutex> &lock) {
+    size_t next;
+    for (;;) {
+      if (failed_)
+        return;
+      Slot &s = slots_[cur_];
+      if (s.base + s.len <= sealed_)
+        return;
+      next = (cur_ + 1) % slots_.size();
+      if (slots_[next].state == State::FILLING)
+        break;
+      ++stats_.buffer_full_events;
+      cv_.wait(lock);
+    }
+
+    Slot &s = slots_[cur_];
+    s.state = State::SEALED;
+    s.sealed = std::chrono::steady_clock::now();
+    sealed_ = s.base + s.len;
+
+    // With O_DIRECT the partial last block is rewritten by the next batch
+    Slot &n = slots_[next];
+    size_t whole = direct_ ? (s.len & ~(ALIGN - 1)) : s.len;
+    n.base = s.base + whole;
+    n.len = s.len - whole;
+    n.drain = n.len > 0;
+    if (n.len)
+      std::memcpy(n.buf, s.buf + whole, n.len);
+    cur_ = next;
+    doorbell(WAKE);
+  }
+
+  // Queues every sealed buffer as WRITE -> FDATASYNC. Only the I/O thread
+  // issues real I/O: io_uring may finish a request in the context of the
+  // task that submitted it, and appender threads can exit at any time.
+  void issue_locked() {
+    unsigned n = 0;
+    while (slots_[issue_].state == State::SEALED) {
+      Slot &s = slots_[issue_];
+      s.wlen = s.len;
+      if (direct_) {
+        s.wlen = (s.len + ALIGN - 1) & ~(ALIGN - 1);
+        std::memset(s.buf + s.len, 0, s.wlen - s.len);
+      }
+      segs_.for_each_extent(s.base, s.len, [](File &f, uint64_t off,
+                                              size_t, size_t len) {
+        f.reserve((int64_t)(off + len));
+      });
+
+      // WRITE per segment, then FDATASYNC per segment, all linked
+      struct Piece {
+        int fd;
+        uint64_t off;
+        size_t at, len;
+      } pieces[2];
+      int np = 0;
+      bool ok = segs_.for_each_extent(
+          s.base, s.wlen, [&](File &f, uint64_t off, size_t at, size_t len) {
+            if (np < 2)
+              pieces[np] = {f.fd(), off, at, len};
+            ++np;
+          });
+      if (!ok || np > 2) {
+        fail_locked("segment lookup", -EINVAL);
+        return;
+      }
+      for (int i = 0; i < np; ++i) {
+        io_uring_sqe *w = ring_.next_sqe();
+        w->opcode = IORING_OP_WRITE;
+        w->fd = pieces[i].fd;
+        w->addr = (uint64_t)(uintptr_t)(s.buf + pieces[i].at);
+        w->len = (uint32_t)pieces[i].len;
+        w->off = pieces[i].off;
+        w->flags = IOSQE_IO_LINK | (i == 0 && s.drain ? IOSQE_IO_DRAIN : 0);
+        w->user_data = issue_ << 2 | (uint64_t)i << 1;
+        s.piece_len[i] = pieces[i].len;
+      }
+      for (int i = 0; i < np; ++i) {
+        io_uring_sqe *f = ring_.next_sqe();
+        f->opcode = IORING_OP_FSYNC;
+        f->fd = pieces[i].fd;
+        f->fsync_flags = IORING_FSYNC_DATASYNC;
+        f->flags = i + 1 < np ? IOSQE_IO_LINK : 0;
+        f->user_data = issue_ << 2 | (uint64_t)i << 1 | 1;
+      }
+
+      s.state = State::IN_FLIGHT;
+      s.pending = 2 * np;
+      s.res = 0;
+      issue_ = (issue_ + 1) % slots_.size();
+      ++n;
+    }
+    if (n) {
+      int err = ring_.submit();
+      if (err < 0)
+        fail_locked("submit", err);
+    }
+  }
+
+  void io_loop() {
+    bool stop = false;
+    while (!stop) {
+      {
+        std::lock_guard lock(mx_);
+        issue_locked();
+      }
+
+      std::vector<std::pair<uint64_t, int>> done;
+      int err = ring_.reap([&](const io_uring_cqe &c) {
+        done.emplace_back(c.user_data, c.res);
+      });
+
+      std::lock_guard lock(mx_);
+      if (err < 0) {
+        fail_locked("wait", err);
+        return;
+      }
+      for (auto [tag, res] : done) {
+        if (tag == STOP)
+          stop = true;
+        if (tag == WAKE || tag == STOP)
+          continue;
+        Slot &s = slots_[tag >> 2];
+        if (!(tag & 1) && res >= 0) {
+          stats_.bytes_written += (uint64_t)res;
+          if ((size_t)res != s.piece_len[(tag >> 1) & 1])
+            res = -EIO; // Short write
+        }
+        if (res < 0 && s.res == 0)
+          s.res = res; // A failed WRITE cancels its FDATASYNC
+        --s.pending;
+      }
+      retire_locked();
+    }
+  }
+
+  // Retires completed batches in submission order.
+  void retire_locked() {
+    bool progressed = false;
+    while (slots_[head_].state == State::IN_FLIGHT &&
+           slots_[head_].pending == 0) {
+      Slot &s = slots_[head_];
+      if (s.res < 0) {
+        fail_locked("write", s.res);
+      } else {
+        durable_ = std::max(durable_, s.base + s.len);
+        ++stats_.batches;
+        stats_.total_latency_us +=
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - s.sealed)
+                .count();
+      }
+      s.state = State::FILLING;
+      s.len = 0;
+      head_ = (head_ + 1) % slots_.size();
+      progressed = true;
+    }
+    if (progressed)
+      cv_.notify_all();
+  }
+
+  Segments &segs_;
+  const bool direct_;
+  const size_t cap_;
+  Ring ring_;
+  std::thread io_thread_;
+
+  std::mutex append_mx_; // Taken before mx_
+  mutable std::mutex mx_;
+  std::condition_variable cv_;
+  std::vector<Slot> slots_;
+  size_t cur_ = 0;   // Buffer being filled
+  size_t issue_ = 0; // Next buffer to hand to the kernel
+  size_t head_ = 0;  // Oldest buffer possibly in flight
+  uint64_t durable_;
+  uint64_t sealed_;
+  bool failed_ = false;
+  Stats stats_;
+};
+
+} // namespace wal
+
+#endif
+#endif
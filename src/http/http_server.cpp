@@ -1,7 +1,9 @@
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
+#ifdef _WIN32
 #include <winsock2.h>
+#endif
 
 // Fix conflict with Boost.Beast
 #ifdef off_t
@@ -13,8 +15,10 @@
 #include <boost/asio/dispatch.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/config.hpp>
+#include <cctype>
 #include <chrono>
 #include <csignal>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -25,6 +29,7 @@
 #include "engine/store.hpp"
 #include "json.hpp"
 #include "observability/simple_metrics.hpp"
+#include "value_body.hpp"
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -135,6 +140,23 @@ private:
     return res;
   }
 
+  // Decodes %XX escapes and '+' in a query parameter.
+  static std::string url_decode(std::string_view in) {
+    std::string out;
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); ++i) {
+      if (in[i] == '%' && i + 2 < in.size() &&
+          std::isxdigit((unsigned char)in[i + 1]) &&
+          std::isxdigit((unsigned char)in[i + 2])) {
+        out += (char)std::stoi(std::string(in.substr(i + 1, 2)), nullptr, 16);
+        i += 2;
+      } else {
+        out += in[i] == '+' ? ' ' : in[i];
+      }
+    }
+    return out;
+  }
+
   void handle_request() {
     ScopedMetric sm("handler_total");
     auto const bad_req = [&](beast::string_view why) {
@@ -145,6 +167,15 @@ private:
       res.prepare_payload();
       return res;
     };
+    // Write not durable (WAL write or sync failed)
+    auto const unavailable = [&](beast::string_view why) {
+      http::response<http::string_body> res{
+          http::status::service_unavailable, req_.version()};
+      res.set(http::field::server, "Lite3");
+      res.body() = std::string(why);
+      res.prepare_payload();
+      return res;
+    };
 
 #include "dashboard.hpp"
 
@@ -183,8 +214,31 @@ private:
     }
 
     if (req_.method() == http::verb::get && target == "/kv/health") {
-      http::response<http::empty_body> res{http::status::ok, req_.version()};
+      // Recovery progress. A recovering node serves the shards it has
+      // replayed (requests for the others wait), so it reports 200.
+      using Phase = l3kv::RecoveryProgress::Phase;
+      auto rec = db_.recovery_progress();
+      static constexpr const char *PHASES[] = {"snapshot", "log", "replay",
+                                               "done", "failed"};
+      json j;
+      j["status"] = rec.phase == Phase::DONE     ? "ok"
+                    : rec.phase == Phase::FAILED ? "failed"
+                                                 : "recovering";
+      j["recovery"] = {{"phase", PHASES[(int)rec.phase]},
+                       {"shards_ready", rec.shards_ready},
+                       {"shards", rec.shards},
+                       {"snapshot_entries", rec.snapshot_entries},
+                       {"elapsed_ms", rec.elapsed_ms}};
+      if (rec.phase == Phase::FAILED)
+        j["recovery"]["error"] = rec.error;
+
+      http::response<http::string_body> res{
+          rec.phase == Phase::FAILED ? http::status::service_unavailable
+                                     : http::status::ok,
+          req_.version()};
       res.set(http::field::server, "Lite3");
+      res.set(http::field::content_type, "application/json");
+      res.body() = j.dump();
       res.keep_alive(req_.keep_alive());
       res.prepare_payload();
       return send_response(std::move(res));
@@ -212,6 +266,26 @@ private:
       body += "Buffer Full Events: " +
               std::to_string(wal_stats.write_buffer_full_events) + "\n";
 
+      auto mem = db_.memory_stats();
+      body += "\n=== Value Memory (shard arenas) ===\n";
+      body += "Live Bytes: " + std::to_string(mem.live_bytes) + "\n";
+      body += "Live Values: " + std::to_string(mem.live_allocs) + "\n";
+      body += "Reserved Bytes: " + std::to_string(mem.reserved_bytes) + "\n";
+      body += "Value Pages: " + std::to_string(db_.live_pages()) + "\n";
+
+      auto tier = db_.tier_stats();
+      body += "\n=== Value Log (evicted values) ===\n";
+      body += "Evicted: " + std::to_string(tier.evicted) + "\n";
+      body += "Faulted In: " + std::to_string(tier.faulted) + "\n";
+      body += "Log Bytes: " + std::to_string(tier.log.bytes) + "\n";
+      body += "Dead Bytes: " + std::to_string(tier.log.dead_bytes) + "\n";
+      body += "Compactions: " + std::to_string(tier.compactions) + "\n";
+
+      auto delta = db_.delta_stats();
+      body += "\n=== Patch Buffer ===\n";
+      body += "Buffered Patches: " + std::to_string(delta.buffered) + "\n";
+      body += "Folds: " + std::to_string(delta.folded) + "\n";
+
       http::response<http::string_body> res{http::status::ok, req_.version()};
       res.set(http::field::server, "Lite3");
       res.body() = std::move(body);
@@ -289,6 +363,189 @@ private:
       return send_response(std::move(res));
     }
 
+    // Ordered scan of this node's keys, one page per request:
+    //   GET /scan?prefix=P | start=A&end=B [&limit=N] [&cursor=C]
+    // Returns {"keys": [...], "cursor": C}; pass the cursor back for the
+    // next page, it is empty after the last one.
+    if (req_.method() == http::verb::get &&
+        (target == "/scan" || target.starts_with("/scan?"))) {
+      if (!db_.ordered_index()) {
+        http::response<http::string_body> res{http::status::not_implemented,
+                                              req_.version()};
+        res.set(http::field::server, "Lite3");
+        res.body() = "Ordered index is off (storage.ordered_index)";
+        res.keep_alive(req_.keep_alive());
+        res.prepare_payload();
+        return send_response(std::move(res));
+      }
+      auto qpos = target.find('?');
+      auto params = qpos == std::string::npos
+                        ? std::map<std::string, std::string>()
+                        : parse_query(target.substr(qpos + 1));
+      for (auto &[k, v] : params)
+        v = url_decode(v);
+      l3kv::KeyRange range = params.count("prefix")
+                                 ? l3kv::KeyRange::prefix(params["prefix"])
+                                 : l3kv::KeyRange{params["start"],
+                                                  params["end"]};
+      size_t limit = 100;
+      try {
+        if (params.count("limit"))
+          limit = std::clamp<size_t>(std::stoul(params["limit"]), 1, 1000);
+        auto page = db_.scan(range, limit, params["cursor"], false);
+        json keys = json::array();
+        for (auto &[key, value] : page.entries)
+          keys.push_back(key);
+        json j;
+        j["keys"] = std::move(keys);
+        j["cursor"] = page.cursor;
+
+        http::response<http::string_body> res{http::status::ok,
+                                              req_.version()};
+        res.set(http::field::server, "Lite3");
+        res.set(http::field::content_type, "application/json");
+        res.body() = j.dump();
+        res.keep_alive(req_.keep_alive());
+        res.prepare_payload();
+        return send_response(std::move(res));
+      } catch (const std::exception &e) {
+        return send_response(bad_req(e.what()));
+      }
+    }
+
+    // Batch read, binary framed (integers little-endian):
+    //   Request:  [KeyLen:2][Key] per key
+    //   Response: [Status:1][Len:4][Value] per key, in request order.
+    //             Status 0 = not found, 1 = found, 2 = owned by another
+    //             node (sharded mode; ask it).
+    if (req_.method() == http::verb::post && target == "/mget") {
+      constexpr size_t MAX_KEYS = 10000;
+      const std::string &in = req_.body();
+      std::vector<std::string_view> keys;
+      for (size_t p = 0; p < in.size();) {
+        uint16_t len;
+        if (p + 2 > in.size() || keys.size() == MAX_KEYS)
+          return send_response(bad_req("Malformed or oversized batch"));
+        std::memcpy(&len, in.data() + p, 2);
+        if (p + 2 + len > in.size())
+          return send_response(bad_req("Malformed or oversized batch"));
+        keys.emplace_back(in.data() + p + 2, len);
+        p += 2 + len;
+      }
+      std::vector<uint8_t> remote(keys.size(), 0);
+      std::vector<std::string_view> local;
+      for (size_t i = 0; i < keys.size(); ++i) {
+        uint32_t owner = ring_ ? ring_->get_node(std::string(keys[i])) : 0;
+        remote[i] = owner != self_node_id_ && owner != 0;
+        if (!remote[i])
+          local.push_back(keys[i]);
+      }
+
+      auto values = db_.multi_get(local);
+      size_t bytes = 5 * keys.size();
+      for (auto &v : values)
+        bytes += v.size();
+      std::string body;
+      body.reserve(bytes);
+      for (size_t i = 0, j = 0; i < keys.size(); ++i) {
+        const l3kv::ValueRef *v = remote[i] ? nullptr : &values[j++];
+        uint32_t len = v ? (uint32_t)v->size() : 0;
+        body += (char)(remote[i] ? 2 : *v ? 1 : 0);
+        body.append((const char *)&len, 4);
+        if (len > 0)
+          for (auto chunk : v->chunks())
+            body.append((const char *)chunk.data(), chunk.size());
+      }
+
+      http::response<http::string_body> res{http::status::ok, req_.version()};
+      res.set(http::field::server, "Lite3");
+      res.set(http::field::content_type, "application/octet-stream");
+      res.body() = std::move(body);
+      res.keep_alive(req_.keep_alive());
+      res.prepare_payload();
+      return send_response(std::move(res));
+    }
+
+    // Batch write, applied with one WAL record (Engine::write_batch).
+    // Binary framed, integers little-endian, per op:
+    //   [Op:1][KeyLen:2][Key][FieldLen:2][Field][ValLen:4][Val]
+    //   Op 1 = PUT (Val = document), 2 = set_int (Val = Int:8),
+    //   3 = set_str (Val = string), 4 = DELETE. Field is empty for 1 and 4.
+    // In sharded mode every key must be owned by this node, or nothing is
+    // written.
+    if (req_.method() == http::verb::post && target == "/bulk") {
+      constexpr size_t MAX_OPS = 100000;
+      const std::string &in = req_.body();
+      std::vector<l3kv::WriteOp> ops;
+      for (size_t p = 0; p < in.size();) {
+        uint8_t op;
+        uint16_t klen, flen;
+        uint32_t vlen;
+        if (p + 3 > in.size() || ops.size() == MAX_OPS)
+          return send_response(bad_req("Malformed or oversized batch"));
+        op = (uint8_t)in[p];
+        std::memcpy(&klen, in.data() + p + 1, 2);
+        size_t f = p + 3 + klen;
+        if (f + 2 > in.size())
+          return send_response(bad_req("Malformed or oversized batch"));
+        std::memcpy(&flen, in.data() + f, 2);
+        size_t v = f + 2 + flen;
+        if (v + 4 > in.size())
+          return send_response(bad_req("Malformed or oversized batch"));
+        std::memcpy(&vlen, in.data() + v, 4);
+        if (vlen > in.size() - v - 4)
+          return send_response(bad_req("Malformed or oversized batch"));
+        std::string key(in.data() + p + 3, klen);
+        std::string field(in.data() + f + 2, flen);
+        std::string val(in.data() + v + 4, vlen);
+        p = v + 4 + vlen;
+
+        if (ring_) {
+          uint32_t owner = ring_->get_node(key);
+          if (owner != self_node_id_ && owner != 0)
+            return send_response(bad_req("Key " + key + " is owned by node " +
+                                         std::to_string(owner)));
+        }
+        switch (op) {
+        case 1:
+          ops.push_back(l3kv::WriteOp::put(std::move(key), std::move(val)));
+          break;
+        case 2: {
+          int64_t num;
+          if (vlen != 8)
+            return send_response(bad_req("set_int value is not 8 bytes"));
+          std::memcpy(&num, val.data(), 8);
+          ops.push_back(
+              l3kv::WriteOp::patch_int(std::move(key), std::move(field), num));
+          break;
+        }
+        case 3:
+          ops.push_back(l3kv::WriteOp::patch_str(
+              std::move(key), std::move(field), std::move(val)));
+          break;
+        case 4:
+          ops.push_back(l3kv::WriteOp::del(std::move(key)));
+          break;
+        default:
+          return send_response(bad_req("Unknown op"));
+        }
+      }
+
+      try {
+        db_.write_batch(ops);
+        http::response<http::empty_body> res{http::status::ok, req_.version()};
+        res.keep_alive(req_.keep_alive());
+        res.prepare_payload();
+        return send_response(std::move(res));
+      } catch (const l3kv::DurabilityError &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return send_response(unavailable(e.what()));
+      } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return send_response(bad_req(e.what()));
+      }
+    }
+
     if (req_.method() == http::verb::get && target.starts_with("/kv/")) {
       std::string key = target.substr(4);
 
@@ -300,9 +557,8 @@ private:
         }
       }
 
-      lite3cpp::Buffer buffer_data =
-          db_.get(key);              // db.get now returns a Buffer
-      if (buffer_data.size() == 0) { // Check if buffer is empty
+      l3kv::ValueRef value = db_.get(key); // Shared handle, no copy
+      if (value.empty()) {
         http::response<http::empty_body> res{http::status::not_found,
                                              req_.version()};
         res.keep_alive(req_.keep_alive());
@@ -314,14 +570,12 @@ private:
       // The user specified "reads should also not be serialized".
       // We return the raw lite3 internal buffer. Clients must handle it.
 
-      http::response<http::string_body> res{http::status::ok, req_.version()};
+      http::response<value_body> res{http::status::ok, req_.version()};
       res.set(http::field::server, "Lite3");
       res.set(http::field::content_type, "application/octet-stream");
-      // Cast raw bytes to string body (copy)
-      const char *ptr = reinterpret_cast<const char *>(buffer_data.data());
-      if (ptr && buffer_data.size() > 0) {
-        res.body().assign(ptr, buffer_data.size());
-      }
+      // The body points at the stored bytes; the handle keeps them alive
+      // until the write completes.
+      res.body() = std::move(value);
       res.keep_alive(req_.keep_alive());
       res.prepare_payload();
       return send_response(std::move(res));
@@ -344,6 +598,9 @@ private:
         res.keep_alive(req_.keep_alive());
         res.prepare_payload();
         return send_response(std::move(res));
+      } catch (const l3kv::DurabilityError &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return send_response(unavailable(e.what()));
       } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << "\n";
         return send_response(bad_req(e.what()));
@@ -366,20 +623,27 @@ private:
 
       auto params = parse_query(target.substr(qpos + 1));
 
-      if (params["op"] == "set_int") {
-        int64_t val = std::stoll(params["val"]);
-        db_.patch_int(key, params["field"], val);
-        http::response<http::empty_body> res{http::status::ok, req_.version()};
-        res.keep_alive(req_.keep_alive());
-        res.prepare_payload();
-        return send_response(std::move(res));
-      }
-      if (params["op"] == "set_str") {
-        db_.patch_str(key, params["field"], params["val"]);
-        http::response<http::empty_body> res{http::status::ok, req_.version()};
-        res.keep_alive(req_.keep_alive());
-        res.prepare_payload();
-        return send_response(std::move(res));
+      try {
+        if (params["op"] == "set_int") {
+          int64_t val = std::stoll(params["val"]);
+          db_.patch_int(key, params["field"], val);
+          http::response<http::empty_body> res{http::status::ok,
+                                               req_.version()};
+          res.keep_alive(req_.keep_alive());
+          res.prepare_payload();
+          return send_response(std::move(res));
+        }
+        if (params["op"] == "set_str") {
+          db_.patch_str(key, params["field"], params["val"]);
+          http::response<http::empty_body> res{http::status::ok,
+                                               req_.version()};
+          res.keep_alive(req_.keep_alive());
+          res.prepare_payload();
+          return send_response(std::move(res));
+        }
+      } catch (const l3kv::DurabilityError &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return send_response(unavailable(e.what()));
       }
       return send_response(bad_req("Unknown op"));
     }
@@ -395,7 +659,14 @@ private:
         }
       }
 
-      if (db_.del(key)) {
+      bool existed;
+      try {
+        existed = db_.del(key);
+      } catch (const l3kv::DurabilityError &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return send_response(unavailable(e.what()));
+      }
+      if (existed) {
         http::response<http::empty_body> res{http::status::ok, req_.version()};
         res.keep_alive(req_.keep_alive());
         res.prepare_payload();
@@ -467,7 +738,11 @@ http_server::http_server(l3kv::Engine &db, std::string address,
                          uint32_t node_id,
                          std::map<uint32_t, std::pair<std::string, int>> peers)
     : address_(std::move(address)), port_(port), ioc_(max_threads),
+#ifdef _WIN32
       signals_(ioc_, SIGINT, SIGTERM, SIGBREAK),
+#else
+      signals_(ioc_, SIGINT, SIGTERM),
+#endif
       acceptor_(ioc_, {net::ip::make_address(address_), port_}), db_(db),
       min_threads_(min_threads), max_threads_(max_threads),
       manager_timer_(ioc_), ring_(ring), self_node_id_(node_id),
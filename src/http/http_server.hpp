@@ -6,7 +6,9 @@
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
+#ifdef _WIN32
 #include <winsock2.h>
+#endif
 
 #include "engine/store.hpp"
 #include "kalman_filter.hpp"
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "engine/store.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace http_server {
+
+// Beast Body that serializes an l3kv::ValueRef straight from the stored
+// bytes. The response owns the handle, so the value stays alive until the
+// async write completes and is never copied into a string. A paged value
+// goes out as one scatter/gather buffer sequence, a buffer per page.
+struct value_body {
+  using value_type = l3kv::ValueRef;
+
+  static std::uint64_t size(const value_type &v) { return v.size(); }
+
+  class writer {
+    const value_type &body_;
+
+  public:
+    using const_buffers_type = std::vector<boost::asio::const_buffer>;
+
+    template <bool isRequest, class Fields>
+    writer(const boost::beast::http::header<isRequest, Fields> &,
+           const value_type &body)
+        : body_(body) {}
+
+    void init(boost::beast::error_code &ec) { ec = {}; }
+
+    boost::optional<std::pair<const_buffers_type, bool>>
+    get(boost::beast::error_code &ec) {
+      ec = {};
+      const_buffers_type buffers;
+      for (auto chunk : body_.chunks())
+        buffers.emplace_back(chunk.data(), chunk.size());
+      return {{std::move(buffers), false}};
+    }
+  };
+};
+
+} // namespace http_server
@@ -5,7 +5,9 @@
 #define NOMINMAX
 #endif
 
+#ifdef _WIN32
 #include <winsock2.h>
+#endif
 
 #include "engine/mesh.hpp"
 #include "engine/store.hpp"
@@ -42,6 +44,25 @@ struct Config {
   int min_threads = 4;
   int max_threads = 16;
   std::string wal_path = "data.wal";
+  bool wal_direct_io = false;          // O_DIRECT (POSIX only)
+  uint64_t wal_preallocate_mb = 0;     // fallocate() chunk, 0 = off
+  std::string wal_writer = "buffered"; // "buffered" or "io_uring" (Linux)
+  unsigned wal_uring_depth = 4;
+  uint32_t wal_buffer_mb = 16;         // Log buffer ring (buffered writer)
+  uint32_t wal_segment_mb = 64;
+  uint32_t checkpoint_mb = 256;        // WAL growth per checkpoint, 0 = off
+  std::string checkpoint_format = "snapshot"; // "snapshot" or "heap"
+  unsigned recovery_threads = 0;       // WAL replay threads, 0 = per core
+  bool background_recovery = false;    // Serve while shards are replayed
+  uint64_t memory_budget_mb = 0;       // Value memory, 0 = no tiering
+  uint32_t value_log_file_mb = 64;
+  uint32_t patch_buffer_min_kb = 16;   // Documents patched as deltas, 0 = off
+  uint32_t patch_fold_bytes = 512;     // Deltas folded in past this size
+  uint32_t paged_value_min_kb = 1024;  // Values stored as pages, 0 = off
+  bool ordered_index = false;          // Key order for /scan
+  std::string durability = "none";     // "none", "group" or "always"
+  uint32_t group_commit_us = 500;
+  uint32_t group_commit_kb = 256;
   uint32_t node_id = 1;
   int mesh_port = 9090;
   int mesh_threads = 2; // Default to 2 for thread pool
@@ -72,6 +93,37 @@ Config load_config(const std::string &path) {
     cfg.mesh_port = j.value("mesh_port", cfg.mesh_port);
     cfg.mesh_threads = j.value("mesh_threads", cfg.mesh_threads);
 
+    if (j.contains("storage")) {
+      auto &s = j["storage"];
+      cfg.wal_path = s.value("wal_path", cfg.wal_path);
+      cfg.wal_direct_io = s.value("direct_io", cfg.wal_direct_io);
+      cfg.wal_preallocate_mb =
+          s.value("preallocate_mb", cfg.wal_preallocate_mb);
+      cfg.wal_writer = s.value("wal_writer", cfg.wal_writer);
+      cfg.wal_uring_depth = s.value("io_uring_depth", cfg.wal_uring_depth);
+      cfg.wal_buffer_mb = s.value("buffer_mb", cfg.wal_buffer_mb);
+      cfg.wal_segment_mb = s.value("segment_mb", cfg.wal_segment_mb);
+      cfg.checkpoint_mb = s.value("checkpoint_mb", cfg.checkpoint_mb);
+      cfg.checkpoint_format =
+          s.value("checkpoint_format", cfg.checkpoint_format);
+      cfg.recovery_threads =
+          s.value("recovery_threads", cfg.recovery_threads);
+      cfg.background_recovery =
+          s.value("background_recovery", cfg.background_recovery);
+      cfg.memory_budget_mb = s.value("memory_budget_mb", cfg.memory_budget_mb);
+      cfg.value_log_file_mb =
+          s.value("value_log_file_mb", cfg.value_log_file_mb);
+      cfg.patch_buffer_min_kb =
+          s.value("patch_buffer_min_kb", cfg.patch_buffer_min_kb);
+      cfg.patch_fold_bytes = s.value("patch_fold_bytes", cfg.patch_fold_bytes);
+      cfg.paged_value_min_kb =
+          s.value("paged_value_min_kb", cfg.paged_value_min_kb);
+      cfg.ordered_index = s.value("ordered_index", cfg.ordered_index);
+      cfg.durability = s.value("durability", cfg.durability);
+      cfg.group_commit_us = s.value("group_commit_us", cfg.group_commit_us);
+      cfg.group_commit_kb = s.value("group_commit_kb", cfg.group_commit_kb);
+    }
+
     if (j.contains("cluster")) {
       auto &c = j["cluster"];
       cfg.cluster_mode = c.value("mode", cfg.cluster_mode);
@@ -129,7 +181,10 @@ int main(int argc, char *argv[]) {
     std::cout << "  Address: " << cfg.address << ":" << cfg.port << std::endl;
     std::cout << "  Threads: " << cfg.min_threads << "-" << cfg.max_threads
               << "(Dynamic)" << std::endl;
-    std::cout << "  WAL Path: " << cfg.wal_path << std::endl;
+    std::cout << "  WAL Path: " << cfg.wal_path
+              << (cfg.wal_direct_io ? " (direct I/O)" : "") << std::endl;
+    std::cout << "  WAL Writer: " << cfg.wal_writer << std::endl;
+    std::cout << "  Durability: " << cfg.durability << std::endl;
     std::cout << "  Node ID: " << cfg.node_id << std::endl;
     std::cout << "  Mesh Port: " << cfg.mesh_port << std::endl;
     std::cout << "  Mesh Threads: " << cfg.mesh_threads << std::endl;
@@ -138,7 +193,40 @@ int main(int argc, char *argv[]) {
     lite3cpp::set_metrics(&global_metrics);
 
     // Initialize Database Engine
-    l3kv::Engine db(cfg.wal_path, cfg.node_id);
+    l3kv::WalOptions wal_opts;
+    wal_opts.file.direct = cfg.wal_direct_io;
+    wal_opts.file.preallocate_bytes = cfg.wal_preallocate_mb * 1024 * 1024;
+    if (cfg.wal_writer == "io_uring")
+      wal_opts.writer = l3kv::WalOptions::Writer::IO_URING;
+    wal_opts.uring_depth = cfg.wal_uring_depth;
+    wal_opts.buffer_bytes = (size_t)cfg.wal_buffer_mb * 1024 * 1024;
+    wal_opts.segment_bytes = (uint64_t)cfg.wal_segment_mb * 1024 * 1024;
+    if (cfg.durability == "group")
+      wal_opts.durability = l3kv::WalOptions::Durability::GROUP;
+    else if (cfg.durability == "always")
+      wal_opts.durability = l3kv::WalOptions::Durability::ALWAYS;
+    wal_opts.group_commit_us = cfg.group_commit_us;
+    wal_opts.group_commit_bytes = (size_t)cfg.group_commit_kb * 1024;
+    wal_opts.recovery_threads = cfg.recovery_threads;
+    l3kv::CheckpointOptions ckpt_opts;
+    ckpt_opts.wal_bytes = (uint64_t)cfg.checkpoint_mb * 1024 * 1024;
+    if (cfg.checkpoint_format == "heap")
+      ckpt_opts.format = l3kv::CheckpointOptions::Format::HEAP;
+    l3kv::RecoveryOptions rec_opts;
+    rec_opts.background = cfg.background_recovery;
+    l3kv::TieringOptions tier_opts;
+    tier_opts.memory_budget = cfg.memory_budget_mb * 1024 * 1024;
+    tier_opts.file_bytes = (uint64_t)cfg.value_log_file_mb * 1024 * 1024;
+    l3kv::DeltaOptions delta_opts;
+    delta_opts.enabled = cfg.patch_buffer_min_kb > 0;
+    delta_opts.min_value_bytes = (size_t)cfg.patch_buffer_min_kb * 1024;
+    delta_opts.fold_bytes = cfg.patch_fold_bytes;
+    l3kv::PagingOptions paging_opts;
+    paging_opts.min_value_bytes = (size_t)cfg.paged_value_min_kb * 1024;
+    l3kv::OrderedIndexOptions index_opts;
+    index_opts.enabled = cfg.ordered_index;
+    l3kv::Engine db(cfg.wal_path, cfg.node_id, wal_opts, ckpt_opts, rec_opts,
+                    tier_opts, delta_opts, paging_opts, index_opts);
 
     // Initialize Mesh and SyncManager (Replication)
     boost::asio::io_context io_context;
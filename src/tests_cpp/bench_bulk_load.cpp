@@ -0,0 +1,97 @@
+#include "../engine/store.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Benchmark: bulk load, one put() per key vs write_batch()
+// Loads KEY_COUNT small documents into an empty engine from one thread,
+// per WAL durability mode. put() logs and commits every key on its own;
+// write_batch() logs BATCH_SIZE keys as one record, waits for one commit
+// and takes each shard lock once per batch.
+
+using namespace l3kv;
+
+int KEY_COUNT = 200000;
+int BATCH_SIZE = 1000;
+
+std::string build_key(int id) { return "user" + std::to_string(id); }
+
+std::string build_record(int id) {
+  return "{\"id\":" + std::to_string(id) +
+         ",\"name\":\"user\",\"score\":100,\"active\":true}";
+}
+
+// Returns keys/sec.
+double run(WalOptions::Durability durability, bool batched, int keys) {
+  std::string path = "bench_bulk_load.wal";
+  std::filesystem::remove_all(path);
+  WalOptions wal;
+  wal.durability = durability;
+  CheckpointOptions ckpt;
+  ckpt.wal_bytes = 0;
+  double rate;
+  {
+    Engine db(path, 1, wal, ckpt);
+    auto start = std::chrono::high_resolution_clock::now();
+    if (batched) {
+      std::vector<WriteOp> batch;
+      for (int i = 0; i < keys; i += BATCH_SIZE) {
+        batch.clear();
+        for (int j = i; j < std::min(keys, i + BATCH_SIZE); ++j)
+          batch.push_back(WriteOp::put(build_key(j), build_record(j)));
+        db.write_batch(batch);
+      }
+    } else {
+      for (int i = 0; i < keys; ++i)
+        db.put(build_key(i), build_record(i));
+    }
+    db.flush();
+    auto end = std::chrono::high_resolution_clock::now();
+    rate = keys / std::chrono::duration<double>(end - start).count();
+  }
+  std::filesystem::remove_all(path);
+  return rate;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--keys" && i + 1 < argc) {
+      KEY_COUNT = std::stoi(argv[++i]);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      BATCH_SIZE = std::stoi(argv[++i]);
+    }
+  }
+
+  struct Mode {
+    const char *name;
+    WalOptions::Durability durability;
+    int keys; // Every put() waits for an fsync in ALWAYS mode
+  };
+  std::vector<Mode> modes = {
+      {"none", WalOptions::Durability::NONE, KEY_COUNT},
+      {"group", WalOptions::Durability::GROUP, KEY_COUNT / 10},
+      {"always", WalOptions::Durability::ALWAYS, KEY_COUNT / 100}};
+
+  try {
+    std::cout << std::left << std::setw(10) << "Sync" << std::setw(10)
+              << "Keys" << std::setw(16) << "put() keys/s" << std::setw(16)
+              << "batch keys/s"
+              << "Speedup\n";
+    for (const auto &m : modes) {
+      double single = run(m.durability, false, m.keys);
+      double batched = run(m.durability, true, m.keys);
+      std::cout << std::left << std::setw(10) << m.name << std::setw(10)
+                << m.keys << std::fixed << std::setprecision(0)
+                << std::setw(16) << single << std::setw(16) << batched
+                << std::setprecision(1) << batched / single << "x\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Fatal Error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
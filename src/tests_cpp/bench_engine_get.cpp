@@ -0,0 +1,126 @@
+#include "../engine/store.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmark: In-process Engine::get scaling (1..N threads)
+// Readers run under EpochManager guards, so throughput should grow linearly
+// with cores until memory bandwidth is saturated.
+
+using namespace l3kv;
+
+int RECORD_COUNT = 100000;
+int DURATION_MS = 2000;
+int MAX_THREADS = 0; // 0 = hardware_concurrency
+
+std::string build_key(int id) { return "user" + std::to_string(id); }
+
+std::string build_record(int id) {
+  std::string doc = "{\"id\":" + std::to_string(id);
+  for (int i = 0; i < 10; ++i)
+    doc += ",\"field" + std::to_string(i) + "\":\"" + std::string(100, 'x') +
+           "\"";
+  return doc + "}";
+}
+
+double run_readers(Engine &db, int threads) {
+  std::atomic<bool> go{false};
+  std::atomic<bool> stop{false};
+  std::vector<uint64_t> counts(threads * 8, 0); // Padded per-thread counters
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      std::mt19937 gen(12345 + t);
+      std::uniform_int_distribution<int> dist(0, RECORD_COUNT - 1);
+      std::vector<std::string> keys(4096);
+      for (auto &k : keys)
+        k = build_key(dist(gen));
+
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+      uint64_t n = 0;
+      size_t sink = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+          auto buf = db.get(keys[(n + i) & 4095]);
+          sink += buf.size();
+        }
+        n += 64;
+      }
+      counts[t * 8] = n + (sink == 0 ? 1 : 0);
+    });
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  go = true;
+  std::this_thread::sleep_for(std::chrono::milliseconds(DURATION_MS));
+  stop = true;
+  for (auto &w : workers)
+    w.join();
+  auto end = std::chrono::high_resolution_clock::now();
+
+  uint64_t total = 0;
+  for (int t = 0; t < threads; ++t)
+    total += counts[t * 8];
+  return total / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--records" && i + 1 < argc) {
+      RECORD_COUNT = std::stoi(argv[++i]);
+    } else if (arg == "--duration-ms" && i + 1 < argc) {
+      DURATION_MS = std::stoi(argv[++i]);
+    } else if (arg == "--max-threads" && i + 1 < argc) {
+      MAX_THREADS = std::stoi(argv[++i]);
+    }
+  }
+  if (MAX_THREADS <= 0)
+    MAX_THREADS = std::max(1u, std::thread::hardware_concurrency());
+
+  std::string path = "bench_engine_get.wal";
+  std::filesystem::remove_all(path);
+
+  try {
+    Engine db(path, 1);
+    std::cout << "Loading " << RECORD_COUNT << " records...\n";
+    for (int i = 0; i < RECORD_COUNT; ++i)
+      db.put(build_key(i), build_record(i));
+
+    std::cout << std::left << std::setw(10) << "Threads" << std::setw(16)
+              << "GET ops/sec" << std::setw(10) << "Speedup"
+              << "Efficiency\n";
+
+    std::vector<int> steps;
+    for (int t = 1; t < MAX_THREADS; t *= 2)
+      steps.push_back(t);
+    steps.push_back(MAX_THREADS);
+
+    double base = 0;
+    for (int threads : steps) {
+      double ops = run_readers(db, threads);
+      if (threads == 1)
+        base = ops;
+      double speedup = ops / base;
+      std::cout << std::left << std::setw(10) << threads << std::setw(16)
+                << std::fixed << std::setprecision(0) << ops << std::setw(10)
+                << std::setprecision(2) << speedup << std::setprecision(0)
+                << (100.0 * speedup / threads) << "%\n";
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Fatal Error: " << e.what() << "\n";
+    return 1;
+  }
+  std::filesystem::remove_all(path);
+  return 0;
+}
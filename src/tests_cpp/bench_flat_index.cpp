@@ -0,0 +1,114 @@
+#include "../engine/flat_index.hpp"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Benchmark: FlatIndex vs the previous per-shard std::unordered_map layout
+// (node bucket -> std::string key -> unique_ptr value). Keys are looked up
+// through std::string_view for FlatIndex and std::string for the map, which
+// is what Engine::get had to do before.
+
+using namespace l3kv;
+
+int KEY_COUNT = 10000000;
+int LOOKUP_COUNT = 10000000;
+
+struct Value {
+  uint64_t payload[4];
+};
+
+std::string build_key(int id) { return "user" + std::to_string(id); }
+
+template <class F> double time_s(F f) {
+  auto start = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+void report(const char *name, const char *phase, int ops, double secs) {
+  std::cout << std::left << std::setw(16) << name << std::setw(14) << phase
+            << std::fixed << std::setprecision(3) << std::setw(10) << secs
+            << std::setprecision(0) << (ops / secs) << " ops/sec\n";
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--keys" && i + 1 < argc) {
+      KEY_COUNT = std::stoi(argv[++i]);
+    } else if (arg == "--lookups" && i + 1 < argc) {
+      LOOKUP_COUNT = std::stoi(argv[++i]);
+    }
+  }
+
+  std::cout << "Building " << KEY_COUNT << " keys...\n";
+  std::vector<std::string> keys(KEY_COUNT);
+  for (int i = 0; i < KEY_COUNT; ++i)
+    keys[i] = build_key(i);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dist(0, KEY_COUNT - 1);
+  std::vector<int> hits(LOOKUP_COUNT);
+  for (auto &h : hits)
+    h = dist(gen);
+  std::vector<std::string> misses(LOOKUP_COUNT / 10);
+  for (size_t i = 0; i < misses.size(); ++i)
+    misses[i] = "miss" + std::to_string(i);
+
+  auto hasher = std::hash<std::string_view>{};
+  size_t sink = 0;
+
+  {
+    std::unordered_map<std::string, std::unique_ptr<Value>> map;
+    report("unordered_map", "insert", KEY_COUNT, time_s([&] {
+             for (auto &k : keys)
+               map[k] = std::make_unique<Value>();
+           }));
+    report("unordered_map", "lookup-hit", LOOKUP_COUNT, time_s([&] {
+             for (int i : hits) {
+               // Engine::get built a std::string from the request key
+               std::string k(keys[i].data(), keys[i].size());
+               if (auto it = map.find(k); it != map.end())
+                 sink += it->second->payload[0] + 1;
+             }
+           }));
+    report("unordered_map", "lookup-miss", (int)misses.size(), time_s([&] {
+             for (auto &k : misses)
+               sink += map.count(k);
+           }));
+  }
+
+  {
+    auto values = std::make_unique<Value[]>(KEY_COUNT);
+    FlatIndex<Value> idx;
+    report("FlatIndex", "insert", KEY_COUNT, time_s([&] {
+             for (int i = 0; i < KEY_COUNT; ++i)
+               idx.find_or_insert(keys[i], hasher(keys[i]))
+                   .store(&values[i], std::memory_order_relaxed);
+           }));
+    report("FlatIndex", "lookup-hit", LOOKUP_COUNT, time_s([&] {
+             EpochManager::Guard guard;
+             for (int i : hits) {
+               std::string_view k = keys[i];
+               if (auto *v = idx.find(k, hasher(k)))
+                 sink += v->load(std::memory_order_acquire)->payload[0] + 1;
+             }
+           }));
+    report("FlatIndex", "lookup-miss", (int)misses.size(), time_s([&] {
+             EpochManager::Guard guard;
+             for (auto &k : misses)
+               sink += idx.find(k, hasher(k)) != nullptr;
+           }));
+  }
+
+  EpochManager::instance().synchronize();
+  std::cout << "(checksum " << sink << ")\n";
+  return 0;
+}
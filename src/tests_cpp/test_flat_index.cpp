@@ -0,0 +1,49 @@
+#include "../engine/flat_index.hpp"
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace l3kv;
+
+uint64_t h(std::string_view k) { return std::hash<std::string_view>{}(k); }
+
+void test_insert_find_grow() {
+  std::cout << "TEST: FlatIndex insert/find across growth..." << std::endl;
+  FlatIndex<int> idx(16);
+  std::vector<int> values(5000);
+
+  for (int i = 0; i < 5000; ++i) {
+    // Mix inline (<=14 bytes) and heap-stored keys
+    std::string k = (i % 2) ? "k" + std::to_string(i)
+                            : "a-much-longer-key-" + std::to_string(i);
+    values[i] = i;
+    idx.find_or_insert(k, h(k)).store(&values[i]);
+  }
+  assert(idx.size() == 5000);
+
+  for (int i = 0; i < 5000; ++i) {
+    std::string k = (i % 2) ? "k" + std::to_string(i)
+                            : "a-much-longer-key-" + std::to_string(i);
+    auto *v = idx.find(k, h(k));
+    assert(v && *v->load() == i);
+  }
+  assert(idx.find("missing", h("missing")) == nullptr);
+
+  // Re-insert returns the existing slot
+  auto &again = idx.find_or_insert("k1", h("k1"));
+  assert(*again.load() == 1);
+  assert(idx.size() == 5000);
+
+  size_t visited = 0;
+  idx.for_each([&](std::string_view, std::atomic<int *> &) { ++visited; });
+  assert(visited == 5000);
+  EpochManager::instance().synchronize();
+  std::cout << "[PASS] FlatIndex insert/find/grow" << std::endl;
+}
+
+int main() {
+  test_insert_find_grow();
+  return 0;
+}
@@ -35,7 +35,34 @@ void test_merkle_xor() {
   std::cout << "[PASS] Multiple Keys impacting Root" << std::endl;
 }
 
+void test_merkle_image() {
+  std::cout << "TEST: Merkle Tree save/load..." << std::endl;
+  MerkleTree t;
+  for (int i = 0; i < 5000; ++i)
+    t.apply_delta("k" + std::to_string(i), 0x9E3779B97F4A7C15ULL * (i + 1));
+  auto image = t.nodes();
+  assert(image.size() == MerkleTree::NODE_COUNT);
+  assert(image.back() == t.get_root_hash());
+
+  // Installed as is: every level matches without recomputation
+  MerkleTree u;
+  assert(!u.load_nodes(std::span<const uint64_t>(image).first(10)));
+  assert(u.load_nodes(image));
+  assert(u.get_root_hash() == t.get_root_hash());
+  for (size_t i = 0; i < 4096; ++i)
+    assert(u.get_node_hash(3, i) == t.get_node_hash(3, i));
+  for (size_t i = 0; i < 65536; ++i)
+    assert(u.get_node_hash(4, i) == t.get_node_hash(4, i));
+
+  // Later deltas rehash on top of the loaded tree
+  t.apply_delta("k1", 7);
+  u.apply_delta("k1", 7);
+  assert(u.get_root_hash() == t.get_root_hash());
+  std::cout << "[PASS] Merkle Tree save/load" << std::endl;
+}
+
 int main() {
   test_merkle_xor();
+  test_merkle_image();
   return 0;
 }
@@ -4,7 +4,9 @@
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
+#ifdef _WIN32
 #include <winsock2.h>
+#endif
 
 #include "../engine/store.hpp"
 #include "../engine/sync_manager.hpp"
@@ -137,9 +139,9 @@ void test_satellite_uplink() {
   std::cout << "TEST: Satellite Uplink (Latency Simulation)..." << std::endl;
   // Setup
   // Clean up WALs
-  std::filesystem::remove("node_1.wal");
-  std::filesystem::remove("node_2.wal");
-  std::filesystem::remove("node_3.wal");
+  std::filesystem::remove_all("node_1.wal");
+  std::filesystem::remove_all("node_2.wal");
+  std::filesystem::remove_all("node_3.wal");
 
   VirtualNetwork net;
   Node n1(1, net);
@@ -184,9 +186,9 @@ void test_satellite_uplink() {
 void test_split_brain() {
   std::cout << "TEST: Split Brain (Partition & Heal)..." << std::endl;
   // Cleanup
-  std::filesystem::remove("node_1.wal");
-  std::filesystem::remove("node_2.wal");
-  std::filesystem::remove("node_3.wal");
+  std::filesystem::remove_all("node_1.wal");
+  std::filesystem::remove_all("node_2.wal");
+  std::filesystem::remove_all("node_3.wal");
 
   VirtualNetwork net;
   Node n1(1, net);
@@ -275,9 +277,9 @@ void test_split_brain() {
 void test_rolling_restart() {
   std::cout << "TEST: Rolling Restart (Persistence & Catch-up)..." << std::endl;
   // Cleanup
-  std::filesystem::remove("node_1.wal");
-  std::filesystem::remove("node_2.wal");
-  std::filesystem::remove("node_3.wal");
+  std::filesystem::remove_all("node_1.wal");
+  std::filesystem::remove_all("node_2.wal");
+  std::filesystem::remove_all("node_3.wal");
 
   VirtualNetwork net;
   // Use unique_ptr to allow easy destruction/reset
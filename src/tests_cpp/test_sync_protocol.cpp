@@ -0,0 +1,139 @@
+#include "../engine/sync_manager.hpp"
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+
+using namespace l3kv;
+
+// Records what a SyncManager sends instead of sending it
+struct FakeMesh : IMesh {
+  std::vector<std::pair<NodeID, std::vector<uint8_t>>> sent;
+
+  void connect(NodeID, const std::string &, int) override {}
+  bool send(NodeID peer_id, Lane, std::vector<uint8_t> payload) override {
+    sent.emplace_back(peer_id, std::move(payload));
+    return true;
+  }
+  void set_on_message(MessageCallback) override {}
+  void listen() override {}
+  std::vector<NodeID> get_active_peers() override { return {}; }
+};
+
+std::vector<uint8_t> message(uint8_t type, NodeID from,
+                             std::string_view body) {
+  std::vector<uint8_t> m(5);
+  m[0] = type;
+  std::memcpy(&m[1], &from, 4);
+  m.insert(m.end(), body.begin(), body.end());
+  return m;
+}
+
+std::vector<uint8_t> sync_init(NodeID from, int version) {
+  std::string body(8, '\0'); // Root 0: never matches
+  if (version > 1)
+    body += (char)version;
+  return message(0x01, from, body);
+}
+
+// The meta block of a SYNC_PUT_VAL
+std::string put_val_meta(const std::vector<uint8_t> &m) {
+  assert(m.size() >= 7 && m[0] == 0x07);
+  uint16_t klen, mlen;
+  std::memcpy(&klen, &m[5], 2);
+  std::memcpy(&mlen, &m[7 + klen], 2);
+  return std::string((const char *)&m[9 + klen], mlen);
+}
+
+// How a version 1 peer reads the meta block: the Lite3 "<key>:meta"
+// document, nothing else.
+struct OldMeta {
+  int64_t wall;
+  uint32_t logical, node;
+  bool tombstone;
+};
+OldMeta old_peer_decode(const std::string &meta) {
+  lite3cpp::Buffer buf(std::vector<uint8_t>(meta.begin(), meta.end()));
+  OldMeta out{0, 0, 0, false};
+  assert(buf.get_type(0, "ts") == lite3cpp::Type::Int64);
+  out.wall = buf.get_i64(0, "ts");
+  out.logical = (uint32_t)buf.get_i64(0, "l");
+  out.node = (uint32_t)buf.get_i64(0, "n");
+  if (buf.get_type(0, "tombstone") == lite3cpp::Type::Bool)
+    out.tombstone = buf.get_bool(0, "tombstone");
+  return out;
+}
+
+void test_meta_versions() {
+  std::cout << "TEST: Sync meta format per peer version..." << std::endl;
+  std::string path_a = "test_sync_proto_a.wal";
+  std::string path_b = "test_sync_proto_b.wal";
+  std::filesystem::remove_all(path_a);
+  std::filesystem::remove_all(path_b);
+  {
+    Engine a(path_a, 1), b(path_b, 3);
+    FakeMesh mesh_a, mesh_b;
+    SyncManager sync_a(mesh_a, a, 1), sync_b(mesh_b, b, 3);
+    a.put("k", R"({"v":1})");
+    a.put("gone", R"({"v":2})");
+    a.del("gone");
+    auto meta_k = *a.get_meta("k"), meta_gone = *a.get_meta("gone");
+
+    auto get_val = [&](NodeID from, std::string_view key) {
+      mesh_a.sent.clear();
+      sync_a.handle_message(from, message(0x06, from, key));
+      assert(mesh_a.sent.size() == 1 && mesh_a.sent[0].first == from);
+      return mesh_a.sent[0].second;
+    };
+
+    // Peer 2 never advertised a version: it gets the old document
+    auto old_k = old_peer_decode(put_val_meta(get_val(2, "k")));
+    assert(old_k.wall == meta_k.ts.wall_time &&
+           old_k.logical == meta_k.ts.logical &&
+           old_k.node == meta_k.ts.node_id && !old_k.tombstone);
+    auto old_gone = old_peer_decode(put_val_meta(get_val(2, "gone")));
+    assert(old_gone.wall == meta_gone.ts.wall_time && old_gone.tombstone);
+
+    // A version 1 SYNC_INIT keeps it that way
+    sync_a.handle_message(2, sync_init(2, 1));
+    old_peer_decode(put_val_meta(get_val(2, "k")));
+
+    // Once peer 2 advertises version 2, the binary block
+    sync_a.handle_message(2, sync_init(2, 2));
+    auto new_k = get_val(2, "k");
+    assert(put_val_meta(new_k).size() == 17);
+
+    // Downgraded (restarted on an old build): back to the document
+    sync_a.handle_message(2, sync_init(2, 1));
+    auto legacy_gone = get_val(2, "gone");
+    old_peer_decode(put_val_meta(legacy_gone));
+
+    // A current receiver applies both formats
+    sync_b.handle_message(2, new_k);
+    sync_b.handle_message(2, legacy_gone);
+    assert(b.get_meta("k")->ts == meta_k.ts);
+    assert(b.get("k").size() == a.get("k").size());
+    assert(b.get_meta("gone")->ts == meta_gone.ts);
+    assert(b.get_meta("gone")->is_tombstone());
+
+    // SYNC_REQ_BUCKET carries the version too
+    std::string bucket(4, '\0');
+    sync_a.handle_message(4, message(0x04, 4, bucket + '\x02'));
+    assert(put_val_meta(get_val(4, "k")).size() == 17);
+    sync_a.handle_message(5, message(0x04, 5, bucket));
+    old_peer_decode(put_val_meta(get_val(5, "k")));
+  }
+  std::filesystem::remove_all(path_a);
+  std::filesystem::remove_all(path_b);
+  std::cout << "[PASS] Sync meta format per peer version" << std::endl;
+}
+
+int main() {
+  try {
+    test_meta_versions();
+    std::cout << "All Sync Protocol Tests Passed!" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Test Failed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -20,7 +20,7 @@ struct Node {
 
   Node(uint32_t node_id, int port) : id(node_id) {
     db_path = "sync_node_" + std::to_string(id) + ".wal";
-    std::remove(db_path.c_str());
+    std::filesystem::remove_all(db_path);
 
     engine = std::make_unique<Engine>(db_path, id);
     mesh = std::make_unique<Mesh>(io, id, port);
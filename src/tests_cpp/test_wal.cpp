@@ -1,18 +1,32 @@
 #include "../engine/wal.hpp"
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
 using namespace l3kv;
 
+// First segment file of the WAL directory at `path`.
+static std::string first_segment(const std::string &path) {
+  return path + "/0000000000000000.wal";
+}
+
 void test_simple_append_recover() {
   std::string path = "test_simple.wal";
-  std::filesystem::remove(path);
+  std::filesystem::remove_all(path);
 
   {
     WriteAheadLog wal(path);
-    wal.recover([](WalOp, std::string_view, std::string_view) {});
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
     wal.append(WalOp::PUT, "key1", "val1");
     wal.append(WalOp::DELETE_, "key2", "");
     wal.flush();
@@ -21,7 +35,8 @@ void test_simple_append_recover() {
   {
     WriteAheadLog wal(path);
     std::vector<std::string> ops;
-    wal.recover([&](WalOp op, std::string_view key, std::string_view val) {
+    wal.recover([&](WalOp op, std::string_view key, std::string_view val,
+                    const Timestamp &) {
       ops.push_back(std::string(key) + ":" + std::string(val));
     });
 
@@ -30,21 +45,22 @@ void test_simple_append_recover() {
     assert(ops[1] == "key2:");
     std::cout << "[PASS] Simple Append/Recover" << std::endl;
   }
-  std::filesystem::remove(path);
+  std::filesystem::remove_all(path);
 }
 
 void test_batch_append_recover() {
   std::cout << "TEST: batch_append_recover start" << std::endl;
   std::string path = "test_batch.wal";
-  std::filesystem::remove(path);
+  std::filesystem::remove_all(path);
 
   {
     WriteAheadLog wal(path);
-    wal.recover([](WalOp, std::string_view, std::string_view) {});
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
 
     std::vector<BatchOp> batch;
     batch.push_back({WalOp::PUT, "bkey1", "bval1"});
-    batch.push_back({WalOp::PUT, "bkey2", "bval2"});
+    batch.push_back({WalOp::PUT, "bkey2", "bval2", {1234, 5, 7}});
 
     wal.append_batch(batch);
     wal.flush();
@@ -53,16 +69,616 @@ void test_batch_append_recover() {
   {
     WriteAheadLog wal(path);
     std::vector<std::string> ops;
-    wal.recover([&](WalOp op, std::string_view key, std::string_view val) {
+    std::vector<Timestamp> stamps;
+    wal.recover([&](WalOp op, std::string_view key, std::string_view val,
+                    const Timestamp &ts) {
       ops.push_back(std::string(key) + ":" + std::string(val));
+      stamps.push_back(ts);
     });
 
     assert(ops.size() == 2);
     assert(ops[0] == "bkey1:bval1");
     assert(ops[1] == "bkey2:bval2");
+    assert((stamps[0] == Timestamp{0, 0, 0}));
+    assert((stamps[1] == Timestamp{1234, 5, 7}));
     std::cout << "[PASS] Batch Append/Recover" << std::endl;
   }
-  std::filesystem::remove(path);
+  std::filesystem::remove_all(path);
+}
+
+// Record as written before CRC32C: op without flag, bitwise CRC32
+static void write_legacy_record(std::ofstream &out, WalOp op,
+                                std::string_view key, std::string_view val) {
+  uint32_t crc = 0xFFFFFFFF;
+  auto process = [&](const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+      crc ^= p[i];
+      for (int j = 0; j < 8; j++)
+        crc = (crc >> 1) ^ (0xEDB88320 & (-(crc & 1)));
+    }
+  };
+  uint8_t op_byte = (uint8_t)op;
+  process(&op_byte, 1);
+  process(key.data(), key.size());
+  process(val.data(), val.size());
+  LogHeader h{~crc, op_byte, (uint16_t)key.size(), (uint32_t)val.size()};
+  out.write((const char *)&h, sizeof(h));
+  out.write(key.data(), key.size());
+  out.write(val.data(), val.size());
+}
+
+void test_crc_versions() {
+  std::string path = "test_crc.wal";
+  std::filesystem::remove_all(path);
+
+  {
+    std::ofstream out(path, std::ios::binary);
+    write_legacy_record(out, WalOp::PUT, "old", "legacy-crc32");
+  }
+  {
+    // Append CRC32C records after the legacy one
+    WriteAheadLog wal(path);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    wal.append(WalOp::PUT, "new", "crc32c");
+    wal.append(WalOp::DELETE_, "gone", "");
+    wal.flush();
+  }
+  {
+    WriteAheadLog wal(path);
+    std::vector<std::string> ops;
+    wal.recover([&](WalOp op, std::string_view key, std::string_view val,
+                    const Timestamp &) {
+      ops.push_back(std::to_string((int)op) + ":" + std::string(key) + ":" +
+                    std::string(val));
+    });
+    assert(ops.size() == 3);
+    assert(ops[0] == "1:old:legacy-crc32");
+    assert(ops[1] == "1:new:crc32c");
+    assert(ops[2] == "3:gone:");
+  }
+
+  // Corrupt the payload of the CRC32C record: replay stops before it
+  {
+    std::fstream f(first_segment(path),
+                   std::ios::in | std::ios::out | std::ios::binary);
+    size_t legacy_len = sizeof(LogHeader) + 3 + 12;
+    f.seekp(legacy_len + sizeof(LogHeader) + 3);
+    f.put('X');
+  }
+  {
+    WriteAheadLog wal(path);
+    std::vector<std::string> keys;
+    wal.recover([&](WalOp, std::string_view key, std::string_view,
+                    const Timestamp &) { keys.emplace_back(key); });
+    assert(keys.size() == 1 && keys[0] == "old");
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] CRC32C records + legacy CRC32 records" << std::endl;
+}
+
+// Torn tail and (on POSIX) preallocated / O_DIRECT files: recovery stops
+// at the last intact record and new appends continue right after it.
+void test_tail_recovery(WalOptions opts, const char *name) {
+  std::string path = "test_tail.wal";
+  std::filesystem::remove_all(path);
+
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    for (int i = 0; i < 100; ++i)
+      wal.append(WalOp::PUT, "k" + std::to_string(i), std::string(i, 'v'));
+    wal.flush();
+  }
+  size_t clean_size = std::filesystem::file_size(first_segment(path));
+  {
+    // Half a header of garbage, as left by a crash mid-append
+    std::ofstream out(first_segment(path), std::ios::binary | std::ios::app);
+    out.write("\x01\x02\x03\x04\x05", 5);
+  }
+  {
+    WriteAheadLog wal(path, opts);
+    int n = 0;
+    wal.recover([&](WalOp, std::string_view, std::string_view,
+                    const Timestamp &) { ++n; });
+    assert(n == 100);
+    wal.append(WalOp::DELETE_, "k0", "");
+    wal.flush();
+  }
+  {
+    WriteAheadLog wal(path, opts);
+    std::vector<std::string> keys;
+    wal.recover([&](WalOp op, std::string_view key, std::string_view,
+                    const Timestamp &) {
+      if (op == WalOp::DELETE_)
+        keys.emplace_back(key);
+    });
+    assert(keys.size() == 1 && keys[0] == "k0");
+  }
+  // Preallocated space and block padding are trimmed on close
+  assert(std::filesystem::file_size(first_segment(path)) ==
+         clean_size + sizeof(LogHeader) + 2);
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Tail recovery (" << name << ")" << std::endl;
+}
+
+#ifdef L3KV_WAL_URING
+// Concurrent appenders waiting on their own positions, small buffers so
+// batches fill, wrap and (with O_DIRECT) carry partial blocks.
+void test_uring_writer(wal::FileOptions file, const char *name) {
+  std::string path = "test_uring.wal";
+  std::filesystem::remove_all(path);
+
+  WalOptions opts;
+  opts.file = file;
+  opts.writer = WalOptions::Writer::IO_URING;
+  opts.uring_depth = 3;
+  opts.uring_buffer_bytes = 8192;
+
+  const int threads = 4, per_thread = 500;
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    std::vector<std::thread> ts;
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        for (int i = 0; i < per_thread; ++i) {
+          std::string key = "t" + std::to_string(t) + ":" + std::to_string(i);
+          uint64_t lsn = wal.append(WalOp::PUT, key, std::string(i % 97, 'x'));
+          if (i % 50 == 0)
+            assert(wal.wait_durable(lsn));
+        }
+      });
+    }
+    for (auto &t : ts)
+      t.join();
+    wal.flush();
+    assert(wal.stats().bytes_written > 0);
+  }
+  {
+    WriteAheadLog wal(path); // Read back through the conveyor path
+    std::set<std::string> keys;
+    wal.recover([&](WalOp, std::string_view key, std::string_view val,
+                    const Timestamp &) {
+      keys.emplace(key);
+      size_t i = std::stoul(std::string(key.substr(key.find(':') + 1)));
+      assert(val == std::string(i % 97, 'x'));
+    });
+    assert(keys.size() == threads * per_thread);
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] " << name << " writer" << std::endl;
+}
+#endif
+
+// Concurrent committers: every commit returns durable, and GROUP mode
+// shares syncs between them.
+void test_group_commit(WalOptions::Durability mode, bool uring,
+                       const char *name) {
+  std::string path = "test_group.wal";
+  std::filesystem::remove_all(path);
+
+  WalOptions opts;
+  opts.durability = mode;
+  opts.group_commit_us = 2000;
+  if (uring)
+    opts.writer = WalOptions::Writer::IO_URING;
+
+  const int threads = 8, per_thread = 100;
+  uint64_t syncs;
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    std::vector<std::thread> ts;
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        for (int i = 0; i < per_thread; ++i) {
+          uint64_t lsn = wal.append_batch(
+              {{WalOp::PUT, "k" + std::to_string(t * per_thread + i), "v"}});
+          assert(wal.commit(lsn));
+          assert(wal.durable_lsn() >= lsn);
+        }
+      });
+    }
+    for (auto &t : ts)
+      t.join();
+    syncs = wal.sync_count();
+  }
+  if (mode == WalOptions::Durability::GROUP)
+    assert(syncs < threads * per_thread);
+  {
+    WriteAheadLog wal(path);
+    int n = 0;
+    wal.recover([&](WalOp, std::string_view, std::string_view,
+                    const Timestamp &) { ++n; });
+    assert(n == threads * per_thread);
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Durability " << name << " (" << syncs << " syncs for "
+            << threads * per_thread << " commits)" << std::endl;
+}
+
+// Many appenders through a tiny log buffer: records wrap around the ring and
+// writers wait for space, some records are larger than the whole ring, yet
+// every record comes back intact.
+void test_concurrent_append(wal::FileOptions file, const char *name) {
+  std::string path = "test_concurrent.wal";
+  std::filesystem::remove_all(path);
+
+  WalOptions opts;
+  opts.file = file;
+  opts.buffer_bytes = 0; // The smallest ring
+
+  const int threads = 8, per_thread = 500;
+  auto size = [](int i) { return i % 97 == 1 ? 6000 + i : i % 200; };
+  uint64_t full_waits;
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    std::vector<std::thread> ts;
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        for (int i = 0; i < per_thread; ++i) {
+          std::string key = "k" + std::to_string(t * per_thread + i);
+          std::string val(size(i), (char)('a' + t));
+          if (i % 2)
+            wal.append(WalOp::PUT, key, val);
+          else
+            wal.append_batch({{WalOp::PUT, key, val, {1, (uint32_t)i, 2}}});
+        }
+      });
+    }
+    for (auto &t : ts)
+      t.join();
+    wal.flush();
+    full_waits = wal.stats().write_buffer_full_events;
+  }
+  {
+    WriteAheadLog wal(path);
+    std::set<std::string> keys;
+    wal.recover([&](WalOp, std::string_view key, std::string_view val,
+                    const Timestamp &) {
+      int id = std::stoi(std::string(key.substr(1)));
+      int t = id / per_thread, i = id % per_thread;
+      assert(val == std::string(size(i), (char)('a' + t)));
+      keys.insert(std::string(key));
+    });
+    assert(keys.size() == (size_t)threads * per_thread);
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Concurrent append " << name << " (" << full_waits
+            << " buffer-full waits)" << std::endl;
+}
+
+// In-memory file for a wal::LogBuffer; every write fails while `failing`
+// is set, as on a transient EIO or ENOSPC.
+struct FlakyFile {
+  std::mutex mx;
+  std::string bytes;
+  std::atomic<bool> failing{false};
+  std::atomic<int> failures{0};
+
+  static ssize_t pwrite(storage_handle_t h, const void *p, size_t n,
+                        off_t off) {
+    auto *f = static_cast<FlakyFile *>(h);
+    if (f->failing.load()) {
+      f->failures.fetch_add(1);
+      errno = EIO;
+      return -1;
+    }
+    std::lock_guard lock(f->mx);
+    if (f->bytes.size() < (size_t)off + n)
+      f->bytes.resize((size_t)off + n, '\0');
+    std::memcpy(f->bytes.data() + off, p, n);
+    return (ssize_t)n;
+  }
+};
+
+// Test record framing: [Len:4][Marker:1][Body:Len]
+struct TestRecord {
+  static constexpr size_t HEADER_SIZE = 5;
+  static constexpr size_t MARKER_OFFSET = 4;
+  static size_t record_size(const uint8_t *header) {
+    uint32_t len;
+    std::memcpy(&len, header, 4);
+    return HEADER_SIZE + len;
+  }
+};
+
+// A failed log buffer write is retried in place: records acknowledged
+// after it are not lost behind a hole, appends are refused meanwhile, and
+// the buffer takes writes again once the file does. Record 150 is larger
+// than the ring and goes straight to the file.
+void test_log_buffer_write_failure() {
+  FlakyFile file;
+  storage_operations_t ops{};
+  ops.pwrite_fn = &FlakyFile::pwrite;
+  auto body = [](int i) {
+    return std::to_string(i) + std::string(i == 150 ? 10000 : i % 50, 'x');
+  };
+  int next = 0;
+  {
+    wal::LogBuffer<TestRecord> buf(&file, ops, 0, 4096);
+    auto append = [&] {
+      std::string b = body(next++);
+      uint32_t len = (uint32_t)b.size();
+      if (TestRecord::HEADER_SIZE + len > buf.capacity()) {
+        std::string rec(TestRecord::HEADER_SIZE, '\xA5');
+        std::memcpy(rec.data(), &len, 4);
+        rec += b;
+        return buf.append_direct(rec.data(), rec.size());
+      }
+      uint64_t pos = buf.reserve(TestRecord::HEADER_SIZE + len);
+      buf.write(pos, &len, 4);
+      buf.write(pos + TestRecord::HEADER_SIZE, b.data(), len);
+      buf.publish(pos, 0xA5);
+      return pos + TestRecord::HEADER_SIZE + len;
+    };
+
+    uint64_t end = 0;
+    for (int i = 0; i < 100; ++i)
+      end = append();
+    assert(buf.wait_flushed(end) && !buf.failed());
+
+    file.failing = true;
+    for (int i = 0; i < 10; ++i)
+      end = append();
+    assert(!buf.wait_flushed(end)); // Reports the failure, does not hang
+    assert(buf.failed());
+    bool refused = false;
+    try {
+      buf.reserve(64);
+    } catch (const wal::WriteFailed &) {
+      refused = true;
+    }
+    assert(refused);
+
+    file.failing = false;
+    for (int i = 0; i < 5000 && buf.failed(); ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(!buf.failed() && buf.wait_flushed(end));
+    for (int i = 0; i < 100; ++i)
+      end = append();
+    assert(buf.wait_flushed(end));
+    assert(file.bytes.size() == end);
+  }
+  assert(file.failures > 0);
+
+  // Every record, in order, with no gap where the write failed
+  size_t at = 0;
+  for (int i = 0; i < next; ++i) {
+    uint32_t len;
+    std::memcpy(&len, file.bytes.data() + at, 4);
+    assert((uint8_t)file.bytes[at + 4] == 0xA5);
+    assert(file.bytes.compare(at + TestRecord::HEADER_SIZE, len, body(i)) ==
+           0);
+    at += TestRecord::HEADER_SIZE + len;
+  }
+  assert(at == file.bytes.size());
+  std::cout << "[PASS] Log buffer write failure (" << file.failures
+            << " failed writes retried)" << std::endl;
+}
+
+// Records straddle segment boundaries; replay from a checkpoint LSN skips
+// everything before it, even once the segments holding it are removed.
+void test_segments(WalOptions opts, const char *name) {
+  std::string path = "test_segments.wal";
+  std::filesystem::remove_all(path);
+  opts.segment_bytes = 1 << 20;
+
+  const int n = 3000, ckpt = 2000; // ~3 MiB of 1000-byte values
+  auto value = [](int i) { return std::string(1000, (char)('a' + i % 26)); };
+  uint64_t ckpt_lsn = 0;
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    for (int i = 0; i < n; ++i) {
+      uint64_t lsn = wal.append(WalOp::PUT, "k" + std::to_string(i), value(i));
+      if (i == ckpt - 1)
+        ckpt_lsn = lsn;
+    }
+    wal.flush();
+    assert(wal.segment_count() >= 3);
+  }
+  {
+    WriteAheadLog wal(path, opts);
+    int next = 0;
+    wal.recover([&](WalOp, std::string_view key, std::string_view val,
+                    const Timestamp &) {
+      assert(key == "k" + std::to_string(next) && val == value(next));
+      ++next;
+    });
+    assert(next == n);
+    assert(wal.remove_segments_before(ckpt_lsn) >= 1);
+    wal.append(WalOp::DELETE_, "k0", "");
+    wal.flush();
+  }
+  {
+    WriteAheadLog wal(path, opts);
+    int next = ckpt;
+    bool deleted = false;
+    wal.recover(
+        [&](WalOp op, std::string_view key, std::string_view val,
+            const Timestamp &) {
+          if (op == WalOp::DELETE_) {
+            deleted = true;
+            return;
+          }
+          assert(key == "k" + std::to_string(next) && val == value(next));
+          ++next;
+        },
+        ckpt_lsn);
+    assert(next == n && deleted);
+
+    bool refused = false;
+    try {
+      WriteAheadLog again(path, opts);
+      again.recover([](WalOp, std::string_view, std::string_view,
+                       const Timestamp &) {});
+    } catch (const std::runtime_error &) {
+      refused = true; // Oldest segment starts mid-record
+    }
+    assert(refused);
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Segments (" << name << ")" << std::endl;
+}
+
+// Binary patch payloads and single timestamped records round-trip; field
+// names may contain ':' and values span the whole int64 range.
+void test_binary_patch_records() {
+  std::string path = "test_binary_patch.wal";
+  std::filesystem::remove_all(path);
+
+  const int64_t ints[] = {0, -1, 1, 300, -300, INT64_MIN, INT64_MAX};
+  for (int64_t v : ints) {
+    std::string_view field, value;
+    int64_t back = 0;
+    std::string p = patch_format::encode_i64("a:b", v);
+    assert(patch_format::decode(p, field, value) && field == "a:b");
+    assert(patch_format::decode_i64(value, back) && back == v);
+  }
+  std::string_view field, value;
+  assert(!patch_format::decode("\x05ab", field, value)); // Field overruns
+  int64_t dummy;
+  assert(!patch_format::decode_i64("\x80", dummy));        // Unterminated
+
+  std::string small = patch_format::encode_i64("n", 5);
+  assert(small.size() < std::string("n:5").size() + 1);
+  {
+    WriteAheadLog wal(path);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    wal.append(WalOp::PATCH_I64_BIN, "k", patch_format::encode_i64("x:y", -7),
+               {1234, 5, 7});
+    wal.append(WalOp::PATCH_STR_BIN, "k",
+               patch_format::encode_str("s", "with:colon"), {1235, 0, 7});
+    wal.append(WalOp::PUT, "plain", "v"); // No timestamp
+    wal.flush();
+  }
+  {
+    WriteAheadLog wal(path);
+    int n = 0;
+    wal.recover([&](WalOp op, std::string_view key, std::string_view val,
+                    const Timestamp &ts) {
+      std::string_view f, v;
+      int64_t i = 0;
+      if (n == 0) {
+        assert(op == WalOp::PATCH_I64_BIN && key == "k");
+        assert((ts == Timestamp{1234, 5, 7}));
+        assert(patch_format::decode(val, f, v) && f == "x:y");
+        assert(patch_format::decode_i64(v, i) && i == -7);
+      } else if (n == 1) {
+        assert(op == WalOp::PATCH_STR_BIN && (ts == Timestamp{1235, 0, 7}));
+        assert(patch_format::decode(val, f, v) && f == "s" &&
+               v == "with:colon");
+      } else {
+        assert(op == WalOp::PUT && val == "v" && (ts == Timestamp{0, 0, 0}));
+      }
+      ++n;
+    });
+    assert(n == 3);
+  }
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Binary patch records" << std::endl;
+}
+
+// Partitioned replay on several threads: every op reaches its partition in
+// log order, across segment boundaries, and replay stops at a corrupt
+// record as a serial scan would.
+void test_parallel_recovery() {
+  std::string path = "test_parallel.wal";
+  std::filesystem::remove_all(path);
+  WalOptions opts;
+  opts.segment_bytes = 1 << 20;
+  opts.recovery_threads = 4;
+
+  const int n = 6000, bad = 4000, keys = 97;
+  const size_t parts = 8;
+  auto key_of = [](int i) { return "k" + std::to_string(i % keys); };
+  auto value = [](int i) {
+    return std::to_string(i) + ":" + std::string(300 + i % 500, 'v');
+  };
+  uint64_t bad_pos = 0;
+  size_t ops_before_bad = 0, ops_total = 0;
+  {
+    WriteAheadLog wal(path, opts);
+    wal.recover([](WalOp, std::string_view, std::string_view,
+                   const Timestamp &) {});
+    uint64_t lsn = 0;
+    for (int i = 0; i < n; ++i) {
+      if (i == bad) {
+        bad_pos = lsn;
+        ops_before_bad = ops_total;
+      }
+      if (i % 10 == 0) {
+        lsn = wal.append_batch({{WalOp::PUT, key_of(i), value(i), {1, 0, 1}},
+                                {WalOp::DELETE_, "gone", "", {1, 0, 1}}});
+        ops_total += 2;
+      } else {
+        lsn = wal.append(WalOp::PUT, key_of(i), value(i));
+        ops_total += 1;
+      }
+    }
+    wal.flush();
+    assert(wal.segment_count() >= 3);
+  }
+
+  auto replay = [&](size_t &count) {
+    WriteAheadLog wal(path, opts);
+    std::vector<std::map<std::string, int>> last(parts);
+    auto partition = [](const ReplayOp &op) {
+      return std::hash<std::string_view>{}(op.key);
+    };
+    std::atomic<size_t> seen{0};
+    wal.recover(parts, partition, [&](size_t p, const ReplayOp &op) {
+      assert(partition(op) % parts == p);
+      seen.fetch_add(1);
+      if (op.op != WalOp::PUT)
+        return;
+      int seq = std::stoi(std::string(op.payload.substr(0, 6)));
+      auto [it, fresh] = last[p].try_emplace(std::string(op.key), seq);
+      assert(fresh || it->second < seq); // Log order within the partition
+      it->second = seq;
+    });
+    count = seen.load();
+    return wal.appended_lsn();
+  };
+
+  size_t count = 0;
+  replay(count);
+  assert(count == ops_total);
+
+  // Flip a key byte of record `bad` in whichever segment holds it
+  uint64_t target = bad_pos + sizeof(LogHeader) + 1;
+  uint64_t seg_start = 0;
+  for (auto &e : std::filesystem::directory_iterator(path)) {
+    uint64_t start = std::stoull(e.path().stem().string(), nullptr, 16);
+    if (start <= target && start > seg_start)
+      seg_start = start;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016llx.wal",
+                (unsigned long long)seg_start);
+  {
+    std::fstream f(path + name,
+                   std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp((std::streamoff)(target - seg_start));
+    f.put('#');
+  }
+  assert(replay(count) == bad_pos); // Truncated before the bad record
+  assert(count == ops_before_bad);
+  assert(replay(count) == bad_pos);
+  assert(count == ops_before_bad);
+
+  std::filesystem::remove_all(path);
+  std::cout << "[PASS] Parallel recovery" << std::endl;
 }
 
 int main() {
@@ -71,6 +687,31 @@ int main() {
     test_simple_append_recover();
     // batch test will fail to compile until we add the method
     test_batch_append_recover();
+    test_crc_versions();
+    test_binary_patch_records();
+    test_tail_recovery({}, "default");
+    test_tail_recovery({{false, 1 << 20}}, "preallocate");
+    test_tail_recovery({{true, 1 << 20}}, "direct + preallocate");
+    test_segments({}, "buffered");
+    test_parallel_recovery();
+    test_concurrent_append({}, "buffered");
+    test_concurrent_append({true, 1 << 20}, "direct");
+    test_log_buffer_write_failure();
+    test_group_commit(WalOptions::Durability::ALWAYS, false, "always");
+    test_group_commit(WalOptions::Durability::GROUP, false, "group");
+#ifdef L3KV_WAL_URING
+    test_group_commit(WalOptions::Durability::GROUP, true, "group + io_uring");
+    test_uring_writer({}, "io_uring");
+    test_uring_writer({true, 1 << 20}, "io_uring + direct");
+    {
+      WalOptions opts;
+      opts.writer = WalOptions::Writer::IO_URING;
+      opts.uring_buffer_bytes = 64 * 1024;
+      test_segments(opts, "io_uring");
+      opts.file.direct = true;
+      test_segments(opts, "io_uring + direct");
+    }
+#endif
     std::cout << "All WAL Tests Passed!" << std::endl;
   } catch (const std::exception &e) {
     std::cerr << "Test Failed: " << e.what() << std::endl;
@@ -0,0 +1,30 @@
+// l3kv-compact: rewrites a WAL directory down to its live set.
+//
+//   l3kv-compact <wal dir> <output dir>
+//
+// Run it while the server is stopped, then swap the output directory in for
+// the original (see engine/wal_compact.hpp).
+
+#include "engine/wal_compact.hpp"
+
+#include <exception>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <wal dir> <output dir>\n";
+    return 2;
+  }
+  try {
+    auto st = l3kv::compact_wal(argv[1], argv[2]);
+    std::cout << "Compacted " << argv[1] << " -> " << argv[2] << "\n"
+              << "  From LSN: " << st.lsn << "\n"
+              << "  Ops:      " << st.ops_in << " -> " << st.ops_out << "\n"
+              << "  Bytes:    " << st.bytes_in << " -> " << st.bytes_out
+              << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "l3kv-compact: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}